@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// bump allocator for short-lived scratch memory, blocks are kept across
+// resets so a repeated workload stops allocating once it has warmed up
+class Arena {
+  public:
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    Arena(size_t block_size = 1 << 20);
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate_bytes(size_t size, size_t alignment);
+
+    template <typename T> std::span<T> allocate(size_t count);
+
+    Marker get_marker() const;
+
+    void rewind(const Marker& marker);
+
+    void reset();
+
+    // number of blocks requested from the heap over the arena's lifetime
+    size_t get_allocation_count() const;
+
+    size_t get_capacity() const;
+
+    static Arena& get_thread_arena();
+
+  private:
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    size_t m_block_size;
+    std::vector<Block> m_blocks;
+    size_t m_block = 0;
+    size_t m_offset = 0;
+    size_t m_allocation_count = 0;
+};
+
+// rewinds the arena to where it was when the scope was opened
+class ArenaScope {
+  public:
+    ArenaScope(Arena& arena);
+
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+  private:
+    Arena& m_arena;
+    Arena::Marker m_marker;
+};
+
+template <typename T> std::span<T> Arena::allocate(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena memory is released without running destructors");
+    T* data = (T*)allocate_bytes(count * sizeof(T), alignof(T));
+    return std::span<T>(data, count);
+}
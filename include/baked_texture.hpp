@@ -0,0 +1,79 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// on-disk layout of a baked texture: header, level table, then the pixel data
+// of every level, already flipped for OpenGL and aligned to 16 bytes
+struct BakedTextureHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t internal_format;
+    // zero for compressed formats
+    uint32_t format;
+    uint32_t type;
+    uint32_t channel_count;
+};
+
+struct BakedTextureLevel {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+inline constexpr char BAKED_TEXTURE_MAGIC[4] = {'F', 'T', 'E', 'X'};
+inline constexpr uint32_t BAKED_TEXTURE_VERSION = 1;
+inline constexpr const char* BAKED_TEXTURE_EXTENSION = ".ftex";
+
+class MappedFile {
+  public:
+    MappedFile(const std::filesystem::path& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const;
+
+    const uint8_t* get_data() const;
+
+    size_t get_size() const;
+
+  private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+class BakedTexture {
+  public:
+    BakedTexture(const std::filesystem::path& path);
+
+    bool is_valid() const;
+
+    const BakedTextureHeader& get_header() const;
+
+    const BakedTextureLevel& get_level(int level) const;
+
+    const uint8_t* get_level_data(int level) const;
+
+    bool is_compressed() const;
+
+    static bool is_baked_texture(const std::filesystem::path& path);
+
+  private:
+    MappedFile m_file;
+    const BakedTextureHeader* m_header = nullptr;
+    const BakedTextureLevel* m_levels = nullptr;
+};
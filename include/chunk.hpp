@@ -1,45 +1,304 @@
 #pragma once
 
+#include "heightfield.hpp"
+#include "instance_pool.hpp"
 #include "mesh.hpp"
+#include "render_queue.hpp"
 #include "renderer.hpp"
 #include "shader.hpp"
+#include "texture_array.hpp"
+#include "upload.hpp"
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+class ComputeScheduler;
+class SpeciesSet;
+class TerrainGenerator;
+class VegetationBatch;
 
 struct GrassBuffer {
     glm::mat4 transform;
     glm::mat4 sway;
 };
 
+// per-dispatch data of the flow field and displacement passes
+struct ChunkParameters {
+    glm::vec2 offset;
+    float shift;
+    int size;
+    int grass_count;
+    // noise map layer
+    int layer;
+    // first instance of the chunk in its instance buffer
+    int first_instance;
+    // std430 rounds the array stride up to the vec2 alignment
+    int padding;
+};
+
+// per-draw data of procedural blades, read by gpu_instancing.glsl in place
+// of the instance buffer. each draw covers every cell of a chunk for one
+// species
+struct ProceduralBlades {
+    // xyz and the cell spacing
+    glm::vec4 lower_bound;
+    // xyz and the terrain height
+    glm::vec4 upper_bound;
+    // cells per side
+    int width;
+    int height_layer;
+    int noise_layer;
+    int species;
+};
+
+constexpr int CHUNK_PARAMETERS_BINDING = 2;
+// distance buckets per species of the instance depth sort
+constexpr int SORT_BUCKET_COUNT = 64;
+
+struct ChunkVisibility {
+    bool cull = false;
+    // ground drawn with the low poly mesh and blades left unanimated
+    bool far = false;
+    bool grass = true;
+};
+
+// cpu side of a chunk: ground meshes, height map and heightfield. building
+// it touches no GL state, so it can run on any thread
+struct ChunkGeometry {
+    glm::ivec2 coordinate;
+    int size;
+    float terrain_height;
+    float terrain_scale;
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // meshes, heights and heightfield are left to a TerrainGenerator and min
+    // and max only bound the terrain. a heightfield set anyway is the cpu
+    // build the gpu one is validated against
+    bool gpu_terrain = false;
+
+    std::vector<Vertex> ground_vertices;
+    std::vector<int> ground_indices;
+    std::vector<Vertex> ground_vertices_low_poly;
+    std::vector<int> ground_indices_low_poly;
+    // r16 samples, normalized to the terrain height
+    std::vector<uint8_t> heights;
+    std::shared_ptr<Heightfield> heightfield;
+};
+
+// height and wind maps are layers of arrays shared by every chunk, so wind
+// for all visible chunks is computed in one dispatch per array.
+// blades are generated in two passes. the first one applies the density
+// masks and counts the survivors, a prefix sum turns the counts into slots,
+// and once the total has been read back the second pass writes the blades
+// into a run of a shared instance buffer of exactly that size, grouped by
+// species. procedural chunks stop after the count, their blades are
+// recomputed from the cells by the vertex shader and take no instances.
+// every dispatch is recorded into the scheduler and runs on its next flush
 class Chunk {
   public:
-    Chunk(const Mesh& grass_mesh, Shader& generator, glm::ivec3 position,
+    Chunk(const SpeciesSet& species, Shader& generator, Shader& compaction,
+          ComputeScheduler& scheduler, TextureArrayPool& height_maps,
+          TextureArrayPool& noise_maps, InstanceBufferPool& instances,
+          glm::ivec3 position,
           int grass_per_unit, int size, float terrain_height,
-          float terrain_scale, uint64_t seed);
+          float terrain_scale, uint64_t seed, UploadService* uploads = nullptr);
+
+    Chunk(const SpeciesSet& species, Shader& generator, Shader& compaction,
+          ComputeScheduler& scheduler, TextureArrayPool& height_maps,
+          TextureArrayPool& noise_maps, InstanceBufferPool& instances,
+          ChunkGeometry geometry,
+          int grass_per_unit, UploadService* uploads = nullptr,
+          TerrainGenerator* terrain = nullptr);
+
+    ~Chunk();
+
+    static ChunkGeometry build(const glm::ivec2& coordinate, int size,
+                               float terrain_height, float terrain_scale,
+                               uint64_t seed);
+
+    // geometry for a TerrainGenerator to fill, bounded by the whole terrain
+    // height
+    static ChunkGeometry build_bounds(const glm::ivec2& coordinate, int size,
+                                      float terrain_height,
+                                      float terrain_scale);
+
+    // starts generation once the uploads have landed and finishes it once
+    // the blade count is back, true when the chunk can be drawn
+    bool prepare();
+
+    // regenerates the blades at another density or after the masks changed,
+    // the terrain is kept and the old blades draw until the new ones exist
+    void regenerate(int grass_per_unit);
+
+    // blades drawn from their cells instead of an instance buffer, applies
+    // from the next generation
+    void set_procedural(bool procedural);
+
+    // whether the blades that draw are procedural
+    bool is_procedural() const;
+
+    // drops the blades of a chunk whose grass isn't drawn, they are
+    // regenerated once it is visible again. returns whether anything was
+    // dropped, its runs only free memory once their pool trims the buffer
+    bool evict();
+
+    // time of the last update that drew grass, for lru eviction
+    float get_last_used() const;
+
+    // wind for every chunk that animates its blades this frame, one
+    // dispatch per noise map array. recorded before update
+    static void update_wind(ComputeScheduler& scheduler, Shader& flow_field,
+                            ShaderBuffer<ChunkParameters>& parameters,
+                            const std::vector<std::shared_ptr<Chunk>>& chunks,
+                            float time);
+
+    void update(Shader& displacement, ShaderBuffer<ChunkParameters>& parameters,
+                float wind_direction, float time);
+
+    // orders the drawn blades front to back by distance to eye, once the eye
+    // has moved resort_distance away from where they were last sorted.
+    // returns whether a sort was recorded
+    bool sort_instances(Shader& sort, const glm::vec3& eye, float range,
+                        float resort_distance);
+
+    // queues the ground draw sorted by distance to the view and adds the
+    // blades to the vegetation batch
+    void submit(RenderQueue& queue, VegetationBatch& vegetation,
+                Shader& standard);
+
+    // shadow casters, culled against the light camera instead of the view
+    void render_terrain_depth(Renderer& renderer, const Camera& light,
+                              Shader& depth, bool low_detail);
 
-    void update(Shader& flow_field, Shader& displacement, float wind_direction,
-                float time);
+    // adds every stride-th instance to a batch of shadow casters
+    void add_grass_depth(VegetationBatch& casters, const Camera& light,
+                         int stride);
 
-    void render(Renderer& renderer, Shader& standard, Shader& gpu_instancing,
-                bool debug = false);
+    // blades are only drawn and animated within grass_distance of the camera,
+    // the far field covers the rest
+    void frustum_test(const Camera& camera,
+                      float grass_distance = std::numeric_limits<float>::max());
 
-    void frustum_test(const Camera& camera);
+    // const so it can run on the simulation thread while the render thread
+    // draws the previous frame
+    ChunkVisibility test_visibility(
+        const Camera& camera,
+        float grass_distance = std::numeric_limits<float>::max()) const;
 
-    static int grass_count;
+    void set_visibility(const ChunkVisibility& visibility);
+
+    // false while a regeneration is still counting its blades
+    bool is_ready() const;
+
+    glm::ivec2 get_coordinate() const;
+
+    // null until a gpu built terrain has been read back
+    std::shared_ptr<const Heightfield> get_heightfield() const;
+
+    // true once after the heightfield of a gpu built terrain arrived
+    bool take_terrain_readback();
+
+    // the blades of every species, invalid while evicted
+    const InstanceRange& get_instances() const;
+
+    // instances of a species, counted from the first of get_instances
+    int get_species_first(int species) const;
+
+    int get_species_count(int species) const;
+
+    ProceduralBlades get_procedural_blades(int species) const;
+
+    const TextureLayer& get_height_map() const;
+
+    const TextureLayer& get_noise_map() const;
+
+    // r8, blade height / 4 per generation cell and 0 where no blade survived
+    const Texture& get_coverage() const;
+
+    int get_grass_count() const;
+
+    glm::vec3 get_min() const;
+
+    glm::vec3 get_max() const;
+
+    int get_grass_per_unit() const;
+
+    static std::atomic<int> grass_count;
+
+    // heap allocations of the last cpu chunk build, arena blocks included.
+    // scratch is recycled by the arena, but the output arrays and the
+    // heightfield are kept by the meshes, the height map upload and the
+    // collision snapshot, so they are allocated anew by every build
+    static std::atomic<int> build_allocations;
 
   private:
-    const Mesh& m_grass_mesh;
+    void set_generation_uniforms(bool write_instances);
+
+    // visible, near and within grass distance
+    bool is_animated() const;
+
+    ChunkParameters get_parameters(float time) const;
+
+    // records the counting pass, the prefix sum and the fence
+    void begin_generation();
+
+    // reads the total back and records the writing pass, returns false
+    // while the gpu isn't done
+    bool finish_generation(bool wait);
+
+    // builds the heightfield from the gpu built ground mesh
+    void read_terrain();
+
+    bool is_outside(const glm::mat4& matrix) const;
+
+    const SpeciesSet& m_species;
+    Shader& m_generator;
+    Shader& m_compaction;
+    ComputeScheduler& m_scheduler;
     Mesh m_ground;
     Mesh m_ground_low_poly;
 
     int m_size;
     int m_grass_count;
     int m_grass_per_unit;
+    float m_terrain_height;
+
+    ChunkVisibility m_visibility;
+    bool m_generated = false;
+    bool m_evicted = false;
+    // from the counting pass until the total has been read back
+    bool m_generating = false;
+    bool m_procedural = false;
+    // mode of the last finished generation
+    bool m_procedural_generated = false;
+    float m_last_used = 0.0f;
+    GLsync m_count_fence = nullptr;
+    ShaderBuffer<uint32_t> m_offsets;
+
+    // the instance order holds a sort from m_sort_position
+    bool m_sorted = false;
+    glm::vec3 m_sort_position = glm::vec3(0.0f);
+    ShaderBuffer<uint32_t> m_sort_buckets;
 
-    bool m_cull = false;
-    bool m_far = false;
+    std::vector<std::shared_ptr<const UploadTicket>> m_uploads;
 
-    ShaderBuffer<GrassBuffer> m_grass_buffer;
-    Texture m_height_map;
-    Texture m_noise_map;
+    InstanceBufferPool& m_instance_pool;
+    InstanceRange m_instances;
+    // first instance of every species and the total
+    std::vector<int> m_species_offsets;
+    glm::ivec2 m_coordinate;
+    std::shared_ptr<Heightfield> m_heightfield;
+    // the ground mesh still has to be read back, validated against the
+    // reference when there is one
+    bool m_terrain_pending = false;
+    bool m_terrain_read = false;
+    std::shared_ptr<Heightfield> m_terrain_reference;
+    TextureArrayPool& m_noise_maps;
+    TextureLayer m_height_map;
+    TextureLayer m_noise_map;
+    Texture m_coverage;
 
     glm::vec3 m_min;
     glm::vec3 m_max;
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "baked_texture.hpp"
+#include "chunk.hpp"
+#include "glm/ext/vector_int2.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+
+struct WorldConfig;
+
+// on-disk layout of a chunk cache: header, entry table, then the ground of
+// every chunk as built by Chunk::build. the arrays of an entry follow each
+// other, aligned to 16 bytes, in the order of ChunkGeometry
+struct ChunkCacheHeader {
+    char magic[4];
+    uint32_t version;
+    // get_chunk_cache_key of the config the chunks were built with
+    uint64_t key;
+    uint32_t chunk_count;
+    uint32_t chunk_size;
+};
+
+struct ChunkCacheEntry {
+    int32_t x;
+    int32_t y;
+    float min_height;
+    float max_height;
+    uint64_t offset;
+};
+
+inline constexpr char CHUNK_CACHE_MAGIC[4] = {'F', 'C', 'H', 'K'};
+inline constexpr uint32_t CHUNK_CACHE_VERSION = 1;
+
+// hash of everything the ground of a chunk depends on
+uint64_t get_chunk_cache_key(const WorldConfig& config);
+
+// the cpu ground of a whole layout, built once and mapped read only by every
+// process that renders it. workers skip the noise evaluation, but load copies
+// the arrays of each chunk they use and rebuilds its heightfield pyramid, only
+// the file itself is shared through the page cache
+class ChunkCache {
+  public:
+    // builds every chunk of the layout on all cores and writes them out
+    static bool write(const std::filesystem::path& path,
+                      const WorldConfig& config);
+
+    ChunkCache(const std::filesystem::path& path);
+
+    bool is_valid() const;
+
+    // any thread, false when the chunk is missing or the cache was built for
+    // another terrain
+    bool load(const glm::ivec2& coordinate, const WorldConfig& config,
+              ChunkGeometry& geometry) const;
+
+  private:
+    MappedFile m_file;
+    const ChunkCacheHeader* m_header = nullptr;
+    std::unordered_map<int64_t, const ChunkCacheEntry*> m_entries;
+};
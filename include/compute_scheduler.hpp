@@ -0,0 +1,108 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// how a pass touches a resource, decides the barrier a dependent pass needs
+enum class ComputeAccess {
+    // shader storage buffer
+    Storage,
+    // image load and store
+    Image,
+    // texture sampling
+    Sampled,
+    // glGetBufferSubData and friends once the pass has run
+    Readback
+};
+
+class ComputePass {
+  public:
+    ComputePass& read_buffer(GLuint buffer,
+                             ComputeAccess access = ComputeAccess::Storage);
+
+    ComputePass& write_buffer(GLuint buffer,
+                              ComputeAccess access = ComputeAccess::Storage);
+
+    // a buffer tracked by ranges, ranges are told apart by their first
+    // element alone and must not overlap
+    ComputePass&
+    read_buffer_range(GLuint buffer, size_t first,
+                      ComputeAccess access = ComputeAccess::Storage);
+
+    ComputePass&
+    write_buffer_range(GLuint buffer, size_t first,
+                       ComputeAccess access = ComputeAccess::Storage);
+
+    ComputePass& read_texture(GLuint texture,
+                              ComputeAccess access = ComputeAccess::Sampled);
+
+    ComputePass& write_texture(GLuint texture,
+                               ComputeAccess access = ComputeAccess::Image);
+
+    // one layer of an array texture. layers don't wait on each other but
+    // do on passes that access the whole texture
+    ComputePass&
+    read_texture_layer(GLuint texture, int layer,
+                       ComputeAccess access = ComputeAccess::Sampled);
+
+    ComputePass&
+    write_texture_layer(GLuint texture, int layer,
+                        ComputeAccess access = ComputeAccess::Image);
+
+  private:
+    friend class ComputeScheduler;
+
+    struct Access {
+        uint64_t resource;
+        GLbitfield barrier;
+        bool write;
+        // key of the whole texture for layer accesses, 0 otherwise
+        uint64_t texture;
+    };
+
+    ComputePass& add(uint64_t resource, ComputeAccess access, bool write,
+                     uint64_t texture = 0);
+
+    const void* m_owner = nullptr;
+    std::function<void()> m_execute;
+    std::vector<Access> m_accesses;
+    int m_level = 0;
+    GLbitfield m_barrier = 0;
+};
+
+struct ComputeStatistics {
+    int passes = 0;
+    int barriers = 0;
+    // levels of the deepest flush
+    int levels = 0;
+};
+
+// records compute passes with the resources they read and write and runs
+// them on flush. passes without a dependency between them share a level and
+// run back to back, a single barrier with the bits the next level needs
+// separates levels. a pass sets all of its own state when it executes, so
+// it may run after passes recorded later
+class ComputeScheduler {
+  public:
+    // execute runs during flush, owner identifies the passes for cancel
+    ComputePass& record(const void* owner, std::function<void()> execute);
+
+    // drops the pending passes of an owner that is going away
+    void cancel(const void* owner);
+
+    // runs every pending pass, then issues final_barriers once for whatever
+    // reads the results outside the scheduler
+    void flush(GLbitfield final_barriers = 0);
+
+    void begin_frame();
+
+    // passes and barriers since begin_frame
+    ComputeStatistics get_statistics() const;
+
+  private:
+    std::deque<ComputePass> m_passes;
+    ComputeStatistics m_statistics;
+};
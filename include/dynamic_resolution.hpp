@@ -0,0 +1,59 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/ext/vector_float2.hpp"
+#include "glm/ext/vector_int2.hpp"
+
+// picks the scene render scale from measured gpu frame time. rendering happens
+// inside a max-size target through its viewport, so a scale change never
+// reallocates anything
+class DynamicResolution {
+  public:
+    DynamicResolution(const glm::ivec2& max_size, float budget,
+                      float min_scale = 0.5f, float max_scale = 1.0f);
+
+    ~DynamicResolution();
+
+    void begin_frame();
+
+    void end_frame();
+
+    void set_enabled(bool enabled);
+
+    // target gpu frame time in milliseconds
+    void set_budget(float budget);
+
+    bool is_enabled() const;
+
+    float get_budget() const;
+
+    float get_scale() const;
+
+    // smoothed gpu frame time in milliseconds
+    float get_gpu_time() const;
+
+    glm::ivec2 get_viewport_size() const;
+
+    // fraction of the target covered by the viewport
+    glm::vec2 get_uv_scale() const;
+
+  private:
+    static constexpr int QUERY_COUNT = 4;
+
+    void update_scale(float gpu_time);
+
+    glm::ivec2 m_max_size;
+    float m_budget;
+    float m_min_scale;
+    float m_max_scale;
+    float m_scale;
+    float m_gpu_time = 0.0f;
+    bool m_enabled = true;
+
+    // timestamp pairs, the elapsed query target is left free for the passes
+    // that measure themselves
+    GLuint m_queries[QUERY_COUNT][2];
+    bool m_pending[QUERY_COUNT] = {};
+    bool m_timing = false;
+    int m_frame = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+constexpr int FAR_FIELD_TEXTURE_UNIT = 5;
+
+// grass height and density of the whole terrain baked into one texture, one
+// texel per unit. the terrain shader shades it as a grass layer where blades
+// have faded out, so far chunks never instance any blades
+class FarField {
+  public:
+    FarField(const Mesh& grass_mesh, Shader& baker, const glm::vec2& origin,
+             const glm::ivec2& size);
+
+    // bakes chunks whose grass has been generated since the last call
+    void update(const std::vector<std::shared_ptr<Chunk>>& chunks);
+
+    // clears the layer so every chunk is baked again
+    void invalidate();
+
+    // resizes the layer to new world bounds, implies invalidate
+    void set_bounds(const glm::vec2& origin, const glm::ivec2& size);
+
+    // blades shrink away between the two distances while the layer fades in
+    void set_fade(float start, float end);
+
+    // sets the far-field uniforms of a shader using default_fragment.glsl,
+    // without fade blades keep full height at any distance
+    void apply(Shader& shader, bool terrain, bool fade = true) const;
+
+    float get_fade_end() const;
+
+    const Texture& get_texture() const;
+
+  private:
+    void bake(const Chunk& chunk);
+
+    Shader& m_baker;
+    Texture m_texture;
+    glm::vec2 m_origin;
+    glm::ivec2 m_size;
+    glm::vec3 m_grass_color;
+    float m_fade_start = 48.0f;
+    float m_fade_end = 80.0f;
+
+    std::unordered_set<int64_t> m_baked;
+};
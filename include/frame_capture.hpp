@@ -0,0 +1,101 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/ext/vector_int2.hpp"
+#include "gpu_memory.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class CaptureFormat { Raw, PNG };
+
+// frame_000042.png and the like
+std::string get_capture_file_name(uint64_t frame, CaptureFormat format);
+
+// rgba8 with the rows bottom up, as read back from OpenGL
+bool write_image(const std::filesystem::path& path, const uint8_t* pixels,
+                 const glm::ivec2& size, CaptureFormat format);
+
+// takes the pixels of a captured frame instead of the disk, on the writer
+// thread. the pixels are only valid for the call
+using FrameSink = std::function<void(uint64_t frame, const uint8_t* pixels,
+                                     const glm::ivec2& size)>;
+
+// reads frames back through a ring of persistently mapped pixel pack buffers.
+// a slot is handed to the writer thread once its fence has signalled, which
+// reads straight from the mapping and frees the slot again, so the render
+// thread never waits on the gpu or the disk
+class FrameCapture {
+  public:
+    // lossless capture waits for a free slot instead of dropping the frame
+    FrameCapture(const glm::ivec2& size, const std::filesystem::path& directory,
+                 CaptureFormat format, bool lossless = false,
+                 int ring_size = 4);
+
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // before the first capture
+    void set_sink(FrameSink sink);
+
+    // render thread, queues a readback of the bound read framebuffer
+    void capture();
+
+    // waits until every captured frame is on disk
+    void flush();
+
+    int get_written_count() const;
+
+    int get_dropped_count() const;
+
+  private:
+    enum class SlotState : int { Free, InFlight, Writing };
+
+    struct Slot {
+        GLuint buffer = 0;
+        uint8_t* data = nullptr;
+        GLsync fence = nullptr;
+        uint64_t frame = 0;
+        std::atomic<SlotState> state = SlotState::Free;
+    };
+
+    // hands every signalled slot to the writer, in capture order
+    void resolve(bool wait);
+
+    void run();
+
+    void write(const Slot& slot) const;
+
+    glm::ivec2 m_size;
+    size_t m_frame_size;
+    std::filesystem::path m_directory;
+    CaptureFormat m_format;
+    bool m_lossless;
+    FrameSink m_sink;
+
+    int m_ring_size;
+    std::unique_ptr<Slot[]> m_slots;
+    GpuAllocation m_allocation;
+    int m_next = 0;
+    uint64_t m_frame = 0;
+    std::deque<int> m_in_flight;
+
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<int> m_jobs;
+    bool m_running = true;
+
+    std::atomic<int> m_written = 0;
+    int m_dropped = 0;
+};
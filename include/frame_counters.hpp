@@ -0,0 +1,92 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <atomic>
+#include <cstdint>
+
+enum class FrameCounter {
+    DrawCalls,
+    Dispatches,
+    // instances of instanced and indirect draws, as submitted by the cpu
+    Instances,
+    VisibleChunks,
+    UploadedBytes,
+    ProgramBinds,
+    TextureBinds,
+    Barriers,
+    Count
+};
+
+constexpr int FRAME_COUNTER_COUNT = (int)FrameCounter::Count;
+
+// GL_ARB_pipeline_statistics_query
+enum class PipelineCounter {
+    VertexInvocations,
+    Primitives,
+    FragmentInvocations,
+    Count
+};
+
+constexpr int PIPELINE_COUNTER_COUNT = (int)PipelineCounter::Count;
+
+const char* get_frame_counter_name(FrameCounter counter);
+
+const char* get_pipeline_counter_name(PipelineCounter counter);
+
+struct FrameCounts {
+    int64_t counters[FRAME_COUNTER_COUNT] = {};
+    // of the latest frame whose queries are back, -1 without the extension
+    int64_t pipeline[PIPELINE_COUNTER_COUNT] = {-1, -1, -1};
+};
+
+// what a frame asked of gl, counted where the calls are made. any thread
+// may add, uploads land in the frame during which the upload thread ran them
+class FrameCounters {
+  public:
+    static void add(FrameCounter counter, int64_t count = 1);
+
+    // render thread, returns the counts since the last take and resets them
+    static FrameCounts take();
+
+  private:
+    static std::atomic<int64_t> m_counters[FRAME_COUNTER_COUNT];
+};
+
+// pipeline statistics queries around every frame, read back a few frames
+// later like the timestamps of DynamicResolution. a frame whose slot is
+// still busy goes unmeasured instead of stalling. render thread only
+class PipelineStatistics {
+  public:
+    PipelineStatistics();
+
+    ~PipelineStatistics();
+
+    PipelineStatistics(const PipelineStatistics&) = delete;
+
+    PipelineStatistics& operator=(const PipelineStatistics&) = delete;
+
+    void begin_frame();
+
+    void end_frame();
+
+    bool is_supported() const;
+
+    // sets the pipeline counts of the latest measured frame
+    void read(FrameCounts& counts) const;
+
+    // per measured frame over the whole run, -1 without the extension
+    double get_average(PipelineCounter counter) const;
+
+  private:
+    static constexpr int QUERY_COUNT = 4;
+
+    bool m_supported;
+    GLuint m_queries[QUERY_COUNT][PIPELINE_COUNTER_COUNT];
+    bool m_pending[QUERY_COUNT] = {};
+    bool m_measuring = false;
+    int m_frame = 0;
+
+    int64_t m_latest[PIPELINE_COUNTER_COUNT] = {-1, -1, -1};
+    int64_t m_totals[PIPELINE_COUNTER_COUNT] = {};
+    int m_measured_frames = 0;
+};
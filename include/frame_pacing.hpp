@@ -0,0 +1,72 @@
+#pragma once
+
+#include "glad/glad.h"
+
+// caps the frame rate and smooths the frame delta. the limiter sleeps for
+// most of the wait and spins the rest, sleep alone overshoots by a scheduler
+// quantum
+class FramePacer {
+  public:
+    FramePacer(double target_fps = 0.0, double spin_margin = 0.002);
+
+    // 0 disables the limiter
+    void set_target_fps(double target_fps);
+
+    double get_target_fps() const;
+
+    // blocks until the next frame deadline, returns the smoothed delta
+    double wait();
+
+    // seconds, clamped and smoothed
+    double get_delta_time() const;
+
+    // seconds, as measured
+    double get_raw_delta_time() const;
+
+    // mean absolute deviation of the raw delta in milliseconds
+    float get_jitter() const;
+
+  private:
+    static constexpr double MAX_DELTA_TIME = 0.1;
+
+    double m_target_fps;
+    double m_spin_margin;
+    double m_deadline = 0.0;
+    double m_last_frame = -1.0;
+    double m_raw_delta_time = 0.0;
+    double m_delta_time = 0.0;
+    float m_jitter = 0.0f;
+};
+
+// input to present latency. a timestamp query issued after the swap resolves
+// to when the gpu finished the frame, which is mapped onto the glfw clock
+// through a periodically recalibrated offset
+class PresentLatency {
+  public:
+    PresentLatency();
+
+    ~PresentLatency();
+
+    // render thread, right after the swap. input_time is the glfw time of the
+    // oldest input the frame consumed, negative when there was none
+    void record(double input_time);
+
+    // smoothed, in milliseconds
+    float get_latency() const;
+
+  private:
+    static constexpr int QUERY_COUNT = 4;
+    static constexpr int CALIBRATION_INTERVAL = 120;
+
+    void calibrate();
+
+    GLuint m_queries[QUERY_COUNT];
+    double m_input_times[QUERY_COUNT];
+    bool m_pending[QUERY_COUNT] = {};
+    int m_frame = 0;
+
+    // gpu clock minus glfw clock, in seconds
+    double m_clock_offset = 0.0;
+    int m_calibration_age = CALIBRATION_INTERVAL;
+    float m_latency = 0.0f;
+};
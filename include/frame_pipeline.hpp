@@ -0,0 +1,181 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "compute_scheduler.hpp"
+#include "frame_counters.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include "imgui.h"
+#include "instance_sort.hpp"
+#include "render_queue.hpp"
+#include "renderer.hpp"
+#include "world.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// bounded single-producer single-consumer queue. push blocks while the queue
+// is full and pop while it is empty, neither takes a lock
+template <typename T, size_t Capacity> class SpscQueue {
+  public:
+    void push(T value);
+
+    T pop();
+
+  private:
+    static constexpr size_t SLOT_COUNT = Capacity + 1;
+
+    std::array<T, SLOT_COUNT> m_slots;
+    std::atomic<size_t> m_head = 0;
+    std::atomic<size_t> m_tail = 0;
+};
+
+template <typename T, size_t Capacity>
+void SpscQueue<T, Capacity>::push(T value) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) % SLOT_COUNT;
+    size_t head = m_head.load(std::memory_order_acquire);
+    while (next == head) {
+        m_head.wait(head, std::memory_order_acquire);
+        head = m_head.load(std::memory_order_acquire);
+    }
+
+    m_slots[tail] = std::move(value);
+    m_tail.store(next, std::memory_order_release);
+    m_tail.notify_one();
+}
+
+template <typename T, size_t Capacity> T SpscQueue<T, Capacity>::pop() {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    while (head == tail) {
+        m_tail.wait(tail, std::memory_order_acquire);
+        tail = m_tail.load(std::memory_order_acquire);
+    }
+
+    T value = std::move(m_slots[head]);
+    m_head.store((head + 1) % SLOT_COUNT, std::memory_order_release);
+    m_head.notify_one();
+    return value;
+}
+
+// deep copy of the ui draw lists, ImGui overwrites its own on the next frame
+class DrawDataSnapshot {
+  public:
+    DrawDataSnapshot() = default;
+
+    ~DrawDataSnapshot();
+
+    DrawDataSnapshot(const DrawDataSnapshot&) = delete;
+
+    DrawDataSnapshot& operator=(const DrawDataSnapshot&) = delete;
+
+    DrawDataSnapshot(DrawDataSnapshot&& other) noexcept;
+
+    DrawDataSnapshot& operator=(DrawDataSnapshot&& other) noexcept;
+
+    void capture(const ImDrawData* draw_data);
+
+    // nullptr when nothing was captured
+    ImDrawData* get();
+
+  private:
+    void release();
+
+    ImDrawData m_draw_data;
+    bool m_valid = false;
+};
+
+// everything the render thread needs for one frame, nothing in it is touched
+// by the simulation once submitted
+struct FramePacket {
+    uint64_t frame = 0;
+    bool quit = false;
+
+    // glfw time of the oldest input this frame reacts to, negative if none
+    double input_time = -1.0;
+    int swap_interval = 1;
+    bool capture = false;
+
+    Camera camera;
+    Camera debug_camera;
+    bool show_debug_view = false;
+    // the part of the view the scene shows, min and max in normalized
+    // device coordinates. farm workers render tiles of a larger image
+    glm::vec4 crop = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+
+    // the chunk list the frame was simulated against, with one visibility
+    // entry per chunk in list order
+    std::shared_ptr<const WorldSnapshot> world;
+    std::vector<ChunkVisibility> visibility;
+    WorldConfig world_config;
+
+    float time = 0.0f;
+    float fog_percent = 0.0f;
+    float grass_distance = 0.0f;
+    bool shadows = true;
+    bool sort_blades = true;
+    bool count_blade_fragments = false;
+    // blades through the visibility buffer instead of the forward pass
+    bool visibility_buffer = false;
+    bool dynamic_resolution = true;
+    float frame_budget = 16.0f;
+
+    DrawDataSnapshot ui;
+};
+
+// published by the render thread, read back by the ui of a later frame
+struct RenderStatistics {
+    uint64_t frame = 0;
+    float shadow_time = 0.0f;
+    int shadow_refreshes = 0;
+    float render_scale = 1.0f;
+    glm::ivec2 render_size = glm::ivec2(0);
+    float gpu_time = 0.0f;
+    float latency = 0.0f;
+    int captured_frames = 0;
+    int world_pending = 0;
+    int dropped_frames = 0;
+    RenderQueueStatistics queue;
+    ComputeStatistics compute;
+    InstanceSortStatistics sort;
+    FrameCounts counters;
+};
+
+// runs the render function on its own thread, one frame behind the caller.
+// the context moves to the render thread until stop()
+class FramePipeline {
+  public:
+    using RenderFunction = std::function<void(FramePacket&)>;
+
+    FramePipeline(GLFWwindow* context, RenderFunction render);
+
+    ~FramePipeline();
+
+    // blocks while a packet is already waiting for the render thread
+    void submit(FramePacket packet);
+
+    // drains the queue, joins the render thread and makes the context current
+    // on the calling thread again
+    void stop();
+
+    void publish(const RenderStatistics& statistics);
+
+    RenderStatistics get_statistics() const;
+
+  private:
+    void run();
+
+    GLFWwindow* m_context;
+    RenderFunction m_render;
+    SpscQueue<FramePacket, 1> m_queue;
+    std::thread m_thread;
+
+    mutable std::mutex m_statistics_mutex;
+    RenderStatistics m_statistics;
+};
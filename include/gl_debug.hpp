@@ -0,0 +1,54 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <string>
+
+// KHR_debug validation layer. debug builds ask for a debug context and get
+// errors and warnings through an asynchronous callback instead of polling
+// glGetError, objects carry labels and passes show up as groups in frame
+// debuggers. with NDEBUG every call is an empty inline
+#ifndef NDEBUG
+
+// before the window is created
+void gl_debug_request_context();
+
+// once per context, after glad is loaded. false without KHR_debug
+bool gl_debug_install();
+
+// errors are reported through the callback
+bool gl_debug_is_installed();
+
+// identifier is GL_PROGRAM, GL_TEXTURE, GL_BUFFER, GL_VERTEX_ARRAY, ...
+void gl_debug_label(GLenum identifier, GLuint name, const std::string& label);
+
+void gl_debug_push_group(const char* name);
+
+void gl_debug_pop_group();
+
+#else
+
+inline void gl_debug_request_context() {}
+
+inline bool gl_debug_install() { return false; }
+
+inline bool gl_debug_is_installed() { return false; }
+
+inline void gl_debug_label(GLenum, GLuint, const std::string&) {}
+
+inline void gl_debug_push_group(const char*) {}
+
+inline void gl_debug_pop_group() {}
+
+#endif
+
+// a debug group for the lifetime of the scope
+class GlDebugGroup {
+  public:
+    explicit GlDebugGroup(const char* name) { gl_debug_push_group(name); }
+
+    ~GlDebugGroup() { gl_debug_pop_group(); }
+
+    GlDebugGroup(const GlDebugGroup&) = delete;
+
+    GlDebugGroup& operator=(const GlDebugGroup&) = delete;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/ext/vector_int2.hpp"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+enum class MemoryCategory {
+    Texture,
+    RenderTarget,
+    Geometry,
+    Buffer,
+    // blade instances and their draw order
+    Instances,
+    Staging,
+    // cpu copies of uploaded meshes, not part of the gpu total
+    MeshCopy,
+    Count
+};
+
+constexpr int MEMORY_CATEGORY_COUNT = (int)MemoryCategory::Count;
+
+const char* get_memory_category_name(MemoryCategory category);
+
+// storage of a texture with the given number of mip levels, the full chain
+// when levels is 0
+size_t get_texture_bytes(GLenum internal_format, const glm::ivec2& size,
+                         int levels = 1);
+
+// a resource's share of the tracker, released when the owner dies. a copy
+// counts the same bytes again, like the copy of its owner would
+class GpuAllocation {
+  public:
+    explicit GpuAllocation(MemoryCategory category);
+
+    ~GpuAllocation();
+
+    GpuAllocation(const GpuAllocation& other);
+
+    GpuAllocation& operator=(const GpuAllocation& other);
+
+    void resize(size_t size);
+
+    size_t get_size() const;
+
+  private:
+    MemoryCategory m_category;
+    size_t m_size = 0;
+};
+
+struct MemoryStatistics {
+    size_t bytes[MEMORY_CATEGORY_COUNT] = {};
+    size_t total = 0;
+    size_t peak = 0;
+    size_t budget = 0;
+    int evictions = 0;
+};
+
+// process wide byte counts by category, any thread may read them. the
+// budget is only advisory, owners of evictable resources query the
+// overflow and free what they can (see World::evict)
+class MemoryTracker {
+  public:
+    static void add(MemoryCategory category, int64_t bytes);
+
+    // 0 disables the budget
+    static void set_budget(size_t bytes);
+
+    static size_t get_budget();
+
+    static size_t get_total();
+
+    // bytes above the budget
+    static size_t get_overflow();
+
+    static void count_eviction();
+
+    // meshes that don't need their vertices on the cpu drop them after upload
+    static void set_drop_mesh_copies(bool drop);
+
+    static bool get_drop_mesh_copies();
+
+    static MemoryStatistics get_statistics();
+
+    // one json object
+    static bool write_statistics(const std::filesystem::path& path);
+
+  private:
+    static std::atomic<int64_t> m_bytes[MEMORY_CATEGORY_COUNT];
+    static std::atomic<int64_t> m_total;
+    static std::atomic<int64_t> m_peak;
+    static std::atomic<size_t> m_budget;
+    static std::atomic<int> m_evictions;
+    static std::atomic<bool> m_drop_mesh_copies;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "glm/ext/vector_float2.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_int2.hpp"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct RayHit {
+    glm::vec3 position;
+    glm::vec3 normal;
+    float distance;
+};
+
+// regular grid of height samples with a min-max pyramid over its cells
+class Heightfield {
+  public:
+    Heightfield(const glm::vec2& origin, int resolution, float spacing = 1.0f);
+
+    void set_height(int x, int z, float height);
+
+    float get_height(int x, int z) const;
+
+    // must be called after the samples change and before any raycast
+    void build_pyramid();
+
+    float height_at(float x, float z) const;
+
+    glm::vec3 normal_at(float x, float z) const;
+
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+                 float max_distance, RayHit& hit) const;
+
+    glm::vec2 get_origin() const;
+
+    int get_resolution() const;
+
+    float get_min_height() const;
+
+    float get_max_height() const;
+
+    const std::vector<float>& get_samples() const;
+
+    // heap blocks held by the samples and the pyramid
+    int get_allocation_count() const;
+
+  private:
+    glm::vec2 to_local(float x, float z) const;
+
+    bool intersect_node(const glm::vec3& origin, const glm::vec3& direction,
+                        float max_distance, int level, int i, int j,
+                        RayHit& hit) const;
+
+    bool intersect_cell(const glm::vec3& origin, const glm::vec3& direction,
+                        float max_distance, int i, int j, RayHit& hit) const;
+
+    glm::vec2 m_origin;
+    int m_resolution;
+    float m_spacing;
+
+    std::vector<float> m_samples;
+    // level 0 holds the min and max of every cell, each further level halves
+    // the cell count per side
+    std::vector<std::vector<glm::vec2>> m_pyramid;
+    std::vector<int> m_level_size;
+};
+
+// chunk-indexed set of heightfields covering the terrain
+class HeightfieldStore {
+  public:
+    HeightfieldStore(int chunk_size);
+
+    void insert(const glm::ivec2& chunk,
+                std::shared_ptr<const Heightfield> heightfield);
+
+    void remove(const glm::ivec2& chunk);
+
+    const Heightfield* find(float x, float z) const;
+
+    bool contains(float x, float z) const;
+
+    float height_at(float x, float z) const;
+
+    glm::vec3 normal_at(float x, float z) const;
+
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+                 float max_distance, RayHit& hit) const;
+
+  private:
+    static int64_t key(const glm::ivec2& chunk);
+
+    const Heightfield* find_chunk(const glm::ivec2& chunk) const;
+
+    int m_chunk_size;
+    std::unordered_map<int64_t, std::shared_ptr<const Heightfield>> m_chunks;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "gpu_memory.hpp"
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// storage buffer of equally sized instances, runs of it are handed out one
+// per chunk so a single draw can read the instances of many chunks
+class InstanceBuffer {
+  public:
+    InstanceBuffer(size_t capacity, size_t stride);
+
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // first instance of a free run of count instances, npos when none fits
+    size_t acquire(size_t count);
+
+    void release(size_t first, size_t count);
+
+    GLuint get_id() const;
+
+    // one uint per instance the depth sort writes the draw order into, read
+    // at INSTANCE_ORDER_BINDING
+    GLuint get_order_id() const;
+
+    size_t get_capacity() const;
+
+    size_t get_used_count() const;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+  private:
+    GLuint m_id;
+    GLuint m_order;
+    size_t m_capacity;
+    size_t m_used = 0;
+
+    // first and count of every free run, sorted and never adjacent
+    std::vector<std::pair<size_t, size_t>> m_free;
+    GpuAllocation m_allocation;
+    GpuAllocation m_order_allocation;
+};
+
+// a run of a pooled buffer, handed back to it on destruction
+class InstanceRange {
+  public:
+    InstanceRange() = default;
+
+    InstanceRange(std::shared_ptr<InstanceBuffer> buffer, size_t first,
+                  size_t count);
+
+    ~InstanceRange();
+
+    InstanceRange(InstanceRange&& other);
+
+    InstanceRange& operator=(InstanceRange&& other);
+
+    InstanceRange(const InstanceRange&) = delete;
+
+    InstanceRange& operator=(const InstanceRange&) = delete;
+
+    bool is_valid() const;
+
+    const InstanceBuffer& get_buffer() const;
+
+    size_t get_first() const;
+
+    size_t get_count() const;
+
+  private:
+    void reset();
+
+    std::shared_ptr<InstanceBuffer> m_buffer;
+    size_t m_first = 0;
+    size_t m_count = 0;
+};
+
+// buffers of one instance size, a new buffer is added whenever no buffer has
+// a free run of the requested length. render thread only
+class InstanceBufferPool {
+  public:
+    InstanceBufferPool(size_t stride, size_t instances_per_buffer = 1 << 18);
+
+    InstanceRange acquire(size_t count);
+
+    // drops buffers that had no instance in use for more than idle_trims
+    // calls in a row, 0 drops every empty buffer at once
+    void trim(int idle_trims = 0);
+
+    const std::vector<std::shared_ptr<InstanceBuffer>>& get_buffers() const;
+
+  private:
+    size_t m_stride;
+    size_t m_instances_per_buffer;
+    std::vector<std::shared_ptr<InstanceBuffer>> m_buffers;
+    // trims each buffer has been empty for
+    std::vector<int> m_idle_trims;
+};
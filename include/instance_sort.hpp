@@ -0,0 +1,66 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "glad/glad.h"
+#include "glm/ext/vector_float3.hpp"
+#include "shader.hpp"
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+// storage buffer binding of the counter in default_fragment.glsl
+constexpr int FRAGMENT_COUNTER_BINDING = 6;
+
+struct InstanceSortStatistics {
+    // chunks sorted during the last update
+    int sorted_chunks = 0;
+    // blade fragments shaded in the last counted sorted and unsorted frames
+    uint32_t sorted_fragments = 0;
+    uint32_t unsorted_fragments = 0;
+};
+
+// orders the blades of every drawn chunk front to back in coarse distance
+// buckets, so early depth testing rejects more of dense grass. a chunk is
+// sorted again once the eye has moved resort_distance away from where it was
+// last sorted. while counting, every other frame is drawn unsorted and the
+// shaded blade fragments of both kinds of frame are read back
+class InstanceSort {
+  public:
+    explicit InstanceSort(Shader& sort, float resort_distance = 2.0f);
+
+    ~InstanceSort();
+
+    InstanceSort(const InstanceSort&) = delete;
+
+    InstanceSort& operator=(const InstanceSort&) = delete;
+
+    void set_enabled(bool enabled);
+
+    void set_counting(bool counting);
+
+    // records the sorts, range is the distance the buckets span
+    void update(const std::vector<std::shared_ptr<Chunk>>& chunks,
+                const glm::vec3& eye, float range);
+
+    // sets up the blade shaders for the draws of this frame
+    void begin_draw(std::initializer_list<Shader*> shaders);
+
+    void end_draw();
+
+    InstanceSortStatistics get_statistics() const;
+
+  private:
+    Shader& m_sort;
+    float m_resort_distance;
+    bool m_enabled = true;
+    bool m_counting = false;
+    uint64_t m_frame = 0;
+
+    // one counter per frame parity, read back two frames later
+    GLuint m_counters[2];
+    GLsync m_fences[2] = {nullptr, nullptr};
+    bool m_counted_sorted[2] = {false, false};
+
+    InstanceSortStatistics m_statistics;
+};
@@ -3,8 +3,14 @@
 #include "glad/glad.h"
 #include "glm/ext/matrix_float4x4.hpp"
 #include "texture.hpp"
+#include <memory>
+#include <span>
+#include <string>
 #include <vector>
 
+class UploadService;
+class UploadTicket;
+
 struct Vertex {
     glm::vec3 position;
     glm::vec2 uv;
@@ -14,20 +20,44 @@ struct Vertex {
 
 class Mesh {
   public:
-    Mesh() = default;
+    Mesh();
 
     ~Mesh();
 
     void set(std::vector<Vertex>& vertices, std::vector<int>& indices);
 
+    void set(std::span<const Vertex> vertices, std::span<const int> indices);
+
+    std::shared_ptr<const UploadTicket> set_async(UploadService& uploads,
+                                                  std::vector<Vertex>& vertices,
+                                                  std::vector<int>& indices);
+
+    std::shared_ptr<const UploadTicket>
+    set_async(UploadService& uploads, std::span<const Vertex> vertices,
+              std::span<const int> indices);
+
+    // uninitialized buffers for a compute pass to fill, no cpu copies
+    void allocate(int vertex_count, int index_count);
+
+    // debug builds only, names the vertex array and both buffers
+    void set_label(const std::string& label) const;
+
     GLuint get_vertex_array_id() const;
 
     GLuint get_vertex_buffer_id() const;
 
+    GLuint get_element_buffer_id() const;
+
     const std::vector<Vertex>& get_vertices() const;
 
     const std::vector<int>& get_indices() const;
 
+    // frees the cpu copies once uploaded, get_vertices and get_indices are
+    // empty afterwards
+    void release_copies();
+
+    int get_index_count() const;
+
     glm::mat4 get_transform_matrix() const;
 
     std::shared_ptr<const Texture> get_texture() const;
@@ -35,12 +65,23 @@ class Mesh {
     void set_texture(std::shared_ptr<const Texture> texture);
 
   private:
+    void create_vertex_array();
+
+    void upload();
+
+    void track();
+
+    std::shared_ptr<const UploadTicket> upload_async(UploadService& uploads);
+
     GLuint m_vertex_array;
     GLuint m_vertex_buffer;
     GLuint m_element_buffer;
+    int m_index_count = 0;
+    GpuAllocation m_allocation;
 
     std::vector<Vertex> m_vertices;
     std::vector<int> m_indices;
+    GpuAllocation m_copy_allocation;
 
     std::shared_ptr<const Texture> m_texture;
 };
\ No newline at end of file
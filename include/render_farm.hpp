@@ -0,0 +1,126 @@
+#pragma once
+
+#include "frame_capture.hpp"
+#include "glm/ext/vector_int2.hpp"
+#include "glm/ext/vector_int4.hpp"
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// offline renders split across local worker processes, each with its own
+// headless context. workers pull tasks from the coordinator and send the
+// pixels back over a unix socket, so a slow worker simply takes fewer tasks.
+// every message is a FarmMessage followed by its payload, nothing in the
+// protocol assumes a shared machine besides the chunk cache path
+enum class FarmSplit { Tiles, Frames };
+
+// frame_count frames from first_frame, each cropped to the tile. the tile is
+// x, y, width and height in pixels from the bottom left of the image
+struct FarmTask {
+    uint64_t first_frame = 0;
+    int frame_count = 0;
+    glm::ivec4 tile = glm::ivec4(0);
+};
+
+enum class FarmMessageType : uint32_t { Hello, Request, Task, Result, Done };
+
+struct FarmMessage {
+    FarmMessageType type;
+    int32_t frame_count;
+    uint64_t frame;
+    // hello: tile holds the size every worker renders at
+    int32_t tile[4];
+    // hello: the size of the whole image
+    int32_t size[2];
+    // bytes following the message
+    uint64_t payload;
+};
+
+struct FarmSettings {
+    // one per core when zero
+    int worker_count = 0;
+    FarmSplit split = FarmSplit::Tiles;
+    // the image is cut into tiles x tiles
+    int tiles = 2;
+    // frames per task when splitting by time
+    int frame_range = 8;
+    int frame_count = 1;
+    glm::ivec2 size = glm::ivec2(1920, 1080);
+    std::filesystem::path directory;
+    CaptureFormat format = CaptureFormat::PNG;
+    // worker command line, the farm adds --farm-worker <socket>
+    std::filesystem::path executable;
+    std::vector<std::string> arguments;
+};
+
+// splits the frames into tasks, starts the workers and writes every frame
+// once all of its tiles are back
+class RenderFarm {
+  public:
+    RenderFarm(const FarmSettings& settings);
+
+    // blocks until every frame is written or no worker is left, true when
+    // all frames were written
+    bool run();
+
+  private:
+    struct Assembly {
+        std::vector<uint8_t> pixels;
+        int remaining = 0;
+    };
+
+    void queue_tasks();
+
+    // copies the tile into its frame and writes the frame once complete
+    void gather(uint64_t frame, const glm::ivec4& tile,
+                const std::vector<uint8_t>& pixels);
+
+    FarmSettings m_settings;
+    glm::ivec2 m_tile_size;
+    int m_tiles_per_frame;
+    std::deque<FarmTask> m_tasks;
+    std::unordered_map<uint64_t, Assembly> m_frames;
+    int m_written = 0;
+};
+
+// the worker side of a farm, one per process
+class FarmWorker {
+  public:
+    // connects and reads the hello, see is_connected
+    FarmWorker(const std::filesystem::path& socket_path);
+
+    ~FarmWorker();
+
+    FarmWorker(const FarmWorker&) = delete;
+
+    FarmWorker& operator=(const FarmWorker&) = delete;
+
+    bool is_connected() const;
+
+    glm::ivec2 get_image_size() const;
+
+    // the window size of the worker
+    glm::ivec2 get_tile_size() const;
+
+    // simulation thread, blocks until the coordinator answers. false once
+    // there is no work left
+    bool next_task(FarmTask& task);
+
+    // simulation thread, a frame whose capture goes to send_result
+    void queue_frame(uint64_t frame, const glm::ivec4& tile);
+
+    // capture writer thread, sends the oldest queued frame
+    void send_result(const uint8_t* pixels);
+
+  private:
+    int m_socket = -1;
+    glm::ivec2 m_image_size = glm::ivec2(0);
+    glm::ivec2 m_tile_size = glm::ivec2(0);
+    std::mutex m_mutex;
+    std::deque<std::pair<uint64_t, glm::ivec4>> m_frames;
+};
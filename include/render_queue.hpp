@@ -0,0 +1,111 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "mesh.hpp"
+#include "renderer.hpp"
+#include "shader.hpp"
+#include <cstdint>
+#include <vector>
+
+enum class RenderPass : uint8_t { Opaque = 0, Debug = 1 };
+
+// storage buffer binding of DrawItem::order_buffer
+constexpr int INSTANCE_ORDER_BINDING = 5;
+
+struct DrawItem {
+    uint64_t key = 0;
+    const Mesh* mesh = nullptr;
+    Shader* shader = nullptr;
+    glm::mat4 transform = glm::mat4(1.0f);
+    // storage buffer bound at binding 0 for instanced draws, 0 otherwise
+    GLuint instance_buffer = 0;
+    int instance_count = 0;
+    GLenum mode = GL_TRIANGLES;
+    // command_count indirect commands from this offset when set, the
+    // instance buffer is bound as above
+    GLuint indirect_buffer = 0;
+    size_t indirect_offset = 0;
+    int command_count = 0;
+    // draw order of the instances, bound at INSTANCE_ORDER_BINDING when set
+    GLuint order_buffer = 0;
+};
+
+struct RenderQueueStatistics {
+    int draw_count = 0;
+    int program_changes = 0;
+    int mesh_changes = 0;
+    // samples passed per viewport pixel, only measured in debug builds
+    float overdraw = 0.0f;
+};
+
+// collects draws and submits them sorted by a 64-bit key made of, from the
+// most significant bits down: pass, program, view depth and mesh. every
+// program is bound once per pass and draws within it go front to back
+class RenderQueue {
+  public:
+    RenderQueue();
+
+    ~RenderQueue();
+
+    // depth keys are measured from this camera
+    void set_view(const Camera& camera);
+
+    void submit(RenderPass pass, const Mesh& mesh, Shader& shader,
+                const glm::mat4& transform, const glm::vec3& position,
+                GLenum mode = GL_TRIANGLES);
+
+    template <typename T>
+    void submit_instances(RenderPass pass, const Mesh& mesh,
+                          const ShaderBuffer<T>& shader_buffer, Shader& shader,
+                          int count, const glm::vec3& position,
+                          GLenum mode = GL_TRIANGLES);
+
+    // one multi draw of the commands in indirect_buffer
+    void submit_indirect(RenderPass pass, const Mesh& mesh, Shader& shader,
+                         GLuint instance_buffer, GLuint order_buffer,
+                         GLuint indirect_buffer, size_t indirect_offset,
+                         int command_count, const glm::vec3& position,
+                         GLenum mode = GL_TRIANGLES);
+
+    // draws everything submitted since the last flush
+    void flush();
+
+    // counts the samples passed between the two calls, once per frame around
+    // the scene pass. the result is read back two frames later
+    void begin_overdraw();
+
+    void end_overdraw();
+
+    const RenderQueueStatistics& get_statistics() const;
+
+  private:
+    uint64_t make_key(RenderPass pass, const Mesh& mesh, const Shader& shader,
+                      const glm::vec3& position) const;
+
+    void push(const DrawItem& item);
+
+    glm::vec3 m_view_position = glm::vec3(0.0f);
+    float m_view_distance = 1.0f;
+
+    std::vector<DrawItem> m_items;
+    RenderQueueStatistics m_statistics;
+
+#ifndef NDEBUG
+    GLuint m_overdraw_queries[2];
+    bool m_overdraw_pending[2] = {false, false};
+    // viewport pixels when each query began
+    int m_overdraw_pixels[2] = {1, 1};
+    int m_frame = 0;
+#endif
+};
+
+template <typename T>
+void RenderQueue::submit_instances(RenderPass pass, const Mesh& mesh,
+                                   const ShaderBuffer<T>& shader_buffer,
+                                   Shader& shader, int count,
+                                   const glm::vec3& position, GLenum mode) {
+    push({make_key(pass, mesh, shader, position), &mesh, &shader,
+          glm::mat4(1.0f), shader_buffer.get_id(), count, mode});
+}
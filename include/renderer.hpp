@@ -1,5 +1,6 @@
 #pragma once
 
+#include "frame_counters.hpp"
 #include "glm/ext/matrix_float4x4.hpp"
 #include "mesh.hpp"
 #include "shader.hpp"
@@ -21,6 +22,11 @@ class Camera {
 
     void look_at(const glm::vec3 position);
 
+    // narrows the projection to a rectangle of normalized device coordinates,
+    // which then fills the viewport. tiles of one image rendered this way
+    // line up exactly
+    void crop(const glm::vec2& min, const glm::vec2& max);
+
     glm::mat4 get_matrix() const;
 
     glm::mat4 get_projection() const;
@@ -41,10 +47,22 @@ class Camera {
     float m_far;
 };
 
+// per-camera data read by the vertex and fragment shaders
+struct FrameConstants {
+    glm::mat4 projection;
+    glm::vec4 camera_position;
+};
+
+constexpr int FRAME_CONSTANTS_BINDING = 1;
+
 class Renderer {
   public:
     Renderer();
 
+    void begin_frame();
+
+    void end_frame();
+
     void draw(const Mesh& mesh, const glm::mat4& transform, Shader& shader,
               GLuint mode = GL_TRIANGLES);
 
@@ -55,7 +73,7 @@ class Renderer {
     void set_camera(const Camera& camera);
 
   private:
-    glm::mat4 m_camera_matrix;
+    ShaderBuffer<FrameConstants> m_frame_constants;
     static bool m_glad_initialized;
 };
 
@@ -64,7 +82,6 @@ void Renderer::draw_instances(const Mesh& mesh,
                               const ShaderBuffer<T>& shader_buffer,
                               Shader& shader, int count, GLuint mode) {
 
-    shader.set_uniform_matrix4("projection", m_camera_matrix);
     shader.set_uniform_int("has_texture", mesh.get_texture() != nullptr);
 
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, shader_buffer.get_id());
@@ -74,10 +91,14 @@ void Renderer::draw_instances(const Mesh& mesh,
     glBindVertexArray(mesh.get_vertex_array_id());
     if (mesh.get_texture()) {
         glBindTexture(GL_TEXTURE_2D, mesh.get_texture()->get_id());
+        FrameCounters::add(FrameCounter::TextureBinds);
     }
 
-    glDrawElementsInstanced(mode, mesh.get_indices().size(), GL_UNSIGNED_INT,
-                            mesh.get_indices().data(), count);
+    glDrawElementsInstanced(mode, mesh.get_index_count(), GL_UNSIGNED_INT,
+                            nullptr, count);
+    FrameCounters::add(FrameCounter::DrawCalls);
+    FrameCounters::add(FrameCounter::ProgramBinds);
+    FrameCounters::add(FrameCounter::Instances, count);
 
     glBindVertexArray(0);
     glUseProgram(0);
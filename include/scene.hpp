@@ -1,8 +1,10 @@
 #pragma once
 
 #include "chunk.hpp"
+#include "compute_scheduler.hpp"
 #include "glm/trigonometric.hpp"
 #include "renderer.hpp"
+#include "vegetation.hpp"
 #include <filesystem>
 #include <memory>
 
@@ -37,8 +39,18 @@ class Scene {
     Shader m_post_processing;
     Shader m_gpu_instancing_shader;
     Shader m_grass_generation_shader;
+    Shader m_grass_compaction;
+    ComputeScheduler m_compute_scheduler;
+    Texture m_density_map;
+    TextureArrayPool m_height_maps = TextureArrayPool(GL_R16);
+    TextureArrayPool m_noise_maps = TextureArrayPool(GL_R16F);
     Shader m_flow_field;
     Shader m_displacement;
-    std::vector<std::shared_ptr<Chunk>> m_chunks;
     Mesh m_grass_mesh;
+    std::unique_ptr<SpeciesSet> m_species;
+    std::unique_ptr<VegetationBatch> m_vegetation;
+    InstanceBufferPool m_instances = InstanceBufferPool(sizeof(GrassBuffer));
+    std::vector<std::shared_ptr<Chunk>> m_chunks;
+    ShaderBuffer<ChunkParameters> m_chunk_parameters;
+    RenderQueue m_render_queue;
 };
\ No newline at end of file
@@ -1,35 +1,230 @@
 #pragma once
 
+#include "frame_counters.hpp"
+#include "gl_debug.hpp"
 #include "glad/glad.h"
 #include "glm/ext/matrix_float4x4.hpp"
+#include "gpu_memory.hpp"
 #include "texture.hpp"
+#include "texture_array.hpp"
+#include "upload.hpp"
+#include <cstring>
 #include <filesystem>
+#include <iostream>
 
 template <typename T> class ShaderBuffer {
   public:
-    ShaderBuffer() = default;
+    ShaderBuffer() : m_allocation(MemoryCategory::Buffer) {}
 
     ~ShaderBuffer();
 
     void load_data(const std::vector<T>& data);
 
+    // immutable, zero-filled storage that only the GPU writes to
+    void allocate(size_t count);
+
+    std::shared_ptr<const UploadTicket> load_data_async(UploadService& uploads,
+                                                        const std::vector<T>& data);
+
+    // persistently mapped storage split into one segment per frame in flight,
+    // each segment takes count pushes of a single element
+    void create_ring(size_t count, int segment_count = 3);
+
+    // waits until the gpu has released the next segment and rewinds it
+    void begin_frame();
+
+    // returns the byte offset of the copy, or npos once the segment is full
+    size_t push(const T* data, size_t count = 1);
+
+    size_t push(const T& value);
+
+    void end_frame();
+
+    void bind_range(int index, size_t offset, size_t count = 1) const;
+
+    // debug builds only, applies to the current storage
+    void set_label(const std::string& label) const;
+
     GLuint get_id() const;
 
+    // frees the storage, allocate or load_data bring it back
+    void release();
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
   private:
-    GLuint m_shader_buffer_object;
+
+    GLuint m_shader_buffer_object = 0;
+    bool m_immutable = false;
+    GpuAllocation m_allocation;
+
+    // ring mode
+    uint8_t* m_mapped = nullptr;
+    size_t m_segment_size = 0;
+    size_t m_alignment = 1;
+    size_t m_head = 0;
+    int m_segment = 0;
+    std::vector<GLsync> m_fences;
 };
 
 template <typename T>
 void ShaderBuffer<T>::load_data(const std::vector<T>& data) {
-    glGenBuffers(1, &m_shader_buffer_object);
+    if (m_immutable) {
+        release();
+    }
+    if (!m_shader_buffer_object) {
+        glGenBuffers(1, &m_shader_buffer_object);
+    }
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_shader_buffer_object);
     glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(T), data.data(),
                  GL_DYNAMIC_COPY);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_allocation.resize(data.size() * sizeof(T));
+    FrameCounters::add(FrameCounter::UploadedBytes, data.size() * sizeof(T));
+}
+
+template <typename T> void ShaderBuffer<T>::allocate(size_t count) {
+    release();
+    glGenBuffers(1, &m_shader_buffer_object);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_shader_buffer_object);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, count * sizeof(T), nullptr, 0);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT,
+                      nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_immutable = true;
+    m_allocation.resize(count * sizeof(T));
+}
+
+template <typename T>
+std::shared_ptr<const UploadTicket>
+ShaderBuffer<T>::load_data_async(UploadService& uploads,
+                                 const std::vector<T>& data) {
+    if (m_immutable) {
+        release();
+    }
+    if (!m_shader_buffer_object) {
+        glGenBuffers(1, &m_shader_buffer_object);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_shader_buffer_object);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    std::vector<uint8_t> bytes(data.size() * sizeof(T));
+    std::memcpy(bytes.data(), data.data(), bytes.size());
+    m_allocation.resize(bytes.size());
+    return uploads.upload_buffer(m_shader_buffer_object, GL_DYNAMIC_COPY,
+                                 std::move(bytes));
+}
+
+template <typename T>
+void ShaderBuffer<T>::create_ring(size_t count, int segment_count) {
+    release();
+
+    GLint alignment;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_alignment = alignment > 0 ? alignment : 1;
+    // every push starts on an aligned offset so bind_range can address it
+    m_segment_size =
+        count * ((sizeof(T) + m_alignment - 1) / m_alignment * m_alignment);
+    m_fences.assign(segment_count, nullptr);
+    m_segment = 0;
+    m_head = 0;
+
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_shader_buffer_object);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_shader_buffer_object);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, m_segment_size * segment_count,
+                    nullptr, flags);
+    m_mapped = (uint8_t*)glMapBufferRange(
+        GL_SHADER_STORAGE_BUFFER, 0, m_segment_size * segment_count, flags);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_immutable = true;
+    m_allocation.resize(m_segment_size * segment_count);
+
+    if (!m_mapped) {
+        std::cerr << "FAILED TO MAP SHADER BUFFER RING" << std::endl;
+    }
+}
+
+template <typename T> void ShaderBuffer<T>::begin_frame() {
+    if (m_fences.empty()) {
+        return;
+    }
+
+    m_segment = (m_segment + 1) % m_fences.size();
+    m_head = 0;
+
+    // with a segment per frame in flight the fence has normally signalled
+    // long ago, this only blocks when the gpu falls that many frames behind
+    GLsync& fence = m_fences[m_segment];
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
 }
 
-template <typename T> ShaderBuffer<T>::~ShaderBuffer() {
-    glDeleteBuffers(1, &m_shader_buffer_object);
+template <typename T> size_t ShaderBuffer<T>::push(const T* data, size_t count) {
+    size_t size = count * sizeof(T);
+    if (!m_mapped || m_head + size > m_segment_size) {
+        return npos;
+    }
+
+    size_t offset = m_segment * m_segment_size + m_head;
+    std::memcpy(m_mapped + offset, data, size);
+    FrameCounters::add(FrameCounter::UploadedBytes, size);
+    m_head = (m_head + size + m_alignment - 1) / m_alignment * m_alignment;
+    return offset;
+}
+
+template <typename T> size_t ShaderBuffer<T>::push(const T& value) {
+    return push(&value, 1);
+}
+
+template <typename T> void ShaderBuffer<T>::end_frame() {
+    if (m_fences.empty()) {
+        return;
+    }
+
+    GLsync& fence = m_fences[m_segment];
+    if (fence) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+template <typename T>
+void ShaderBuffer<T>::bind_range(int index, size_t offset, size_t count) const {
+    if (offset == npos) {
+        return;
+    }
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, index, m_shader_buffer_object,
+                      offset, count * sizeof(T));
+}
+
+template <typename T> void ShaderBuffer<T>::release() {
+    for (GLsync fence : m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    m_fences.clear();
+
+    // deleting a mapped buffer unmaps it
+    if (m_shader_buffer_object) {
+        glDeleteBuffers(1, &m_shader_buffer_object);
+    }
+    m_shader_buffer_object = 0;
+    m_immutable = false;
+    m_mapped = nullptr;
+    m_allocation.resize(0);
+}
+
+template <typename T> ShaderBuffer<T>::~ShaderBuffer() { release(); }
+
+template <typename T>
+void ShaderBuffer<T>::set_label(const std::string& label) const {
+    gl_debug_label(GL_BUFFER, m_shader_buffer_object, label);
 }
 
 template <typename T> GLuint ShaderBuffer<T>::get_id() const {
@@ -64,16 +259,19 @@ class Shader {
     void set_uniform_texture(const std::string& name, const Texture& texture,
                              int index);
 
+    void set_uniform_texture_array(const std::string& name,
+                                   const TextureArray& texture, int index);
+
     void flush_textures();
 
     GLuint get_id() const;
 
-    template <typename T> void set_buffer(ShaderBuffer<T>& buffer, int index);
+    template <typename T>
+    void set_buffer(const ShaderBuffer<T>& buffer, int index);
 
+    // no barrier, the caller or the compute scheduler issues it
     void dispatch(const glm::ivec3& work_groups);
 
-    void dispatch_texture(Texture& texture, const glm::ivec3& work_groups);
-
   private:
     GLuint m_id;
 
@@ -82,8 +280,8 @@ class Shader {
 };
 
 template <typename T>
-void Shader::set_buffer(ShaderBuffer<T>& buffer, int index) {
+void Shader::set_buffer(const ShaderBuffer<T>& buffer, int index) {
     glUseProgram(m_id);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer.get_id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, buffer.get_id());
     glUseProgram(0);
 }
\ No newline at end of file
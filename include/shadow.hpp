@@ -0,0 +1,98 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "renderer.hpp"
+#include "shader.hpp"
+#include "vegetation.hpp"
+#include <memory>
+#include <vector>
+
+constexpr int SHADOW_CASCADE_COUNT = 4;
+constexpr int SHADOW_CONSTANTS_BINDING = 3;
+constexpr int SHADOW_MAP_TEXTURE_UNIT = 4;
+
+// per-frame cascade data read by default_fragment.glsl
+struct ShadowConstants {
+    glm::mat4 light_matrices[SHADOW_CASCADE_COUNT];
+    glm::vec4 cascade_splits;
+    glm::vec4 view_position;
+    glm::vec4 view_direction;
+    // x: enabled, y: depth bias, z: texel size
+    glm::vec4 parameters;
+};
+
+// cascaded shadow maps for the directional light. terrain depth is cached per
+// cascade and only re-rendered when the light or the snapped cascade origin
+// moves, grass is drawn on top of the cached depth with thinned casters, one
+// multi draw per cascade. procedural blades cast with procedural_depth
+class ShadowMap {
+  public:
+    ShadowMap(SpeciesSet& species, Shader& terrain_depth, Shader& grass_depth,
+              Shader& procedural_depth, int resolution = 2048);
+
+    ~ShadowMap();
+
+    void update(Renderer& renderer, const Camera& camera,
+                const glm::vec3& light_direction,
+                const std::vector<std::shared_ptr<Chunk>>& chunks);
+
+    void set_enabled(bool enabled);
+
+    // re-renders the cached terrain depth, for terrain that changed in place
+    void invalidate();
+
+    bool is_enabled() const;
+
+    // gpu time of the last finished update in milliseconds
+    float get_gpu_time() const;
+
+    // cascades whose terrain depth was re-rendered during the last update
+    int get_terrain_refreshes() const;
+
+  private:
+    struct Cascade {
+        Camera camera;
+        glm::mat4 matrix = glm::mat4(1.0f);
+        glm::vec3 origin = glm::vec3(0.0f);
+        float extent = 0.0f;
+        // blades per grass caster, 0 keeps the cascade terrain only
+        int grass_stride = 0;
+        bool valid = false;
+    };
+
+    void fit_cascade(const Camera& camera, float near, float far,
+                     const glm::vec3& light_direction, glm::vec3& origin,
+                     float& extent) const;
+
+    void render_terrain(Renderer& renderer, Cascade& cascade, int layer,
+                        const std::vector<std::shared_ptr<Chunk>>& chunks);
+
+    void render_grass(Renderer& renderer, Cascade& cascade, int layer,
+                      const std::vector<std::shared_ptr<Chunk>>& chunks);
+
+    VegetationBatch m_casters;
+    Shader& m_terrain_depth;
+    Shader& m_grass_depth;
+    Shader& m_procedural_depth;
+
+    int m_resolution;
+    bool m_enabled = true;
+    GLuint m_frame_buffer;
+    // cached terrain depth and the composited depth that shaders sample
+    GLuint m_terrain_texture;
+    GLuint m_depth_texture;
+    GpuAllocation m_allocation;
+
+    Cascade m_cascades[SHADOW_CASCADE_COUNT];
+    float m_splits[SHADOW_CASCADE_COUNT];
+    glm::vec3 m_light_direction = glm::vec3(0.0f);
+    int m_ready_chunks = 0;
+    int m_frame = 0;
+    int m_terrain_refreshes = 0;
+
+    ShaderBuffer<ShadowConstants> m_constants;
+
+    GLuint m_queries[2];
+    bool m_query_pending[2] = {false, false};
+    float m_gpu_time = 0.0f;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "glm/ext/vector_float2.hpp"
+#include "mesh.hpp"
+#include "shader.hpp"
+#include "texture_array.hpp"
+#include <cstdint>
+
+class ComputeScheduler;
+
+// gpu port of the ground built by Chunk::build. writes the height map layer
+// and both ground meshes of a chunk from the seed alone, so nothing but a
+// 256 entry permutation crosses the bus
+class TerrainGenerator {
+  public:
+    explicit TerrainGenerator(Shader& shader);
+
+    // render thread, uploads the permutation of siv::PerlinNoise for seed
+    void set_seed(uint64_t seed);
+
+    // records the passes filling ground and low_poly, both allocated for a
+    // chunk of size cells, and height_map. owner is handed to the scheduler
+    void record(ComputeScheduler& scheduler, const void* owner,
+                const glm::vec2& origin, int size, float terrain_height,
+                float terrain_scale, Mesh& ground, Mesh& low_poly,
+                const TextureLayer& height_map);
+
+  private:
+    Shader& m_shader;
+    bool m_seeded = false;
+    uint64_t m_seed = 0;
+    ShaderBuffer<uint32_t> m_permutation;
+};
@@ -1,13 +1,22 @@
 #pragma once
 
 #include "glad/glad.h"
+#include "gpu_memory.hpp"
 #include "glm/ext/vector_int2.hpp"
 #include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+class UploadService;
+class UploadTicket;
 
 class Texture {
   public:
-    Texture();
+    friend class UploadService;
+
+    explicit Texture(MemoryCategory category = MemoryCategory::Texture);
 
     ~Texture();
 
@@ -17,10 +26,25 @@ class Texture {
 
     void load_texture_from_path(const std::filesystem::path& texture_path);
 
+    void load_texture_from_baked(const std::filesystem::path& texture_path);
+
+    std::shared_ptr<const UploadTicket>
+    load_texture_from_byte_async(UploadService& uploads,
+                                 std::vector<uint8_t> pixel_data, GLuint type,
+                                 const glm::ivec2& size, GLuint internal_format,
+                                 GLuint format);
+
+    std::shared_ptr<const UploadTicket>
+    load_texture_from_path_async(UploadService& uploads,
+                                 const std::filesystem::path& texture_path);
+
     void set_filter_mode(GLuint mode);
 
     void set_wrap_mode(GLuint mode);
 
+    // debug builds only, textures loaded from a path are named after it
+    void set_label(const std::string& label) const;
+
     glm::ivec2 get_size() const;
 
     GLuint get_id() const;
@@ -29,6 +53,7 @@ class Texture {
     GLuint m_id;
     glm::ivec2 m_size;
     int m_color_channel_count;
+    GpuAllocation m_allocation;
 };
 
 class RenderTexture : public Texture {
@@ -41,7 +66,10 @@ class RenderTexture : public Texture {
 
     void end_draw();
 
+    GLuint get_frame_buffer_id() const;
+
   private:
     GLuint m_frame_buffer;
     GLuint m_render_buffer;
+    GpuAllocation m_depth_allocation;
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/ext/vector_int2.hpp"
+#include "gpu_memory.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class UploadService;
+class UploadTicket;
+
+// GL_TEXTURE_2D_ARRAY of equally sized layers with linear filtering and
+// clamped edges, layers are handed out one per chunk
+class TextureArray {
+  public:
+    TextureArray(const glm::ivec2& size, int layer_count,
+                 GLenum internal_format);
+
+    ~TextureArray();
+
+    TextureArray(const TextureArray&) = delete;
+
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    // -1 when every layer is taken
+    int acquire();
+
+    void release(int layer);
+
+    GLuint get_id() const;
+
+    glm::ivec2 get_size() const;
+
+    GLenum get_internal_format() const;
+
+    int get_layer_count() const;
+
+    int get_used_count() const;
+
+  private:
+    GLuint m_id;
+    glm::ivec2 m_size;
+    int m_layer_count;
+    GLenum m_internal_format;
+
+    std::vector<int> m_free;
+    GpuAllocation m_allocation;
+};
+
+// one layer of a pooled array, handed back to it on destruction
+class TextureLayer {
+  public:
+    TextureLayer() = default;
+
+    TextureLayer(std::shared_ptr<TextureArray> array, int layer);
+
+    ~TextureLayer();
+
+    TextureLayer(TextureLayer&& other);
+
+    TextureLayer& operator=(TextureLayer&& other);
+
+    TextureLayer(const TextureLayer&) = delete;
+
+    TextureLayer& operator=(const TextureLayer&) = delete;
+
+    void upload(const void* pixel_data, GLuint type, GLuint format);
+
+    std::shared_ptr<const UploadTicket>
+    upload_async(UploadService& uploads, std::vector<uint8_t> pixel_data,
+                 GLuint type, GLuint format);
+
+    bool is_valid() const;
+
+    const TextureArray& get_array() const;
+
+    int get_layer() const;
+
+    glm::ivec2 get_size() const;
+
+  private:
+    void reset();
+
+    std::shared_ptr<TextureArray> m_array;
+    int m_layer = -1;
+};
+
+// arrays of one format, a new array is added whenever no array of the
+// requested layer size has a free layer. render thread only
+class TextureArrayPool {
+  public:
+    TextureArrayPool(GLenum internal_format, int layers_per_array = 256);
+
+    TextureLayer acquire(const glm::ivec2& size);
+
+    // drops arrays that had no layer in use for more than idle_trims calls
+    // in a row, 0 drops every empty array at once
+    void trim(int idle_trims = 0);
+
+    const std::vector<std::shared_ptr<TextureArray>>& get_arrays() const;
+
+  private:
+    GLenum m_internal_format;
+    int m_layers_per_array;
+    std::vector<std::shared_ptr<TextureArray>> m_arrays;
+    // trims each array has been empty for
+    std::vector<int> m_idle_trims;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "gpu_memory.hpp"
+#include "glm/ext/vector_int2.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+class Window;
+class Texture;
+
+class UploadTicket {
+  public:
+    bool is_ready() const;
+
+  private:
+    friend class UploadService;
+
+    GLsync m_fence = nullptr;
+    bool m_ready = false;
+    // render thread, runs once the upload is ready
+    std::function<void()> m_complete;
+};
+
+// persistently mapped staging buffer, regions are recycled once their fence
+// has signalled
+class StagingRing {
+  public:
+    StagingRing(GLenum target, size_t capacity);
+
+    ~StagingRing();
+
+    // returns npos when the request can never fit in the ring
+    size_t allocate(size_t size);
+
+    void fence(size_t offset, size_t size);
+
+    uint8_t* get_data(size_t offset) const;
+
+    GLuint get_id() const;
+
+    GLenum get_target() const;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+  private:
+    struct Region {
+        size_t begin;
+        size_t end;
+        GLsync fence;
+    };
+
+    GLenum m_target;
+    GLuint m_buffer;
+    uint8_t* m_data;
+    size_t m_capacity;
+    size_t m_head = 0;
+    std::deque<Region> m_in_flight;
+    GpuAllocation m_allocation;
+};
+
+class UploadService {
+  public:
+    UploadService(const Window& window, size_t staging_size = 64 << 20);
+
+    ~UploadService();
+
+    std::shared_ptr<const UploadTicket>
+    upload_texture(Texture& texture, const std::filesystem::path& path);
+
+    std::shared_ptr<const UploadTicket>
+    upload_texture(Texture& texture, std::vector<uint8_t> pixel_data,
+                   GLuint type, const glm::ivec2& size, GLuint internal_format,
+                   GLuint format);
+
+    // one layer of an immutable GL_TEXTURE_2D_ARRAY
+    std::shared_ptr<const UploadTicket>
+    upload_texture_layer(GLuint texture, int layer,
+                         std::vector<uint8_t> pixel_data, GLuint type,
+                         const glm::ivec2& size, GLuint format);
+
+    std::shared_ptr<const UploadTicket>
+    upload_buffer(GLuint buffer, GLenum usage, std::vector<uint8_t> data);
+
+    // render thread, marks finished uploads as ready and runs their
+    // completions
+    void poll();
+
+  private:
+    using Job = std::function<void()>;
+
+    // what the upload thread learned about a texture file, only applied to
+    // the texture by the completion on the render thread
+    struct TextureMetadata {
+        glm::ivec2 size = glm::ivec2(0);
+        int channel_count = 0;
+        size_t bytes = 0;
+        bool valid = false;
+    };
+
+    // job runs on the upload thread, complete on the render thread once the
+    // upload is ready. without an upload context both run before returning
+    std::shared_ptr<const UploadTicket> enqueue(Job job,
+                                                Job complete = nullptr);
+
+    void run();
+
+    // calling thread, stands in for the upload thread when no shared
+    // context could be created
+    void run_inline(const Job& job);
+
+    void upload_baked(GLuint texture, const std::filesystem::path& path,
+                      TextureMetadata& metadata);
+
+    void upload_pixels(GLuint texture, const uint8_t* pixel_data, size_t size,
+                       GLuint type, const glm::ivec2& extent,
+                       GLuint internal_format, GLuint format);
+
+    GLFWwindow* m_context;
+    std::thread m_worker;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::pair<Job, std::shared_ptr<UploadTicket>>> m_jobs;
+    std::vector<std::shared_ptr<UploadTicket>> m_pending;
+    bool m_running = true;
+
+    size_t m_staging_size;
+    std::unique_ptr<StagingRing> m_pixel_ring;
+    std::unique_ptr<StagingRing> m_buffer_ring;
+};
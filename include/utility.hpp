@@ -1,5 +1,6 @@
 #pragma once
 
+#include "gl_debug.hpp"
 #include "glad/glad.h"
 #include <iostream>
 
@@ -29,9 +30,17 @@ inline GLenum gl_check_error(const char* file, int line) {
         case GL_INVALID_FRAMEBUFFER_OPERATION:
             error = "INVALID_FRAMEBUFFER_OPERATION";
         }
-        std::cout << error << " " << file << " " << line << std::endl;
+        std::cerr << error << " " << file << " " << line << std::endl;
     }
     return error_code;
 }
 
-#define gl_check_error() gl_check_error(__FILE__, __LINE__)
\ No newline at end of file
+// polls only in debug builds whose context has no debug output, the
+// callback of gl_debug.hpp reports everything else without a stall
+#ifdef NDEBUG
+#define gl_check_error() ((void)0)
+#else
+#define gl_check_error()                                                       \
+    (gl_debug_is_installed() ? (void)0                                         \
+                             : (void)gl_check_error(__FILE__, __LINE__))
+#endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "glad/glad.h"
+#include "glm/ext/vector_float2.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "gpu_memory.hpp"
+#include "instance_pool.hpp"
+#include "mesh.hpp"
+#include "render_queue.hpp"
+#include "shader.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+// one kind of plant the grass generation scatters, every cell grows at most
+// one plant of a species picked by weight
+struct Species {
+    std::string name;
+    const Mesh* mesh;
+    // drawn into the shadow map instead of the mesh when set
+    const Mesh* caster = nullptr;
+    // share of the cells that grow something
+    float weight = 1.0f;
+    // instance height scale
+    glm::vec2 height_range = glm::vec2(1.0f, 4.0f);
+};
+
+// per species data read by grass_generation.glsl
+struct SpeciesParameters {
+    // upper end of the species' slice of [0, 1)
+    float threshold;
+    float min_height;
+    float max_height;
+    // of the species' mesh in the merged index buffer
+    int first_index;
+};
+
+constexpr int SPECIES_BINDING = 4;
+// uint attribute holding base instance + gl_InstanceID
+constexpr int INSTANCE_INDEX_LOCATION = 4;
+// maps sampled by procedural draws
+constexpr int PROCEDURAL_HEIGHT_MAP_TEXTURE_UNIT = 9;
+constexpr int PROCEDURAL_NOISE_MAP_TEXTURE_UNIT = 10;
+
+struct SpeciesRange {
+    int first_index;
+    int index_count;
+};
+
+// the meshes of every species merged into one vertex array, so a multi draw
+// can pick any of them per command
+class SpeciesSet {
+  public:
+    explicit SpeciesSet(const std::vector<Species>& species);
+
+    ~SpeciesSet();
+
+    SpeciesSet(const SpeciesSet&) = delete;
+
+    SpeciesSet& operator=(const SpeciesSet&) = delete;
+
+    int get_count() const;
+
+    const Species& get_species(int index) const;
+
+    // indices of a species' mesh or caster in the merged mesh
+    SpeciesRange get_range(int index, bool caster) const;
+
+    const Mesh& get_mesh() const;
+
+    // binds the parameters of the generation at SPECIES_BINDING
+    void bind() const;
+
+    // grows the instance index attribute to cover count instances
+    void reserve_instances(size_t count);
+
+  private:
+    std::vector<Species> m_species;
+    std::vector<SpeciesRange> m_ranges;
+    std::vector<SpeciesRange> m_caster_ranges;
+    Mesh m_mesh;
+    ShaderBuffer<SpeciesParameters> m_parameters;
+
+    GLuint m_instance_indices = 0;
+    size_t m_instance_index_count = 0;
+    GpuAllocation m_allocation;
+};
+
+struct DrawCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// indirect commands for the species of many chunks. the chunks of one
+// instance buffer take a single multi draw, however many chunks and species
+// it holds. procedural chunks are batched by the arrays of their height and
+// noise maps instead, the base instance of each command picks its entry of
+// a ProceduralBlades buffer bound at binding 0
+class VegetationBatch {
+  public:
+    // casters draws the shadow caster of each species instead of its mesh
+    VegetationBatch(SpeciesSet& species, bool casters = false);
+
+    // room for chunk_count chunks in each of draw_count draws per frame
+    void reserve(size_t chunk_count, int draw_count = 1);
+
+    void begin_frame();
+
+    void end_frame();
+
+    // every stride-th instance of each species of the chunk
+    void add(const Chunk& chunk, int stride = 1);
+
+    // instance buffers of what was added since the last draw, a draw sets
+    // the batch_index uniform to the position of its buffer in here. null
+    // for procedural batches
+    std::vector<const InstanceBuffer*> get_buffers() const;
+
+    // draws everything added since the last draw with the bound state,
+    // procedural batches with procedural when set
+    void draw(Shader& shader, Shader* procedural = nullptr);
+
+    // queues the multi draws instead, sorted with the rest of the pass.
+    // procedural batches sample textures the queue doesn't bind, they are
+    // left for the next draw
+    void submit(RenderQueue& queue, RenderPass pass, Shader& shader,
+                const glm::vec3& position);
+
+  private:
+    struct Batch {
+        const InstanceBuffer* buffer = nullptr;
+        std::vector<DrawCommand> commands;
+        // procedural batches, one entry per command
+        const TextureArray* height_map = nullptr;
+        const TextureArray* noise_map = nullptr;
+        std::vector<ProceduralBlades> blades;
+    };
+
+    void add_procedural(const Chunk& chunk, int stride);
+
+    // pushes the commands of a batch, npos once the ring is full
+    size_t push(const Batch& batch);
+
+    SpeciesSet& m_species;
+    bool m_casters;
+    std::vector<Batch> m_batches;
+
+    ShaderBuffer<DrawCommand> m_commands;
+    ShaderBuffer<ProceduralBlades> m_blades;
+    size_t m_capacity = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/ext/vector_int2.hpp"
+#include "mesh.hpp"
+#include "renderer.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+#include "vegetation.hpp"
+
+constexpr int VISIBILITY_ID_TEXTURE_UNIT = 7;
+constexpr int VISIBILITY_DEPTH_TEXTURE_UNIT = 8;
+// the merged species mesh, read by visibility_resolve.glsl
+constexpr int VISIBILITY_VERTEX_BINDING = 7;
+constexpr int VISIBILITY_INDEX_BINDING = 8;
+
+// deferred path for the blades. the geometry pass only writes instance and
+// triangle ids and depth, a full screen pass per instance buffer then
+// rebuilds the attributes of the visible triangle and lights every pixel
+// once, however many blades were drawn over it
+class VisibilityBuffer {
+  public:
+    VisibilityBuffer(const SpeciesSet& species, const glm::ivec2& size);
+
+    ~VisibilityBuffer();
+
+    VisibilityBuffer(const VisibilityBuffer&) = delete;
+
+    VisibilityBuffer& operator=(const VisibilityBuffer&) = delete;
+
+    // draws the blades added to vegetation on top of target, which already
+    // holds the opaque pass. size is the viewport in the lower left corner
+    void draw(RenderTexture& target, const glm::ivec2& size,
+              const Camera& camera, VegetationBatch& vegetation,
+              Shader& visibility, Shader& resolve);
+
+  private:
+    const SpeciesSet& m_species;
+    glm::ivec2 m_size;
+    GLuint m_frame_buffer;
+    Texture m_ids;
+    Texture m_depth;
+    Mesh m_screen;
+};
@@ -3,7 +3,8 @@
 #include "GLFW/glfw3.h"
 #include "glm/ext/vector_float2.hpp"
 #include "glm/ext/vector_int2.hpp"
-#include <map>
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -23,8 +24,27 @@ class Timer {
     bool m_paused = false;
 };
 
+enum class InputEventType : uint8_t { Key, Mouse, Cursor };
+
+struct InputEvent {
+    // glfw time at which the callback fired
+    double time = 0.0;
+    InputEventType type = InputEventType::Key;
+    int code = 0;
+    int action = 0;
+    // cursor position in window coordinates for cursor and mouse events
+    glm::vec2 position = glm::vec2(0.0f);
+};
+
+// key and button state in fixed arrays indexed by the glfw code, plus a ring
+// of the most recent timestamped events
 class Input {
   public:
+    static constexpr int KEY_COUNT = GLFW_KEY_LAST + 1;
+    static constexpr int BUTTON_COUNT = GLFW_MOUSE_BUTTON_LAST + 1;
+    static constexpr int EVENT_CAPACITY = 64;
+
+    // starts a new frame, resets the edge states and the frame's events
     void clear_inputs();
 
     bool is_key_pressed(GLuint key);
@@ -51,20 +71,39 @@ class Input {
 
     void set_mouse_up(GLuint button, bool flag);
 
-  private:
-    std::map<GLuint, bool> m_key_press;
-    std::map<GLuint, bool> m_key_down;
-    std::map<GLuint, bool> m_key_up;
+    void push_event(const InputEvent& event);
+
+    // events received since the last clear, oldest first. only the newest
+    // EVENT_CAPACITY of them are kept
+    int get_event_count() const;
 
-    std::map<GLuint, bool> m_mouse_press;
-    std::map<GLuint, bool> m_mouse_down;
-    std::map<GLuint, bool> m_mouse_up;
+    const InputEvent& get_event(int index) const;
+
+    // time of the first event since the last clear, negative when there was
+    // none. this one survives ring overflow
+    double get_first_event_time() const;
+
+  private:
+    std::array<bool, KEY_COUNT> m_key_press = {};
+    std::array<bool, KEY_COUNT> m_key_down = {};
+    std::array<bool, KEY_COUNT> m_key_up = {};
+
+    std::array<bool, BUTTON_COUNT> m_mouse_press = {};
+    std::array<bool, BUTTON_COUNT> m_mouse_down = {};
+    std::array<bool, BUTTON_COUNT> m_mouse_up = {};
+
+    std::array<InputEvent, EVENT_CAPACITY> m_events;
+    uint64_t m_event_head = 0;
+    uint64_t m_frame_begin = 0;
+    double m_first_event_time = -1.0;
 };
 
 class Window {
   public:
     friend class Event;
-    Window(const glm::ivec2& size, const std::string& title);
+    // a hidden window still gets a full context, for offline rendering
+    Window(const glm::ivec2& size, const std::string& title,
+           bool visible = true);
 
     ~Window();
 
@@ -86,6 +125,9 @@ class Window {
 
     void display();
 
+    // applies to the context current on the calling thread
+    void set_swap_interval(int interval);
+
   private:
     static void glfw_key_callback(GLFWwindow* window, int key, int scancode,
                                   int action, int mod);
@@ -93,6 +135,8 @@ class Window {
     static void glfw_mouse_callback(GLFWwindow* window, int button, int action,
                                     int mods);
 
+    static void glfw_cursor_callback(GLFWwindow* window, double x, double y);
+
     glm::ivec2 m_size;
 
     GLFWwindow* m_handler;
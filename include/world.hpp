@@ -0,0 +1,178 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "chunk_cache.hpp"
+#include "heightfield.hpp"
+#include "terrain_generator.hpp"
+#include "texture.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct WorldConfig {
+    // chunk coordinates, max is exclusive
+    glm::ivec2 chunk_min = glm::ivec2(-8);
+    glm::ivec2 chunk_max = glm::ivec2(8);
+    int chunk_size = 32;
+    int grass_per_unit = 2;
+    float terrain_height = 34.0f;
+    float terrain_scale = 0.01f;
+    uint64_t seed = 0;
+    float wind_direction = 315.0f;
+    // the ground is built by terrain_generation.glsl instead of on the
+    // worker threads. validation builds it on both and reports chunks whose
+    // heights disagree
+    bool gpu_terrain = true;
+    bool validate_terrain = false;
+
+    // density masks. the map is stretched over the world bounds and its red
+    // channel scales the density, empty or "none" grows grass everywhere.
+    // blades fade out between two slopes in degrees and only grow between
+    // two normalized terrain heights
+    std::string density_map;
+    glm::vec2 slope_fade = glm::vec2(35.0f, 50.0f);
+    glm::vec2 altitude_range = glm::vec2(0.0f, 1.0f);
+
+    // blades are recomputed by the vertex shader from their cell instead of
+    // being stored, see Chunk::set_procedural
+    bool procedural_blades = false;
+};
+
+constexpr int DENSITY_MAP_TEXTURE_UNIT = 6;
+
+// what a config change invalidates, see compare_world_config
+constexpr uint32_t WORLD_WIND_CHANGED = 1 << 0;
+constexpr uint32_t WORLD_DENSITY_CHANGED = 1 << 1;
+constexpr uint32_t WORLD_TERRAIN_CHANGED = 1 << 2;
+constexpr uint32_t WORLD_LAYOUT_CHANGED = 1 << 3;
+
+// one "key value..." pair per line, # starts a comment. keys missing from
+// the file keep their current value
+bool load_world_config(const std::filesystem::path& path, WorldConfig& config);
+
+bool save_world_config(const std::filesystem::path& path,
+                       const WorldConfig& config);
+
+uint32_t compare_world_config(const WorldConfig& a, const WorldConfig& b);
+
+// the chunk list as the simulation thread sees it, replaced as a whole
+struct WorldSnapshot {
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    HeightfieldStore terrain;
+};
+
+// owns the chunks and rebuilds only what a config change affects. wind
+// touches no chunk, density, its masks and the blade storage regenerate the
+// blades of every chunk in place. terrain and layout changes build the
+// affected chunks on worker threads and swap them in together once all of
+// them are ready
+class World {
+  public:
+    // the cpu ground of chunks found in the cache is copied from it instead
+    // of being built
+    World(const WorldConfig& config, const SpeciesSet& species,
+          Shader& generator, Shader& compaction, Shader& terrain,
+          ComputeScheduler& scheduler, UploadService& uploads,
+          const ChunkCache* cache = nullptr);
+
+    ~World();
+
+    World(const World&) = delete;
+
+    World& operator=(const World&) = delete;
+
+    // render thread, returns the WORLD_*_CHANGED bits of what changed
+    uint32_t apply(const WorldConfig& config);
+
+    // render thread, uploads finished builds and swaps in a complete
+    // rebuild. returns true when a swap replaced chunks, not when the first
+    // build streams new ones in
+    bool poll();
+
+    // any thread
+    std::shared_ptr<const WorldSnapshot> get_snapshot() const;
+
+    const WorldConfig& get_config() const;
+
+    // chunks of the running rebuild that are not ready yet
+    int get_pending_count() const;
+
+    // render thread, the density mask uniforms of the generation for a
+    // shader that repeats it, they change with WORLD_DENSITY_CHANGED and
+    // WORLD_LAYOUT_CHANGED
+    void set_mask_uniforms(Shader& shader) const;
+
+    // render thread, drops the blades of the least recently drawn chunks
+    // until the tracked total fell by bytes or no chunk is left to evict,
+    // returns the bytes the pools actually released
+    size_t evict(size_t bytes);
+
+  private:
+    struct BuildJob {
+        uint64_t generation;
+        glm::ivec2 coordinate;
+        WorldConfig config;
+    };
+
+    struct BuildResult {
+        uint64_t generation;
+        ChunkGeometry geometry;
+    };
+
+    static int64_t key(const glm::ivec2& coordinate);
+
+    // queues every chunk of the layout that can't be kept
+    void schedule(const WorldConfig& config, bool rebuild_all);
+
+    void publish();
+
+    // loads the density map and sets the mask uniforms of the generator
+    void apply_rules();
+
+    void run();
+
+    const SpeciesSet& m_species;
+    Shader& m_generator;
+    Shader& m_compaction;
+    ComputeScheduler& m_scheduler;
+    UploadService& m_uploads;
+    const ChunkCache* m_cache;
+    WorldConfig m_config;
+    Texture m_density_map;
+    TerrainGenerator m_terrain;
+    // height and noise map layers of every chunk
+    TextureArrayPool m_height_maps;
+    TextureArrayPool m_noise_maps;
+    // instances of every chunk
+    InstanceBufferPool m_instances;
+
+    // chunks in layout order and by coordinate
+    std::vector<std::shared_ptr<Chunk>> m_chunks;
+    std::unordered_map<int64_t, std::shared_ptr<Chunk>> m_chunk_map;
+
+    // the rebuild in progress, swapped in once every chunk is ready. the
+    // first build streams chunks in one by one instead
+    uint64_t m_generation = 0;
+    bool m_streaming = true;
+    bool m_swap_pending = false;
+    std::vector<glm::ivec2> m_layout;
+    std::unordered_map<int64_t, std::shared_ptr<Chunk>> m_pending;
+    int m_outstanding = 0;
+
+    mutable std::mutex m_snapshot_mutex;
+    std::shared_ptr<const WorldSnapshot> m_snapshot;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<BuildJob> m_jobs;
+    std::deque<BuildResult> m_results;
+    bool m_running = true;
+};
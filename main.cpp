@@ -6,12 +6,32 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "compute_scheduler.hpp"
+#include "dynamic_resolution.hpp"
+#include "far_field.hpp"
+#include "frame_capture.hpp"
+#include "frame_counters.hpp"
+#include "frame_pacing.hpp"
+#include "frame_pipeline.hpp"
+#include "gl_debug.hpp"
+#include "gpu_memory.hpp"
+#include "heightfield.hpp"
+#include "instance_sort.hpp"
 #include "include/chunk.hpp"
 #include "include/mesh.hpp"
+#include "render_farm.hpp"
+#include "render_queue.hpp"
 #include "renderer.hpp"
+#include "shadow.hpp"
 #include "texture.hpp"
+#include "upload.hpp"
+#include "vegetation.hpp"
+#include "visibility_buffer.hpp"
+#include "world.hpp"
 #include "window.hpp"
 #include <fstream>
+#include <iostream>
+#include <cstdio>
 #include <memory>
 #include <sstream>
 
@@ -86,13 +106,186 @@ Mesh load_model(const std::filesystem::path& model_path) {
     return mesh;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // command line
+    // --capture <directory>    record every frame from the start
+    // --capture-format raw|png
+    // --frames <count>         offline render: fixed time step, no dropped
+    //                          captures, quits after count frames
+    // --headless               hidden window, e.g. for llvmpipe batch renders
+    // --world <path>           world config, resources/world.cfg by default
+    // --memory-budget <mb>     evicts the blades of unused chunks above it
+    // --drop-mesh-copies       frees cpu copies of the chunk ground meshes
+    // --memory-stats <path>    writes the gpu memory totals as json on exit
+    // --grass-path forward|visibility
+    //                          starts with the given blade render path
+    // --blades instanced|procedural
+    //                          stored or recomputed blades, overrides the
+    //                          world config
+    // --frame-stats <path>     writes the render path, the blade storage,
+    //                          the average gpu frame time and the average
+    //                          frame counters as json on exit
+    // --size <width> <height>  window and capture size, 1920 1080 by default
+    // --chunk-cache <path>     copies the cpu ground from a chunk cache
+    // --farm <workers>         renders the --frames frames with that many
+    //                          headless worker processes, 0 for one per
+    //                          core, into the capture directory
+    // --farm-split tiles|frames
+    //                          screen tiles of every frame or runs of frames
+    // --farm-tiles <count>     tiles per side, 2 by default
+    // --farm-range <frames>    frames per task when splitting by time
+    // --farm-worker <socket>   one worker of a farm, started by the farm
+    std::filesystem::path capture_directory = "capture";
+    CaptureFormat capture_format = CaptureFormat::PNG;
+    bool enable_capture = false;
+    bool headless = false;
+    int offline_frames = 0;
+    std::filesystem::path world_path = "resources/world.cfg";
+    std::filesystem::path memory_statistics_path;
+    bool visibility_path = false;
+    std::string blade_storage;
+    std::filesystem::path frame_statistics_path;
+    glm::ivec2 window_size(1920, 1080);
+    std::filesystem::path chunk_cache_path;
+    FarmSettings farm_settings;
+    bool farm = false;
+    std::filesystem::path farm_socket;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--capture" && i + 1 < argc) {
+            enable_capture = true;
+            capture_directory = argv[++i];
+        } else if (argument == "--capture-format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "raw") {
+                capture_format = CaptureFormat::Raw;
+            } else if (name != "png") {
+                std::cerr << "UNKNOWN CAPTURE FORMAT: " << name << std::endl;
+                return 1;
+            }
+        } else if (argument == "--frames" && i + 1 < argc) {
+            offline_frames = std::stoi(argv[++i]);
+        } else if (argument == "--headless") {
+            headless = true;
+        } else if (argument == "--world" && i + 1 < argc) {
+            world_path = argv[++i];
+        } else if (argument == "--memory-budget" && i + 1 < argc) {
+            MemoryTracker::set_budget((size_t)std::stoi(argv[++i]) << 20);
+        } else if (argument == "--drop-mesh-copies") {
+            MemoryTracker::set_drop_mesh_copies(true);
+        } else if (argument == "--memory-stats" && i + 1 < argc) {
+            memory_statistics_path = argv[++i];
+        } else if (argument == "--grass-path" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "visibility") {
+                visibility_path = true;
+            } else if (name != "forward") {
+                std::cerr << "UNKNOWN GRASS PATH: " << name << std::endl;
+                return 1;
+            }
+        } else if (argument == "--blades" && i + 1 < argc) {
+            blade_storage = argv[++i];
+            if (blade_storage != "instanced" && blade_storage != "procedural") {
+                std::cerr << "UNKNOWN BLADE STORAGE: " << blade_storage
+                          << std::endl;
+                return 1;
+            }
+        } else if (argument == "--frame-stats" && i + 1 < argc) {
+            frame_statistics_path = argv[++i];
+        } else if (argument == "--size" && i + 2 < argc) {
+            window_size.x = std::stoi(argv[++i]);
+            window_size.y = std::stoi(argv[++i]);
+        } else if (argument == "--chunk-cache" && i + 1 < argc) {
+            chunk_cache_path = argv[++i];
+        } else if (argument == "--farm" && i + 1 < argc) {
+            farm = true;
+            farm_settings.worker_count = std::stoi(argv[++i]);
+        } else if (argument == "--farm-split" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "frames") {
+                farm_settings.split = FarmSplit::Frames;
+            } else if (name != "tiles") {
+                std::cerr << "UNKNOWN FARM SPLIT: " << name << std::endl;
+                return 1;
+            }
+        } else if (argument == "--farm-tiles" && i + 1 < argc) {
+            farm_settings.tiles = std::stoi(argv[++i]);
+        } else if (argument == "--farm-range" && i + 1 < argc) {
+            farm_settings.frame_range = std::stoi(argv[++i]);
+        } else if (argument == "--farm-worker" && i + 1 < argc) {
+            farm_socket = argv[++i];
+        } else {
+            std::cerr << "UNKNOWN ARGUMENT: " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    // the coordinator has no window, it builds the chunk cache the workers
+    // map, hands out the work and writes the gathered frames
+    if (farm) {
+        if (offline_frames <= 0) {
+            std::cerr << "--farm NEEDS --frames" << std::endl;
+            return 1;
+        }
+        WorldConfig config;
+        load_world_config(world_path, config);
+        char name[48];
+        std::snprintf(name, sizeof(name), "grass_chunks_%016llx.cache",
+                      (unsigned long long)get_chunk_cache_key(config));
+        std::filesystem::path cache_path =
+            std::filesystem::temp_directory_path() / name;
+        if (!ChunkCache::write(cache_path, config)) {
+            return 1;
+        }
+
+        farm_settings.frame_count = offline_frames;
+        farm_settings.size = window_size;
+        farm_settings.directory = capture_directory;
+        farm_settings.format = capture_format;
+        farm_settings.executable = argv[0];
+        farm_settings.arguments = {"--headless", "--world",
+                                   world_path.string(), "--chunk-cache",
+                                   cache_path.string()};
+        if (visibility_path) {
+            farm_settings.arguments.push_back("--grass-path");
+            farm_settings.arguments.push_back("visibility");
+        }
+        if (!blade_storage.empty()) {
+            farm_settings.arguments.push_back("--blades");
+            farm_settings.arguments.push_back(blade_storage);
+        }
+        RenderFarm render_farm(farm_settings);
+        bool finished = render_farm.run();
+        std::error_code error;
+        std::filesystem::remove(cache_path, error);
+        return finished ? 0 : 1;
+    }
+
+    // a worker renders tiles of the coordinator's image at the tile size
+    std::unique_ptr<FarmWorker> farm_worker;
+    glm::ivec2 image_size = window_size;
+    if (!farm_socket.empty()) {
+        farm_worker = std::make_unique<FarmWorker>(farm_socket);
+        if (!farm_worker->is_connected()) {
+            return 1;
+        }
+        window_size = farm_worker->get_tile_size();
+        image_size = farm_worker->get_image_size();
+        headless = true;
+        // the pixels go back over the socket, nothing is written here
+        capture_directory = std::filesystem::temp_directory_path();
+    }
+    bool offline = offline_frames > 0 || farm_worker;
+    constexpr float OFFLINE_FRAME_TIME = 1.0f / 30.0f;
+    // frames a farm worker renders without capturing once no chunk is
+    // building anymore, so the blades have been generated
+    constexpr int FARM_SETTLE_FRAMES = 30;
+
     // init window
-    Window window(glm::ivec2(1920, 1080), "grass field");
+    Window window(window_size, "grass field", !headless);
     Renderer renderer;
     Camera camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::radians(45.0f),
-                  (float)window.get_size().x / (float)window.get_size().y, 0.1f,
-                  200.0f);
+                  (float)image_size.x / (float)image_size.y, 0.1f, 200.0f);
 
     Camera camera2(glm::vec3(100.0f, 200.0f, 100.0f), window.get_size() / 4,
                    0.1f, 400.0f);
@@ -103,16 +296,33 @@ int main() {
     std::shared_ptr<Input> input = std::make_shared<Input>();
     window.set_input_handler(input);
 
+    UploadService upload_service(window);
+
     // scene settings
     glm::vec3 light_direction(cos(glm::radians(135.0f)), -0.5f,
                               sin(glm::radians(135.0f)));
-    float wind_direction = 315.0f;
+    // committed config, the panel edits terrain and layout in a copy until
+    // a slider is released so dragging doesn't restart the rebuild
+    WorldConfig world_config;
+    load_world_config(world_path, world_config);
+    if (!blade_storage.empty()) {
+        world_config.procedural_blades = blade_storage == "procedural";
+    }
+    std::unique_ptr<ChunkCache> chunk_cache;
+    if (!chunk_cache_path.empty()) {
+        chunk_cache = std::make_unique<ChunkCache>(chunk_cache_path);
+        // the cache holds the cpu build of the ground
+        if (chunk_cache->is_valid()) {
+            world_config.gpu_terrain = false;
+        }
+    }
+    WorldConfig world_edit = world_config;
     glm::vec3 fog_color(0.9f, 0.9f, 0.9f);
     float fog_percent = 0.0f;
     float distance = 10.0f;
     float angle = 0.0f;
     float height = 34.0f;
-    bool auto_rotate = false;
+    bool auto_rotate = offline;
     bool show_debug_view = false;
 
     // meshes data
@@ -181,10 +391,35 @@ int main() {
     gpu_instancing_shader.load_shader_from_path(
         "resources/shaders/default_fragment.glsl", GL_FRAGMENT_SHADER);
 
+    // visibility buffer path, the same blade vertices but only ids come out
+    Shader grass_visibility_shader;
+    grass_visibility_shader.load_shader_from_path(
+        "resources/shaders/gpu_instancing.glsl", GL_VERTEX_SHADER);
+    grass_visibility_shader.load_shader_from_path(
+        "resources/shaders/visibility_fragment.glsl", GL_FRAGMENT_SHADER);
+
+    Shader grass_resolve_shader;
+    grass_resolve_shader.load_shader_from_path(
+        "resources/shaders/screen_vertex.glsl", GL_VERTEX_SHADER);
+    grass_resolve_shader.load_shader_from_path(
+        "resources/shaders/visibility_resolve.glsl", GL_FRAGMENT_SHADER);
+
     Shader grass_generation_shader;
     grass_generation_shader.load_shader_from_path(
         "resources/shaders/grass_generation.glsl", GL_COMPUTE_SHADER);
 
+    Shader grass_compaction_shader;
+    grass_compaction_shader.load_shader_from_path(
+        "resources/shaders/prefix_sum.glsl", GL_COMPUTE_SHADER);
+
+    Shader terrain_generation_shader;
+    terrain_generation_shader.load_shader_from_path(
+        "resources/shaders/terrain_generation.glsl", GL_COMPUTE_SHADER);
+
+    Shader instance_sort_shader;
+    instance_sort_shader.load_shader_from_path(
+        "resources/shaders/instance_sort.glsl", GL_COMPUTE_SHADER);
+
     Shader flow_field;
     flow_field.load_shader_from_path("resources/shaders/flow_field.glsl",
                                      GL_COMPUTE_SHADER);
@@ -193,6 +428,29 @@ int main() {
     displacement.load_shader_from_path("resources/shaders/displacement.glsl",
                                        GL_COMPUTE_SHADER);
 
+    Shader grass_bake_shader;
+    grass_bake_shader.load_shader_from_path("resources/shaders/grass_bake.glsl",
+                                            GL_COMPUTE_SHADER);
+
+    Shader terrain_depth_shader;
+    terrain_depth_shader.load_shader_from_path(
+        "resources/shaders/single_color_vertex.glsl", GL_VERTEX_SHADER);
+    terrain_depth_shader.load_shader_from_path(
+        "resources/shaders/shadow_fragment.glsl", GL_FRAGMENT_SHADER);
+
+    Shader grass_depth_shader;
+    grass_depth_shader.load_shader_from_path(
+        "resources/shaders/shadow_instancing.glsl", GL_VERTEX_SHADER);
+    grass_depth_shader.load_shader_from_path(
+        "resources/shaders/shadow_fragment.glsl", GL_FRAGMENT_SHADER);
+
+    // procedural blades only exist in gpu_instancing.glsl
+    Shader procedural_depth_shader;
+    procedural_depth_shader.load_shader_from_path(
+        "resources/shaders/gpu_instancing.glsl", GL_VERTEX_SHADER);
+    procedural_depth_shader.load_shader_from_path(
+        "resources/shaders/shadow_fragment.glsl", GL_FRAGMENT_SHADER);
+
     // shader settings
     default_shader.set_uniform_vector3("light_direction", light_direction);
     default_shader.set_uniform_vector3("fog_color", fog_color);
@@ -200,51 +458,138 @@ int main() {
     default_shader.set_uniform_float("view_distance",
                                      camera.get_far_clip_plane());
     default_shader.set_uniform_float("flog_bias", fog_percent);
+    default_shader.set_uniform_int("shadow_map", SHADOW_MAP_TEXTURE_UNIT);
+
+    // both blade paths light the same way
+    for (Shader* shader : {&gpu_instancing_shader, &grass_resolve_shader}) {
+        shader->set_uniform_vector3("light_direction", light_direction);
+        shader->set_uniform_vector3("fog_color", fog_color);
+        shader->set_uniform_float("bias", 0.6f);
+        shader->set_uniform_float("view_distance",
+                                  camera.get_far_clip_plane());
+        shader->set_uniform_int("shadow_map", SHADOW_MAP_TEXTURE_UNIT);
+    }
 
-    gpu_instancing_shader.set_uniform_vector3("light_direction",
-                                              light_direction);
-    gpu_instancing_shader.set_uniform_vector3("fog_color", fog_color);
-    gpu_instancing_shader.set_uniform_float("bias", 0.6f);
-    gpu_instancing_shader.set_uniform_float("view_distance",
-                                            camera.get_far_clip_plane());
-    gpu_instancing_shader.set_uniform_vector2(
-        "wind_direction", glm::vec2(cos(wind_direction), sin(wind_direction)));
+    // every program of gpu_instancing.glsl, the shadow pass sets the caster
+    // stride and scale itself and casters don't fade
+    for (Shader* shader : {&gpu_instancing_shader, &grass_visibility_shader,
+                           &procedural_depth_shader}) {
+        shader->set_uniform_int("height_map",
+                                PROCEDURAL_HEIGHT_MAP_TEXTURE_UNIT);
+        shader->set_uniform_int("noise_map", PROCEDURAL_NOISE_MAP_TEXTURE_UNIT);
+        shader->set_uniform_int("instance_stride", 1);
+        shader->set_uniform_float("caster_scale", 1.0f);
+    }
+    procedural_depth_shader.set_uniform_vector2("far_field_fade",
+                                                glm::vec2(1e30f, 2e30f));
 
-    flow_field.set_uniform_vector2(
-        "wind_direction", glm::vec2(cos(wind_direction), sin(wind_direction)));
+    // wind only changes uniforms, no chunk is touched
+    auto set_wind = [&](float wind_direction) {
+        glm::vec2 wind(cos(wind_direction), sin(wind_direction));
+        gpu_instancing_shader.set_uniform_vector2("wind_direction", wind);
+        grass_visibility_shader.set_uniform_vector2("wind_direction", wind);
+        grass_resolve_shader.set_uniform_vector2("wind_direction", wind);
+        grass_depth_shader.set_uniform_vector2("wind_direction", wind);
+        procedural_depth_shader.set_uniform_vector2("wind_direction", wind);
+        flow_field.set_uniform_vector2("wind_direction", wind);
+    };
+    set_wind(world_config.wind_direction);
 
     // init meshes
     Mesh grass_mesh = load_model("resources/models/grass_model.txt");
+    Mesh grass_caster_mesh =
+        load_model("resources/models/grass_model_low_poly.txt");
+    Mesh flower_mesh = load_model("resources/models/flower_model.txt");
+    Mesh shrub_mesh = load_model("resources/models/shrub_model.txt");
     Mesh screen_mesh;
     screen_mesh.set(screen_vertices, screen_indices);
 
     Mesh frustum_mesh;
     frustum_mesh.set(view_frustum_vertices, view_frustum_indices);
 
-    std::vector<std::shared_ptr<Chunk>> chunks;
-    for (int x = -8; x < 8; ++x) {
-        for (int y = -8; y < 8; ++y) {
-            std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>(
-                grass_mesh, grass_generation_shader, glm::ivec3(x, 0, y), 2, 32,
-                34.0f, 0.01f, 0u);
-            chunks.push_back(chunk);
+    // every chunk dispatch of a frame, flushed with one barrier per level
+    ComputeScheduler compute_scheduler;
+
+    // every species shares the instance buffers and the indirect draws
+    SpeciesSet species_set({
+        {"grass", &grass_mesh, &grass_caster_mesh, 0.85f, {1.0f, 4.0f}},
+        {"flower", &flower_mesh, nullptr, 0.1f, {0.8f, 1.6f}},
+        {"shrub", &shrub_mesh, nullptr, 0.05f, {0.6f, 1.2f}},
+    });
+    VegetationBatch vegetation(species_set);
+
+    // chunks are built on worker threads and stream in
+    World world(world_config, species_set, grass_generation_shader,
+                grass_compaction_shader, terrain_generation_shader,
+                compute_scheduler, upload_service, chunk_cache.get());
+    // procedural blades repeat the density masks of the generation
+    auto set_masks = [&]() {
+        for (Shader* shader : {&gpu_instancing_shader,
+                               &grass_visibility_shader,
+                               &procedural_depth_shader}) {
+            world.set_mask_uniforms(*shader);
         }
-    }
+    };
+    set_masks();
+    auto world_bounds = [](const WorldConfig& config) {
+        return glm::vec4(glm::vec2(config.chunk_min) * (float)config.chunk_size,
+                         glm::vec2(config.chunk_max - config.chunk_min) *
+                             (float)config.chunk_size);
+    };
+
+    // one push per chunk and frame, grown with the layout
+    ShaderBuffer<ChunkParameters> chunk_parameters;
+    size_t chunk_parameter_capacity = 0;
+
+    RenderQueue render_queue;
+
+    // blades only exist near the camera, the baked layer covers the rest
+    glm::vec4 far_field_bounds = world_bounds(world_config);
+    FarField far_field(grass_mesh, grass_bake_shader,
+                       glm::vec2(far_field_bounds.x, far_field_bounds.y),
+                       glm::ivec2(far_field_bounds.z, far_field_bounds.w));
+    float grass_distance = far_field.get_fade_end();
+
+    ShadowMap shadow_map(species_set, terrain_depth_shader,
+                         grass_depth_shader, procedural_depth_shader);
+    bool enable_shadows = true;
+    // blades drawn front to back, every other frame unsorted while counting
+    InstanceSort instance_sort(instance_sort_shader);
+    bool sort_blades = true;
+    bool count_blade_fragments = false;
+    bool enable_visibility_buffer = visibility_path;
     // textures
     std::shared_ptr<RenderTexture> screen_texture =
         std::make_shared<RenderTexture>(window.get_size(), GL_RGB);
-    screen_texture->set_filter_mode(GL_NEAREST);
+    screen_texture->set_filter_mode(GL_LINEAR);
     std::shared_ptr<RenderTexture> post_processing_texture =
         std::make_shared<RenderTexture>(window.get_size(), GL_RGB);
-    post_processing_texture->set_filter_mode(GL_NEAREST);
+    post_processing_texture->set_filter_mode(GL_LINEAR);
     screen_mesh.set_texture(post_processing_texture);
+    VisibilityBuffer visibility_buffer(species_set, window.get_size());
+    // averaged over the run for --frame-stats
+    double gpu_time_total = 0.0;
+    int gpu_time_frames = 0;
+    FrameCounts counter_totals;
+    // vertex, primitive and fragment counts where the driver has them
+    PipelineStatistics pipeline_statistics;
+
+    // the scene renders into the lower left corner of the targets at this scale
+    DynamicResolution dynamic_resolution(window.get_size(), 16.0f);
+    // tiles of a farm have to line up, so workers render at full scale
+    bool enable_dynamic_resolution = !farm_worker;
+    float frame_budget = dynamic_resolution.get_budget();
 
     // timer
     Timer fixed_timer;
-    Timer delta_timer;
-    float delta_time;
+    FramePacer frame_pacer;
+    PresentLatency present_latency;
+    bool enable_vsync = !offline;
+    int frame_limit = 0;
+    int swap_interval = 1;
+    float delta_time = 0.0f;
     float fps_update_interval = 0.5f;
-    float next_fps_update;
+    float next_fps_update = 0.0f;
     int fps = 60;
 
     // imgui
@@ -256,31 +601,320 @@ int main() {
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
     ImGui_ImplGlfw_InitForOpenGL(window.get_handler(), true);
     ImGui_ImplOpenGL3_Init("#version 430 core");
-    bool open_debug_window = true;
+    // creates the device objects and font atlas while the context is still
+    // current here, the ui itself is built on this thread from now on
+    ImGui_ImplOpenGL3_NewFrame();
+    bool open_debug_window = !farm_worker;
     ImGuiStyle& style = ImGui::GetStyle();
     style.Colors[ImGuiCol_WindowBg].w = 0.4f;
 
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // created on the render thread the first time a frame asks for it
+    std::unique_ptr<FrameCapture> frame_capture;
+
+    // render thread, consumes the packets built below one frame later
+    FramePipeline pipeline(window.get_handler(), [&](FramePacket& frame) {
+        pipeline_statistics.begin_frame();
+        upload_service.poll();
+        renderer.begin_frame();
+        compute_scheduler.begin_frame();
+
+        if (frame.swap_interval != swap_interval) {
+            swap_interval = frame.swap_interval;
+            window.set_swap_interval(swap_interval);
+        }
+        shadow_map.set_enabled(frame.shadows);
+        dynamic_resolution.set_enabled(frame.dynamic_resolution);
+        dynamic_resolution.set_budget(frame.frame_budget);
+        far_field.set_fade(frame.grass_distance * 0.6f, frame.grass_distance);
+        dynamic_resolution.begin_frame();
+        glm::ivec2 render_size = dynamic_resolution.get_viewport_size();
+
+        default_shader.set_uniform_float("fog_bias", frame.fog_percent);
+        gpu_instancing_shader.set_uniform_float("fog_bias", frame.fog_percent);
+        grass_resolve_shader.set_uniform_float("fog_bias", frame.fog_percent);
+
+        uint32_t world_changes = world.apply(frame.world_config);
+        if (world_changes & WORLD_WIND_CHANGED) {
+            set_wind(frame.world_config.wind_direction);
+        }
+        if (world_changes & (WORLD_DENSITY_CHANGED | WORLD_LAYOUT_CHANGED)) {
+            set_masks();
+        }
+        if (world.poll()) {
+            glm::vec4 bounds = world_bounds(world.get_config());
+            far_field.set_bounds(glm::vec2(bounds.x, bounds.y),
+                                 glm::ivec2(bounds.z, bounds.w));
+            shadow_map.invalidate();
+        } else if (world_changes & WORLD_DENSITY_CHANGED) {
+            far_field.invalidate();
+            shadow_map.invalidate();
+        }
+        // blades come back on their own once their chunk is drawn again
+        if (size_t overflow = MemoryTracker::get_overflow()) {
+            world.evict(overflow);
+        }
+
+        // the chunk list the visibility was computed for, a rebuild swapped
+        // in above shows up with the next packet
+        const std::vector<std::shared_ptr<Chunk>>& chunks = frame.world->chunks;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            chunks[i]->set_visibility(frame.visibility[i]);
+            if (!frame.visibility[i].cull) {
+                FrameCounters::add(FrameCounter::VisibleChunks);
+            }
+        }
+
+        // the wind batches push up to one more entry per chunk
+        if (chunks.size() * 2 > chunk_parameter_capacity) {
+            chunk_parameter_capacity = chunks.size() * 2;
+            chunk_parameters.create_ring(chunk_parameter_capacity);
+            chunk_parameters.set_label("chunk parameters");
+        }
+        chunk_parameters.begin_frame();
+        Chunk::update_wind(compute_scheduler, flow_field, chunk_parameters,
+                           chunks, frame.time);
+        for (std::shared_ptr<Chunk> chunk : chunks) {
+            chunk->update(displacement, chunk_parameters,
+                          glm::radians(world.get_config().wind_direction),
+                          frame.time);
+        }
+        const Camera& view_camera =
+            frame.show_debug_view ? frame.debug_camera : frame.camera;
+        instance_sort.set_enabled(frame.sort_blades);
+        instance_sort.set_counting(frame.count_blade_fragments);
+        instance_sort.update(chunks, view_camera.get_position(),
+                             frame.grass_distance);
+        // the far field reads the coverage images, the draws the blades and
+        // the ground meshes the terrain passes wrote
+        compute_scheduler.flush(GL_SHADER_STORAGE_BARRIER_BIT |
+                                GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                                GL_TEXTURE_FETCH_BARRIER_BIT |
+                                GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                                GL_ELEMENT_ARRAY_BARRIER_BIT);
+        chunk_parameters.end_frame();
+
+        // one view draws per frame
+        vegetation.end_frame();
+        vegetation.reserve(chunks.size());
+        vegetation.begin_frame();
+
+        far_field.update(chunks);
+        shadow_map.update(renderer, frame.camera, light_direction, chunks);
+
+        instance_sort.begin_draw({&gpu_instancing_shader,
+                                  &grass_visibility_shader,
+                                  &grass_resolve_shader});
+        // debug view
+        if (frame.show_debug_view) {
+            GlDebugGroup group("debug view");
+            screen_mesh.set_texture(screen_texture);
+            screen_texture->begin_draw();
+            glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glViewport(0, 0, render_size.x, render_size.y);
+            renderer.set_camera(frame.debug_camera);
+
+            far_field.apply(default_shader, true, false);
+            far_field.apply(gpu_instancing_shader, false, false);
+            default_shader.set_uniform_int("disable_fog", 1);
+            gpu_instancing_shader.set_uniform_int("disable_fog", 1);
+            render_queue.set_view(frame.debug_camera);
+            for (std::shared_ptr<Chunk> chunk : chunks) {
+                chunk->submit(render_queue, vegetation, default_shader);
+            }
+            vegetation.submit(render_queue, RenderPass::Opaque,
+                              gpu_instancing_shader,
+                              frame.debug_camera.get_position());
+            render_queue.submit(RenderPass::Debug, frustum_mesh, single_color,
+                                frame.camera.get_transform(),
+                                frame.camera.get_position(), GL_LINES);
+            render_queue.flush();
+            // procedural blades bind their maps, the queue can't sort them
+            vegetation.draw(gpu_instancing_shader);
+            screen_texture->end_draw();
+            glViewport(0, 0, window.get_size().x, window.get_size().y);
+        } else {
+
+            // scene view
+            GlDebugGroup group("scene view");
+            screen_mesh.set_texture(post_processing_texture);
+            post_processing_texture->begin_draw();
+            glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glViewport(0, 0, render_size.x, render_size.y);
+            Camera scene_camera = frame.camera;
+            scene_camera.crop(glm::vec2(frame.crop.x, frame.crop.y),
+                              glm::vec2(frame.crop.z, frame.crop.w));
+            renderer.set_camera(scene_camera);
+
+            far_field.apply(default_shader, true);
+            default_shader.set_uniform_int("disable_fog", 0);
+            for (Shader* shader : {&gpu_instancing_shader,
+                                   &grass_visibility_shader,
+                                   &grass_resolve_shader}) {
+                far_field.apply(*shader, false);
+                shader->set_uniform_int("disable_fog", 0);
+            }
+            render_queue.set_view(frame.camera);
+            render_queue.begin_overdraw();
+            for (std::shared_ptr<Chunk> chunk : chunks) {
+                chunk->submit(render_queue, vegetation, default_shader);
+            }
+            // the blades go last when they are shaded from the ids
+            if (!frame.visibility_buffer) {
+                vegetation.submit(render_queue, RenderPass::Opaque,
+                                  gpu_instancing_shader,
+                                  frame.camera.get_position());
+            }
+            render_queue.flush();
+            if (!frame.visibility_buffer) {
+                vegetation.draw(gpu_instancing_shader);
+            }
+            if (frame.visibility_buffer) {
+                visibility_buffer.draw(*post_processing_texture, render_size,
+                                       scene_camera, vegetation,
+                                       grass_visibility_shader,
+                                       grass_resolve_shader);
+            }
+            render_queue.end_overdraw();
+            post_processing_texture->end_draw();
+            glViewport(0, 0, window.get_size().x, window.get_size().y);
+        }
+        instance_sort.end_draw();
+        gl_debug_push_group("post processing");
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        post_processing.set_uniform_vector2("uv_scale",
+                                            dynamic_resolution.get_uv_scale());
+        renderer.draw(screen_mesh, glm::mat4(1.0f), post_processing);
+        gl_debug_pop_group();
+        dynamic_resolution.end_frame();
+        pipeline_statistics.end_frame();
+
+        // read back before the ui is drawn on top
+        if (frame.capture) {
+            if (!frame_capture) {
+                frame_capture = std::make_unique<FrameCapture>(
+                    window.get_size(), capture_directory, capture_format,
+                    offline);
+                if (farm_worker) {
+                    frame_capture->set_sink(
+                        [&](uint64_t, const uint8_t* pixels,
+                            const glm::ivec2&) {
+                            farm_worker->send_result(pixels);
+                        });
+                }
+            }
+            frame_capture->capture();
+        }
+
+        if (ImDrawData* draw_data = frame.ui.get()) {
+            GlDebugGroup group("ui");
+            ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+        }
+        renderer.end_frame();
+        window.display();
+        present_latency.record(frame.input_time);
+
+        RenderStatistics statistics;
+        statistics.frame = frame.frame;
+        statistics.shadow_time = shadow_map.get_gpu_time();
+        statistics.shadow_refreshes = shadow_map.get_terrain_refreshes();
+        statistics.render_scale = dynamic_resolution.get_scale();
+        statistics.render_size = render_size;
+        statistics.gpu_time = dynamic_resolution.get_gpu_time();
+        gpu_time_total += statistics.gpu_time;
+        gpu_time_frames++;
+        statistics.latency = present_latency.get_latency();
+        statistics.world_pending = world.get_pending_count();
+        if (frame_capture) {
+            statistics.captured_frames = frame_capture->get_written_count();
+            statistics.dropped_frames = frame_capture->get_dropped_count();
+        }
+        statistics.queue = render_queue.get_statistics();
+        statistics.compute = compute_scheduler.get_statistics();
+        statistics.sort = instance_sort.get_statistics();
+        statistics.counters = FrameCounters::take();
+        pipeline_statistics.read(statistics.counters);
+        for (int i = 0; i < FRAME_COUNTER_COUNT; ++i) {
+            counter_totals.counters[i] += statistics.counters.counters[i];
+        }
+        pipeline.publish(statistics);
+    });
+
+    // simulation thread, builds frame N + 1 while frame N is being submitted
+    uint64_t frame_index = 0;
+    FarmTask farm_task;
+    int farm_settle = FARM_SETTLE_FRAMES;
     while (window.is_open()) {
         window.poll_events();
         if (input->is_key_down(GLFW_KEY_ESCAPE)) {
             window.close();
         }
 
-        ImGui_ImplOpenGL3_NewFrame();
+        // the scene time and camera follow this frame number, so any process
+        // renders a frame the same way
+        uint64_t scene_frame = frame_index;
+        glm::vec4 crop(-1.0f, -1.0f, 1.0f, 1.0f);
+        bool farm_capture = false;
+        if (farm_worker) {
+            if (farm_settle > 0) {
+                farm_settle = pipeline.get_statistics().world_pending > 0
+                                  ? FARM_SETTLE_FRAMES
+                                  : farm_settle - 1;
+            } else {
+                if (farm_task.frame_count == 0 &&
+                    !farm_worker->next_task(farm_task)) {
+                    window.close();
+                    break;
+                }
+                scene_frame = farm_task.first_frame++;
+                farm_task.frame_count--;
+                farm_worker->queue_frame(scene_frame, farm_task.tile);
+                farm_capture = true;
+                angle = fmod(scene_frame * 10.0f * OFFLINE_FRAME_TIME, 360.0f);
+                glm::vec2 tile_min = glm::vec2(farm_task.tile.x,
+                                               farm_task.tile.y);
+                glm::vec2 tile_max =
+                    tile_min + glm::vec2(farm_task.tile.z, farm_task.tile.w);
+                crop = glm::vec4(tile_min / glm::vec2(image_size),
+                                 tile_max / glm::vec2(image_size)) *
+                           2.0f -
+                       1.0f;
+            }
+        }
+
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        camera.set_position(glm::vec3(0.0f, height, 0.0f) +
-                            glm::vec3(cos(glm::radians(angle)), 0.0f,
-                                      sin(glm::radians(angle))) *
-                                distance);
+        FramePacket packet;
+        packet.world = world.get_snapshot();
+        const HeightfieldStore& terrain = packet.world->terrain;
+        const std::vector<std::shared_ptr<Chunk>>& chunks =
+            packet.world->chunks;
+
+        glm::vec3 camera_position =
+            glm::vec3(0.0f, height, 0.0f) +
+            glm::vec3(cos(glm::radians(angle)), 0.0f,
+                      sin(glm::radians(angle))) *
+                distance;
+        // keep the camera above the ground
+        camera_position.y =
+            fmax(camera_position.y,
+                 terrain.height_at(camera_position.x, camera_position.z) +
+                     1.0f);
+        camera.set_position(camera_position);
         camera.look_at(glm::vec3(0.0f, height, 0.0f));
         camera2.look_at(glm::vec3(0.0f, 0.0f, 0.0f));
 
-        for (std::shared_ptr<Chunk> chunk : chunks) {
-            chunk->frustum_test(camera);
+        packet.frame = frame_index++;
+        packet.input_time = input->get_first_event_time();
+        packet.visibility.resize(chunks.size());
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            packet.visibility[i] =
+                chunks[i]->test_visibility(camera, grass_distance);
         }
 
         angle += auto_rotate * 10.0f * delta_time;
@@ -288,32 +922,185 @@ int main() {
             angle = angle - 360.0f;
         }
 
-        default_shader.set_uniform_float("fog_bias", fog_percent);
-        gpu_instancing_shader.set_uniform_float("fog_bias", fog_percent);
-
         if (open_debug_window) {
             if (fixed_timer.get_time() > next_fps_update) {
                 next_fps_update = fixed_timer.get_time() + fps_update_interval;
-                fps = 1.0f / delta_time;
+                fps = 1.0f / fmax(frame_pacer.get_raw_delta_time(), 1e-4);
             }
+            RenderStatistics statistics = pipeline.get_statistics();
 
             ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
             ImGui::SetNextWindowSize(ImVec2(532.0f, window.get_size().y));
             ImGui::Begin("debug", &open_debug_window,
                          ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize);
-            ImGui::Text("grass count: %d", Chunk::grass_count);
-            ImGui::Text("FPS: %d", fps);
+            ImGui::Text("grass count: %d", Chunk::grass_count.load());
+            ImGui::Text("chunk build allocations: %d",
+                        Chunk::build_allocations.load());
+            ImGui::Text("FPS: %d, jitter: %.2f ms, latency: %.1f ms", fps,
+                        frame_pacer.get_jitter(), statistics.latency);
+            ImGui::Checkbox("vsync", &enable_vsync);
+            ImGui::SliderInt("frame limit (0 = off)", &frame_limit, 0, 240);
+
+            // terrain under the cursor
+            glm::vec2 cursor = window.get_mouse_position_normalized();
+            glm::mat4 inverse_camera = glm::inverse(camera.get_matrix());
+            glm::vec4 near_point =
+                inverse_camera * glm::vec4(cursor, -1.0f, 1.0f);
+            glm::vec4 far_point = inverse_camera * glm::vec4(cursor, 1.0f, 1.0f);
+            glm::vec3 ray_origin = glm::vec3(near_point) / near_point.w;
+            glm::vec3 ray_direction =
+                glm::normalize(glm::vec3(far_point) / far_point.w - ray_origin);
+            RayHit hit;
+            if (terrain.raycast(ray_origin, ray_direction,
+                                camera.get_far_clip_plane(), hit)) {
+                ImGui::Text("cursor: %.1f %.1f %.1f", hit.position.x,
+                            hit.position.y, hit.position.z);
+            } else {
+                ImGui::Text("cursor: -");
+            }
             ImGui::SliderFloat("angle", &angle, 0.0f, 360.0f);
             ImGui::SliderFloat("distance", &distance, 5.0f, 32.0f * 8.0f);
             ImGui::SliderFloat("height", &height, 0.0f, 60.0f);
             ImGui::Checkbox("auto rotate", &auto_rotate);
-            if (ImGui::Checkbox("show debug view", &show_debug_view)) {
-                if (show_debug_view) {
-                    screen_mesh.set_texture(screen_texture);
-                } else {
-                    screen_mesh.set_texture(post_processing_texture);
+            ImGui::SliderFloat("grass distance", &grass_distance, 16.0f,
+                               200.0f);
+            ImGui::Checkbox("shadows", &enable_shadows);
+            ImGui::Text("shadows: %.2f ms, %d cascades refreshed",
+                        statistics.shadow_time, statistics.shadow_refreshes);
+            ImGui::Checkbox("dynamic resolution", &enable_dynamic_resolution);
+            ImGui::SliderFloat("frame budget (ms)", &frame_budget, 4.0f, 50.0f);
+            ImGui::Text("render scale: %.2f (%dx%d), gpu: %.2f ms",
+                        statistics.render_scale, statistics.render_size.x,
+                        statistics.render_size.y, statistics.gpu_time);
+            ImGui::Text("draws: %d, programs: %d, meshes: %d",
+                        statistics.queue.draw_count,
+                        statistics.queue.program_changes,
+                        statistics.queue.mesh_changes);
+            ImGui::Text("compute passes: %d, levels: %d, barriers: %d",
+                        statistics.compute.passes, statistics.compute.levels,
+                        statistics.compute.barriers);
+#ifndef NDEBUG
+            ImGui::Text("overdraw: %.2f", statistics.queue.overdraw);
+#endif
+            ImGui::Checkbox("visibility buffer", &enable_visibility_buffer);
+            ImGui::Checkbox("sort blades", &sort_blades);
+            ImGui::Text("blade sorts: %d", statistics.sort.sorted_chunks);
+            ImGui::Checkbox("count blade fragments", &count_blade_fragments);
+            if (count_blade_fragments &&
+                statistics.sort.unsorted_fragments > 0) {
+                ImGui::Text("blade fragments: %u sorted, %u unsorted, %.0f%% "
+                            "saved",
+                            statistics.sort.sorted_fragments,
+                            statistics.sort.unsorted_fragments,
+                            100.0f - 100.0f * statistics.sort.sorted_fragments /
+                                         statistics.sort.unsorted_fragments);
+            }
+            if (ImGui::TreeNode("frame counters")) {
+                for (int i = 0; i < FRAME_COUNTER_COUNT; ++i) {
+                    ImGui::Text("%s: %lld",
+                                get_frame_counter_name((FrameCounter)i),
+                                (long long)statistics.counters.counters[i]);
+                }
+                for (int i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+                    int64_t count = statistics.counters.pipeline[i];
+                    if (count < 0) {
+                        ImGui::Text("%s: -",
+                                    get_pipeline_counter_name(
+                                        (PipelineCounter)i));
+                    } else {
+                        ImGui::Text("%s: %lld",
+                                    get_pipeline_counter_name(
+                                        (PipelineCounter)i),
+                                    (long long)count);
+                    }
+                }
+                ImGui::TreePop();
+            }
+            MemoryStatistics memory = MemoryTracker::get_statistics();
+            if (ImGui::TreeNode("gpu memory")) {
+                for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+                    ImGui::Text("%s: %.1f mb",
+                                get_memory_category_name((MemoryCategory)i),
+                                memory.bytes[i] / (1024.0f * 1024.0f));
                 }
+                ImGui::Text("peak: %.1f mb, evictions: %d",
+                            memory.peak / (1024.0f * 1024.0f),
+                            memory.evictions);
+                ImGui::TreePop();
             }
+            ImGui::Text("gpu memory: %.1f / %.0f mb",
+                        memory.total / (1024.0f * 1024.0f),
+                        memory.budget / (1024.0f * 1024.0f));
+            ImGui::Text("render thread lag: %d frames",
+                        (int)(packet.frame - statistics.frame));
+            ImGui::Checkbox("capture", &enable_capture);
+            ImGui::Text("captured: %d, dropped: %d",
+                        statistics.captured_frames, statistics.dropped_frames);
+            ImGui::Checkbox("show debug view", &show_debug_view);
+
+            // world, terrain and layout apply once the widget is released
+            ImGui::SeparatorText("world");
+            bool commit = false;
+            int radius = world_edit.chunk_max.x;
+            if (ImGui::SliderInt("chunk radius", &radius, 1, 16)) {
+                world_edit.chunk_min = glm::ivec2(-radius);
+                world_edit.chunk_max = glm::ivec2(radius);
+            }
+            commit |= ImGui::IsItemDeactivatedAfterEdit();
+            int size_index = world_edit.chunk_size == 16   ? 0
+                             : world_edit.chunk_size == 64 ? 2
+                                                           : 1;
+            if (ImGui::Combo("chunk size", &size_index,
+                             "16\0"
+                             "32\0"
+                             "64\0")) {
+                world_edit.chunk_size = 16 << size_index;
+                commit = true;
+            }
+            ImGui::SliderFloat("terrain height", &world_edit.terrain_height,
+                               0.0f, 100.0f);
+            commit |= ImGui::IsItemDeactivatedAfterEdit();
+            ImGui::SliderFloat("terrain scale", &world_edit.terrain_scale,
+                               0.001f, 0.05f, "%.3f");
+            commit |= ImGui::IsItemDeactivatedAfterEdit();
+            int seed = (int)world_edit.seed;
+            if (ImGui::InputInt("seed", &seed)) {
+                world_edit.seed = (uint64_t)std::max(seed, 0);
+                commit = true;
+            }
+            commit |= ImGui::Checkbox("gpu terrain", &world_edit.gpu_terrain);
+            commit |= ImGui::Checkbox("validate terrain",
+                                      &world_edit.validate_terrain);
+            // the masks regenerate every chunk
+            ImGui::DragFloatRange2("slope fade", &world_edit.slope_fade.x,
+                                   &world_edit.slope_fade.y, 0.5f, 0.0f,
+                                   90.0f, "%.1f");
+            commit |= ImGui::IsItemDeactivatedAfterEdit();
+            ImGui::DragFloatRange2("altitude", &world_edit.altitude_range.x,
+                                   &world_edit.altitude_range.y, 0.005f, 0.0f,
+                                   1.0f, "%.3f");
+            commit |= ImGui::IsItemDeactivatedAfterEdit();
+            world_edit.slope_fade.y = std::max(world_edit.slope_fade.y,
+                                               world_edit.slope_fade.x + 0.1f);
+            if (commit) {
+                world_config = world_edit;
+            }
+            if (ImGui::SliderInt("grass per unit", &world_edit.grass_per_unit,
+                                 1, 4)) {
+                world_config.grass_per_unit = world_edit.grass_per_unit;
+            }
+            if (ImGui::Checkbox("procedural blades",
+                                &world_edit.procedural_blades)) {
+                world_config.procedural_blades = world_edit.procedural_blades;
+            }
+            if (ImGui::SliderFloat("wind direction", &world_edit.wind_direction,
+                                   0.0f, 360.0f)) {
+                world_config.wind_direction = world_edit.wind_direction;
+            }
+            if (ImGui::Button("save world")) {
+                save_world_config(world_path, world_config);
+            }
+            ImGui::Text("chunks rebuilding: %d", statistics.world_pending);
             // if (show_debug_view) {
             //     ImTextureID scene = screen_texture.get_id();
             //     ImGui::Text("debug view");
@@ -324,66 +1111,83 @@ int main() {
             // }
             ImGui::End();
         }
+        ImGui::Render();
 
-        for (std::shared_ptr<Chunk> chunk : chunks) {
-            chunk->update(flow_field, displacement,
-                          glm::radians(wind_direction),
-                          fixed_timer.get_time() * 6.0f);
-        }
-
-        // debug view
-        if (show_debug_view) {
-            screen_texture->begin_draw();
-            glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glViewport(0, 0, screen_texture->get_size().x,
-                       screen_texture->get_size().y);
-            renderer.set_camera(camera2);
+        packet.camera = camera;
+        packet.debug_camera = camera2;
+        packet.show_debug_view = show_debug_view;
+        packet.crop = crop;
+        packet.time = offline ? scene_frame * OFFLINE_FRAME_TIME * 6.0f
+                              : fixed_timer.get_time() * 6.0f;
+        packet.fog_percent = fog_percent;
+        packet.grass_distance = grass_distance;
+        packet.shadows = enable_shadows;
+        packet.sort_blades = sort_blades;
+        packet.count_blade_fragments = count_blade_fragments;
+        // procedural blades have no instances to resolve, the sort skips
+        // them per chunk
+        packet.visibility_buffer =
+            enable_visibility_buffer && !world_config.procedural_blades;
+        packet.dynamic_resolution = enable_dynamic_resolution;
+        packet.frame_budget = frame_budget;
+        packet.swap_interval = enable_vsync ? 1 : 0;
+        packet.capture = farm_worker ? farm_capture : enable_capture;
+        packet.world_config = world_config;
+        packet.ui.capture(ImGui::GetDrawData());
+        pipeline.submit(std::move(packet));
 
-            default_shader.set_uniform_int("disable_fog", 1);
-            default_shader.set_uniform_vector3("camera_position",
-                                               camera.get_position());
-            gpu_instancing_shader.set_uniform_int("disable_fog", 1);
-            gpu_instancing_shader.set_uniform_vector3("camera_position",
-                                                      camera.get_position());
-            for (std::shared_ptr<Chunk> chunk : chunks) {
-                chunk->render(renderer, default_shader, gpu_instancing_shader,
-                              true);
+        if (offline) {
+            delta_time = OFFLINE_FRAME_TIME;
+            if (!farm_worker && frame_index >= (uint64_t)offline_frames) {
+                window.close();
             }
-            glDisable(GL_CULL_FACE);
-            renderer.draw(frustum_mesh, camera.get_transform(), single_color,
-                          GL_LINES);
-            glEnable(GL_CULL_FACE);
-            screen_texture->end_draw();
-            glViewport(0, 0, window.get_size().x, window.get_size().y);
         } else {
+            frame_pacer.set_target_fps(frame_limit);
+            delta_time = frame_pacer.wait();
+        }
+    }
+    pipeline.stop();
+    // writes out whatever is still in flight
+    frame_capture.reset();
 
-            // scene view
-            post_processing_texture->begin_draw();
-            glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            renderer.set_camera(camera);
+    if (!memory_statistics_path.empty()) {
+        MemoryTracker::write_statistics(memory_statistics_path);
+    }
 
-            default_shader.set_uniform_int("disable_fog", 0);
-            default_shader.set_uniform_vector3("camera_position",
-                                               camera.get_position());
-            gpu_instancing_shader.set_uniform_int("disable_fog", 0);
-            gpu_instancing_shader.set_uniform_vector3("camera_position",
-                                                      camera.get_position());
-            for (std::shared_ptr<Chunk> chunk : chunks) {
-                chunk->render(renderer, default_shader, gpu_instancing_shader);
+    if (!frame_statistics_path.empty()) {
+        std::ofstream file(frame_statistics_path);
+        if (file.is_open()) {
+            // procedural blades always take the forward path
+            bool procedural = world_config.procedural_blades;
+            bool visibility = enable_visibility_buffer && !procedural;
+            file << "{\n";
+            file << "  \"grass_path\": \""
+                 << (visibility ? "visibility" : "forward") << "\",\n";
+            file << "  \"blade_storage\": \""
+                 << (procedural ? "procedural" : "instanced") << "\",\n";
+            file << "  \"frames\": " << gpu_time_frames << ",\n";
+            file << "  \"average_gpu_time\": "
+                 << gpu_time_total / std::max(gpu_time_frames, 1) << ",\n";
+            // per frame, the pipeline counts are -1 without the extension
+            for (int i = 0; i < FRAME_COUNTER_COUNT; ++i) {
+                file << "  \"" << get_frame_counter_name((FrameCounter)i)
+                     << "\": "
+                     << (double)counter_totals.counters[i] /
+                            std::max(gpu_time_frames, 1)
+                     << ",\n";
             }
-            post_processing_texture->end_draw();
+            for (int i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+                PipelineCounter counter = (PipelineCounter)i;
+                file << "  \"" << get_pipeline_counter_name(counter)
+                     << "\": "
+                     << pipeline_statistics.get_average(counter)
+                     << (i + 1 < PIPELINE_COUNTER_COUNT ? ",\n" : "\n");
+            }
+            file << "}\n";
+        } else {
+            std::cerr << "FAILED TO OPEN FRAME STATISTICS: "
+                      << frame_statistics_path << std::endl;
         }
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        renderer.draw(screen_mesh, glm::mat4(1.0f), post_processing);
-
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        window.display();
-
-        delta_time = delta_timer.reset();
     }
 
     ImGui_ImplOpenGL3_Shutdown();
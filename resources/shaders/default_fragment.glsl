@@ -1,4 +1,8 @@
 #version 430 core
+// nothing here discards or writes depth, and the fragment counter below must
+// only see fragments that survive the depth test
+layout(early_fragment_tests) in;
+
 out vec4 FragColor;
 
 in vec3 color;
@@ -6,34 +10,104 @@ in vec3 normal;
 in vec3 world_frag_position;
 in vec2 uv;
 
+layout(std430, binding = 1) readonly buffer FrameConstants {
+    mat4 projection;
+    vec4 camera_position;
+};
+
+layout(std430, binding = 3) readonly buffer ShadowConstants {
+    mat4 light_matrices[4];
+    vec4 cascade_splits;
+    vec4 view_position;
+    vec4 view_direction;
+    // x: enabled, y: depth bias, z: texel size
+    vec4 shadow_parameters;
+};
+
+// shaded fragments of the blade draws, counted while comparing the sort
+layout(std430, binding = 6) buffer FragmentCounter {
+    uint shaded_fragments;
+};
+uniform int count_fragments;
+
 uniform int has_texture;
 uniform sampler2D diffuse_texture;
 
-uniform vec3 camera_position;
 uniform vec3 light_direction;
 uniform float bias;
 uniform float view_distance;
 uniform float fog_bias;
 uniform vec3 fog_color;
 uniform int disable_fog;
+uniform sampler2DArrayShadow shadow_map;
+
+// far-field grass layer, r: blade height / 4, g: density
+uniform sampler2D far_field;
+uniform int far_field_layer;
+uniform vec4 far_field_bounds;
+uniform vec2 far_field_fade;
+uniform vec3 grass_color;
+
+float light_visibility()
+{
+    if (shadow_parameters.x == 0.0) {
+        return 1.0;
+    }
+
+    float depth = dot(world_frag_position - view_position.xyz, view_direction.xyz);
+    int cascade = 0;
+    while (cascade < 3 && depth > cascade_splits[cascade]) {
+        cascade++;
+    }
+    if (depth > cascade_splits[3]) {
+        return 1.0;
+    }
+
+    vec4 light_position = light_matrices[cascade] * vec4(world_frag_position, 1.0);
+    vec3 coord = light_position.xyz / light_position.w * 0.5 + 0.5;
+    float reference = coord.z - shadow_parameters.y;
+
+    // 3x3 taps on top of the hardware 2x2 comparison filter
+    float visibility = 0.0;
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            vec2 offset = vec2(x, y) * shadow_parameters.z;
+            visibility += texture(shadow_map, vec4(coord.xy + offset, cascade, reference));
+        }
+    }
+    return visibility / 9.0;
+}
 
 void main()
 {
+    if (count_fragments != 0) {
+        atomicAdd(shaded_fragments, 1u);
+    }
+
     vec3 texture_color = color;
     if (has_texture > 0) {
         texture_color *= vec3(texture(diffuse_texture, uv));
     }
+
+    // the layer takes over where the real blades have shrunk away
+    if (far_field_layer > 0) {
+        vec2 field_uv = (world_frag_position.xz - far_field_bounds.xy) * far_field_bounds.zw;
+        vec2 field = texture(far_field, field_uv).rg;
+        float distance = length(camera_position.xyz - world_frag_position);
+        float fade = smoothstep(far_field_fade.x, far_field_fade.y, distance);
+        vec3 layer_color = grass_color * mix(0.6, 1.0, field.r);
+        texture_color = mix(texture_color, layer_color, field.g * fade);
+    }
     
-    float diffuse = max(-dot(normal, normalize(light_direction)), bias);
+    float diffuse = max(-dot(normal, normalize(light_direction)) * light_visibility(), bias);
     texture_color *= diffuse;
     
     float conceal = 0.0;
 
     if (disable_fog == 0) {
-        float distance = length(camera_position - world_frag_position);
+        float distance = length(camera_position.xyz - world_frag_position);
         float d = max(distance - view_distance * fog_bias, 0.0);
         float exp = d / (view_distance * (1.0 - fog_bias));
-        float value = pow(4.0, exp);
         conceal = clamp(exp * exp, 0.0, 1.0);
     }
 
@@ -9,7 +9,11 @@ out vec3 normal;
 out vec3 world_frag_position;
 out vec2 uv;
 
-uniform mat4 projection;
+layout(std430, binding = 1) readonly buffer FrameConstants {
+    mat4 projection;
+    vec4 camera_position;
+};
+
 uniform mat4 transform;
 
 void main()
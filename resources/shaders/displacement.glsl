@@ -1,5 +1,5 @@
 #version 430 core
-layout(local_size_x = 1, local_size_y = 1) in;
+layout(local_size_x = 64) in;
 
 struct GrassBuffer {
     mat4 transform;
@@ -10,15 +10,28 @@ layout(std430, binding = 0) buffer BufferData {
     GrassBuffer grass_buffer[];
 };
 
-uniform int width;
-uniform int height;
-uniform sampler2D noise_map;
+struct ChunkParameters {
+    vec2 offset;
+    float shift;
+    int size;
+    int grass_count;
+    int layer;
+    int first_instance;
+    int padding;
+};
+
+layout(std430, binding = 2) readonly buffer ChunkData {
+    ChunkParameters chunk;
+};
+
+uniform sampler2DArray noise_map;
 
 void main() {
-    uvec2 id = gl_GlobalInvocationID.xy;
-    if (id.x < width && id.y < height) {
-        uint index = id.y * uint(width) + id.x;
-        vec2 uv = vec2(grass_buffer[index].sway[3][0], grass_buffer[index].sway[3][1]);
+    // blades are compacted, one invocation per surviving blade of the chunk's
+    // run of the instance buffer
+    if (gl_GlobalInvocationID.x < uint(chunk.grass_count)) {
+        uint index = uint(chunk.first_instance) + gl_GlobalInvocationID.x;
+        vec3 uv = vec3(grass_buffer[index].sway[3][0], grass_buffer[index].sway[3][1], chunk.layer);
         grass_buffer[index].sway[0][1] = grass_buffer[index].sway[0][0] * (texture(noise_map, uv).r - 0.5);
         grass_buffer[index].sway[1][1] = texture(noise_map, uv).r;
     }
@@ -1,11 +1,24 @@
 #version 430 core
 
-layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-layout(rgba32f, binding = 0) uniform image2D image_output;
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+// every noise map layer of one array, a work group row per chunk
+layout(r16f, binding = 0) uniform writeonly image2DArray image_output;
+
+struct ChunkParameters {
+    vec2 offset;
+    float shift;
+    int size;
+    int grass_count;
+    int layer;
+    int first_instance;
+    int padding;
+};
+
+layout(std430, binding = 2) readonly buffer ChunkData {
+    ChunkParameters chunks[];
+};
 
-uniform float shift;
 uniform vec2 wind_direction;
-uniform vec2 offset;
 
 float hash(float p) { 
     p = fract(p * 0.011); 
@@ -33,18 +46,22 @@ float noise(vec2 x) {
 }
 
 void main() {
+    ChunkParameters chunk = chunks[gl_WorkGroupID.z];
     ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
+    if (texel_coord.x >= chunk.size || texel_coord.y >= chunk.size) {
+        return;
+    }
     float theta = 0.25;
     float c = wind_direction.x;
     float s = wind_direction.y;
-    vec2 position = vec2(texel_coord) + offset;
+    vec2 position = vec2(texel_coord) + chunk.offset;
 	float x = c * position.x + s * position.y;
 	float y = -s * position.x + c * position.y;
 
-    float h = sin(x * 0.03 + shift) * 0.2 + 0.3;
-    h += noise(((position * 0.1) + wind_direction * shift)) * 0.125 - 0.0625;
-    h += noise(((position * 0.06) + wind_direction * shift)) * 0.3 - 0.15;
+    float h = sin(x * 0.03 + chunk.shift) * 0.2 + 0.3;
+    h += noise(((position * 0.1) + wind_direction * chunk.shift)) * 0.125 - 0.0625;
+    h += noise(((position * 0.06) + wind_direction * chunk.shift)) * 0.3 - 0.15;
     h = clamp(h, 0.0, 1.0);
 	
-    imageStore(image_output, texel_coord, vec4(h, h, h, 1.0));
+    imageStore(image_output, ivec3(texel_coord, chunk.layer), vec4(h));
 }
\ No newline at end of file
@@ -3,6 +3,8 @@ layout (location = 0) in vec3 a_position;
 layout (location = 1) in vec2 a_uv;
 layout (location = 2) in vec3 a_normal;
 layout (location = 3) in vec3 a_color;
+// base instance of the draw command + gl_InstanceID
+layout (location = 4) in uint a_instance;
 
 struct GrassBuffer {
     mat4 transform;
@@ -13,26 +15,202 @@ layout(std430, binding = 0) buffer BufferData {
     GrassBuffer grass_buffer[];
 };
 
+// procedural draws bind their entries in place of the instances, the base
+// instance of a command picks its entry
+struct ProceduralBlades {
+    // xyz and the cell spacing
+    vec4 lower_bound;
+    // xyz and the terrain height
+    vec4 upper_bound;
+    int width;
+    int height_layer;
+    int noise_layer;
+    int species;
+};
+
+layout(std430, binding = 0) readonly buffer ProceduralData {
+    ProceduralBlades procedural_blades[];
+};
+
+// front to back order of the instances, written by instance_sort.glsl
+layout(std430, binding = 5) readonly buffer InstanceOrder {
+    uint instance_order[];
+};
+
+struct Species {
+    float threshold;
+    float min_height;
+    float max_height;
+    int first_index;
+};
+
+layout(std430, binding = 4) readonly buffer SpeciesData {
+    Species species[];
+};
+
 out vec3 color;
 out vec3 normal;
 out vec3 world_frag_position;
 out vec2 uv;
+// read by visibility_fragment.glsl
+flat out uint instance_index;
+
+layout(std430, binding = 1) readonly buffer FrameConstants {
+    mat4 projection;
+    vec4 camera_position;
+};
 
-uniform mat4 projection;
 uniform float offset;
 uniform vec2 wind_direction;
+uniform vec2 far_field_fade;
+uniform int sorted_instances;
+// the blades are recomputed from their cells instead of read
+uniform int procedural;
+// procedural shadow casters take every instance_stride-th cell, widened
+uniform int instance_stride;
+uniform float caster_scale;
+
+// the inputs of grass_generation.glsl
+uniform sampler2DArray height_map;
+uniform sampler2DArray noise_map;
+uniform sampler2D density_map;
+uniform vec4 density_map_bounds;
+uniform vec2 slope_fade;
+uniform vec2 altitude_range;
+
+float random(vec2 seed) {
+    return fract(sin(dot(seed.xy, vec2(12.9898,78.233))) * 43758.5453123);
+}
+
+float random_range(vec2 seed, float low, float high) {
+    return low + random(seed) * (high - low);
+}
+
+float sample_height(vec2 uv, int layer) {
+    return texture(height_map, vec3(uv, layer)).r;
+}
+
+mat4 translate(vec3 t) {
+    return mat4(
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        t.x, t.y, t.z, 1.0
+    );
+}
+
+mat4 scale(vec3 s) {
+    return mat4(
+        s.x, 0.0, 0.0, 0.0,
+        0.0, s.y, 0.0, 0.0,
+        0.0, 0.0, s.z, 0.0,
+        0.0, 0.0, 0.0, 1.0
+    );
+}
+
+mat4 rotation_y(float r) {
+    float c = cos(r);
+    float s = sin(r);
+    return mat4(
+        c  , 0.0, -s , 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        s  , 0.0, c  , 0.0,
+        0.0, 0.0, 0.0, 1.0
+    );
+}
+
+// grass_generation.glsl and displacement.glsl for one cell, false when the
+// cell grew nothing or another species than the draw's
+bool procedural_blade(uint cell, out mat4 transform, out float blade_height,
+                      out float sway) {
+    ProceduralBlades blades = procedural_blades[a_instance - uint(gl_InstanceID)];
+    uvec2 id = uvec2(cell % uint(blades.width), cell / uint(blades.width));
+    vec3 lower_bound = blades.lower_bound.xyz;
+    vec3 upper_bound = blades.upper_bound.xyz;
+    float spacing = blades.lower_bound.w;
+
+    vec2 seed = vec2(id) + vec2(lower_bound.xz);
+    vec3 position = lower_bound + vec3(id.x, 0.0, id.y) * spacing;
+    position.x += random_range(seed, 0.0, spacing);
+    position.z += random_range(seed + vec2(1.0), 0.0, spacing);
+    vec2 blade_uv = clamp((position.xz - lower_bound.xz) /
+                          (upper_bound.xz - lower_bound.xz), 0.0, 1.0);
+
+    int kind = species.length() - 1;
+    float pick = random(seed + vec2(5.0, 11.0));
+    for (int i = 0; i < species.length(); ++i) {
+        if (pick < species[i].threshold) {
+            kind = i;
+            break;
+        }
+    }
+    if (kind != blades.species) {
+        return false;
+    }
+    blade_height = random_range(seed, species[kind].min_height,
+                                species[kind].max_height);
+
+    vec2 texel = 1.0 / vec2(textureSize(height_map, 0).xy);
+    vec2 height_uv = blade_uv * (1.0 - texel) + 0.5 * texel;
+    int layer = blades.height_layer;
+    float altitude = sample_height(height_uv, layer);
+    position.y = altitude * blades.upper_bound.w;
+
+    float density = texture(density_map, (position.xz - density_map_bounds.xy) *
+                                             density_map_bounds.zw).r;
+    vec2 gradient = vec2(sample_height(height_uv + vec2(texel.x, 0.0), layer) -
+                         sample_height(height_uv - vec2(texel.x, 0.0), layer),
+                         sample_height(height_uv + vec2(0.0, texel.y), layer) -
+                         sample_height(height_uv - vec2(0.0, texel.y), layer)) *
+                    blades.upper_bound.w * 0.5;
+    float slope = degrees(atan(length(gradient)));
+    density *= 1.0 - smoothstep(slope_fade.x, slope_fade.y, slope);
+    density *= step(altitude_range.x, altitude) * step(altitude, altitude_range.y);
+    if (random(seed + vec2(7.0, 3.0)) >= density) {
+        return false;
+    }
+
+    transform = translate(position) *
+                rotation_y(random_range(seed, 0.0, 3.14159 * 2.0)) *
+                scale(vec3(1.0, blade_height, 1.0));
+    sway = texture(noise_map, vec3(blade_uv, blades.noise_layer)).r - 0.5;
+    return true;
+}
 
 void main()
 {
-    float offset = grass_buffer[gl_InstanceID].sway[0][1] * 2.0 - 1.0;
+    mat4 transform;
+    float blade_height;
+    float sway;
+    uint index = 0u;
+    if (procedural != 0) {
+        uint cell = uint(gl_InstanceID * instance_stride);
+        if (!procedural_blade(cell, transform, blade_height, sway)) {
+            // every vertex lands on the same point outside the view
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+            return;
+        }
+    } else {
+        index = sorted_instances != 0 ? instance_order[a_instance] : a_instance;
+        transform = grass_buffer[index].transform;
+        blade_height = grass_buffer[index].sway[3][2];
+        sway = grass_buffer[index].sway[0][1];
+    }
+
+    float offset = sway * 2.0 - 1.0;
     vec4 vector_offset = vec4(wind_direction.x, 0.0f, wind_direction.y, 0.0f) * offset;
-    vec4 world_position = grass_buffer[gl_InstanceID].transform * vec4(a_position, 1.0f);
-    world_position += vector_offset * (pow(2.0, a_position.y) - 1.0);
+    // blades shrink into the far-field layer with distance
+    vec3 base = vec3(transform[3]);
+    float fade = 1.0 - smoothstep(far_field_fade.x, far_field_fade.y, length(camera_position.xyz - base));
+    vec3 position = vec3(a_position.x * caster_scale, a_position.y * fade, a_position.z * caster_scale);
+    vec4 world_position = transform * vec4(position, 1.0f);
+    world_position += vector_offset * (pow(2.0, position.y) - 1.0);
     world_frag_position = world_position.xyz;
     gl_Position = projection *  world_position;
-    normal = normalize(mat3(transpose(inverse(grass_buffer[gl_InstanceID].transform))) * a_normal);
-    color = a_color * min(grass_buffer[gl_InstanceID].sway[3][2] * a_position.y, 1.0);
-    // color = vec3(grass_buffer[gl_InstanceID].sway[1][1]);
-    // color = vec3(grass_buffer[gl_InstanceID].sway[3][0], grass_buffer[gl_InstanceID].sway[3][1], 0.0);
+    normal = normalize(mat3(transpose(inverse(transform))) * a_normal);
+    color = a_color * min(blade_height * a_position.y, 1.0);
+    // color = vec3(grass_buffer[index].sway[1][1]);
+    // color = vec3(grass_buffer[index].sway[3][0], grass_buffer[index].sway[3][1], 0.0);
     uv = a_uv;
-}
\ No newline at end of file
+    instance_index = index;
+}
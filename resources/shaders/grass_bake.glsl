@@ -0,0 +1,34 @@
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba8, binding = 0) uniform writeonly image2D far_field;
+// blade height / 4 per generation cell, 0 where the masks removed the blade
+layout(r8, binding = 1) uniform readonly image2D coverage;
+
+uniform int blades_per_texel;
+uniform vec2 texel_offset;
+uniform vec2 texel_count;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= int(texel_count.x) || texel.y >= int(texel_count.y)) {
+        return;
+    }
+
+    // average height of the blades in the unit square this texel covers
+    float height = 0.0;
+    float count = 0.0;
+    for (int y = 0; y < blades_per_texel; ++y) {
+        for (int x = 0; x < blades_per_texel; ++x) {
+            ivec2 blade = texel * blades_per_texel + ivec2(x, y);
+            float blade_height = imageLoad(coverage, blade).r * 4.0;
+            if (blade_height > 0.0) {
+                height += blade_height;
+                count += 1.0;
+            }
+        }
+    }
+
+    float density = count / float(blades_per_texel * blades_per_texel);
+    height = count > 0.0 ? height / count : 0.0;
+    imageStore(far_field, ivec2(texel_offset) + texel, vec4(height / 4.0, density, 0.0, 1.0));
+}
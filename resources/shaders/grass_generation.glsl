@@ -1,6 +1,6 @@
 #version 430 core
 
-layout(local_size_x = 1, local_size_y = 1) in;
+layout(local_size_x = 8, local_size_y = 8) in;
 
 struct GrassBuffer {
     mat4 transform;
@@ -11,13 +11,56 @@ layout(std430, binding = 0) buffer BufferData {
     GrassBuffer grass_buffer[];
 };
 
+// one entry per species and cell plus the total. the count pass writes 0 or
+// 1, the scan turns that into each surviving plant's slot in the chunk's run
+// of the instance buffer, species after species
+layout(std430, binding = 1) buffer OffsetData {
+    uint offsets[];
+};
+
+// threshold is the upper end of the species' slice of [0, 1)
+struct Species {
+    float threshold;
+    float min_height;
+    float max_height;
+    int first_index;
+};
+
+layout(std430, binding = 4) readonly buffer SpeciesData {
+    Species species[];
+};
+
+// identity draw order of the run, until the chunk is first sorted
+layout(std430, binding = 5) writeonly buffer InstanceOrder {
+    uint instance_order[];
+};
+
+// blade height / 4 per cell, 0 where no blade survived. read by the far field
+layout(r8, binding = 0) uniform writeonly image2D coverage;
+
 uniform int width;
 uniform int height;
 uniform vec3 lower_bound;
 uniform vec3 upper_bound;
 uniform float spacing;
-uniform sampler2D height_map;
+uniform sampler2DArray height_map;
+uniform int height_layer;
 uniform float terrain_scale;
+uniform bool write_instances;
+uniform int species_count;
+uniform int first_instance;
+
+// density masks: painted map over the world bounds (origin, 1 / size), blades
+// fade out between two slopes in degrees and only grow inside a band of the
+// normalized terrain height
+uniform sampler2D density_map;
+uniform vec4 density_map_bounds;
+uniform vec2 slope_fade;
+uniform vec2 altitude_range;
+
+float sample_height(vec2 uv) {
+    return texture(height_map, vec3(uv, height_layer)).r;
+}
 
 float random(vec2 seed) {
     return fract(sin(dot(seed.xy, vec2(12.9898,78.233))) * 43758.5453123);
@@ -69,32 +112,79 @@ mat4 rotation_y(float r) {
 
 void main() {
     uvec2 id = gl_GlobalInvocationID.xy;
+    if (id.x >= width || id.y >= height) {
+        return;
+    }
+
     vec3 uniform_position = lower_bound + vec3(id.x, 0.0, id.y) * spacing;
     vec2 seed = vec2(id) + vec2(lower_bound.xz);
-    if (id.x < width && id.y < height) {
-        int index = int(id.y) * width + int(id.x);
-
-        vec3 offset;
-        offset.x = random_range(seed, 0.0, spacing);
-        offset.z = random_range(seed + vec2(1.0), 0.0, spacing);
-
-        vec3 position = uniform_position + offset;
-        mat4 rotation = rotation_y(random_range(seed, 0.0, 3.14159 * 2.0));
-
-        vec2 uv = vec2((position.x - lower_bound.x) / (upper_bound.x - lower_bound.x),
-                       (position.z - lower_bound.z) / (upper_bound.z - lower_bound.z));
-
-        uv.x = clamp(uv.x, 0.0, 1.0);
-        uv.y = clamp(uv.y, 0.0, 1.0);
-        float height = random_range(seed, 1.0, 4.0);
-
-        position.y = texture(height_map, uv).r * terrain_scale;
-        grass_buffer[index].transform = translate(position) * 
-                                        rotation *
-                                        scale(vec3(1.0, height, 1.0));
-        grass_buffer[index].sway[0][0] = 1.0;
-        grass_buffer[index].sway[3][0] = uv.x;
-        grass_buffer[index].sway[3][1] = uv.y;
-        grass_buffer[index].sway[3][2] = height;
+    int index = int(id.y) * width + int(id.x);
+
+    vec3 offset;
+    offset.x = random_range(seed, 0.0, spacing);
+    offset.z = random_range(seed + vec2(1.0), 0.0, spacing);
+
+    vec3 position = uniform_position + offset;
+
+    vec2 uv = vec2((position.x - lower_bound.x) / (upper_bound.x - lower_bound.x),
+                   (position.z - lower_bound.z) / (upper_bound.z - lower_bound.z));
+
+    uv.x = clamp(uv.x, 0.0, 1.0);
+    uv.y = clamp(uv.y, 0.0, 1.0);
+
+    int kind = species_count - 1;
+    float pick = random(seed + vec2(5.0, 11.0));
+    for (int i = 0; i < species_count; ++i) {
+        if (pick < species[i].threshold) {
+            kind = i;
+            break;
+        }
+    }
+    float blade_height = random_range(seed, species[kind].min_height,
+                                      species[kind].max_height);
+
+    // samples sit on the texel centres of the (size + 1)^2 height map, one
+    // unit apart
+    vec2 texel = 1.0 / vec2(textureSize(height_map, 0).xy);
+    vec2 height_uv = uv * (1.0 - texel) + 0.5 * texel;
+    float altitude = sample_height(height_uv);
+    position.y = altitude * terrain_scale;
+
+    float density = texture(density_map, (position.xz - density_map_bounds.xy) *
+                                             density_map_bounds.zw).r;
+    vec2 gradient = vec2(sample_height(height_uv + vec2(texel.x, 0.0)) -
+                         sample_height(height_uv - vec2(texel.x, 0.0)),
+                         sample_height(height_uv + vec2(0.0, texel.y)) -
+                         sample_height(height_uv - vec2(0.0, texel.y))) *
+                    terrain_scale * 0.5;
+    float slope = degrees(atan(length(gradient)));
+    density *= 1.0 - smoothstep(slope_fade.x, slope_fade.y, slope);
+    density *= step(altitude_range.x, altitude) * step(altitude, altitude_range.y);
+    bool keep = random(seed + vec2(7.0, 3.0)) < density;
+
+    int cell_count = width * height;
+    if (!write_instances) {
+        for (int i = 0; i < species_count; ++i) {
+            offsets[i * cell_count + index] = keep && i == kind ? 1u : 0u;
+        }
+        imageStore(coverage, ivec2(id), vec4(keep ? blade_height / 4.0 : 0.0));
+        return;
     }
+    if (!keep) {
+        return;
+    }
+
+    uint slot = uint(first_instance) + offsets[kind * cell_count + index];
+    instance_order[slot] = slot;
+    mat4 rotation = rotation_y(random_range(seed, 0.0, 3.14159 * 2.0));
+    grass_buffer[slot].transform = translate(position) *
+                                   rotation *
+                                   scale(vec3(1.0, blade_height, 1.0));
+    grass_buffer[slot].sway = mat4(0.0);
+    grass_buffer[slot].sway[0][0] = 1.0;
+    grass_buffer[slot].sway[3][0] = uv.x;
+    grass_buffer[slot].sway[3][1] = uv.y;
+    grass_buffer[slot].sway[3][2] = blade_height;
+    // the visibility buffer resolve finds the mesh through the species
+    grass_buffer[slot].sway[2][0] = float(kind);
 }
\ No newline at end of file
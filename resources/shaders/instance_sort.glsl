@@ -0,0 +1,63 @@
+#version 430 core
+layout(local_size_x = 64) in;
+
+// coarse front to back order of the instances of a chunk. the count pass
+// counts the instances per species and distance bucket, prefix_sum.glsl
+// turns the counts into offsets and the scatter pass writes every instance
+// index to its slot. keys are species major, so each species keeps the run
+// of the chunk it was generated into
+
+struct GrassBuffer {
+    mat4 transform;
+    mat4 sway;
+};
+
+layout(std430, binding = 0) readonly buffer BufferData {
+    GrassBuffer grass_buffer[];
+};
+
+// species_count * bucket_count counts, their total and then the first
+// instance of every species
+layout(std430, binding = 1) buffer BucketData {
+    uint buckets[];
+};
+
+layout(std430, binding = 5) writeonly buffer InstanceOrder {
+    uint instance_order[];
+};
+
+uniform int instance_count;
+uniform int first_instance;
+uniform int species_count;
+uniform int bucket_count;
+uniform int scatter;
+uniform vec3 eye;
+uniform float sort_range;
+
+uint get_key(uint index) {
+    uint species_first = uint(species_count * bucket_count) + 1u;
+    uint species = 0u;
+    while (species + 1u < uint(species_count) &&
+           index >= buckets[species_first + species + 1u]) {
+        species++;
+    }
+
+    // everything past the sort range shares the last bucket
+    vec3 base = vec3(grass_buffer[first_instance + index].transform[3]);
+    float distance = clamp(length(base - eye) / sort_range, 0.0, 1.0);
+    uint bucket = uint(distance * float(bucket_count - 1));
+    return species * uint(bucket_count) + bucket;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(instance_count)) {
+        return;
+    }
+
+    uint key = get_key(index);
+    uint slot = atomicAdd(buckets[key], 1u);
+    if (scatter != 0) {
+        instance_order[first_instance + slot] = uint(first_instance) + index;
+    }
+}
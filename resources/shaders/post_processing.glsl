@@ -4,8 +4,45 @@ out vec4 FragColor;
 in vec2 uv;
 
 uniform sampler2D diffuse_texture;
+// part of the target the scene was rendered into
+uniform vec2 uv_scale;
+
+// catmull-rom upscale from nine bilinear taps, the rendered region is clamped
+// so nothing outside the viewport bleeds in
+vec4 sample_catmull_rom(vec2 position)
+{
+    vec2 texture_size = vec2(textureSize(diffuse_texture, 0));
+    vec2 lower = 0.5 / texture_size;
+    vec2 upper = uv_scale - 0.5 / texture_size;
+
+    vec2 sample_position = position * texture_size;
+    vec2 texel_position = floor(sample_position - 0.5) + 0.5;
+    vec2 f = sample_position - texel_position;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+
+    vec2 p0 = clamp((texel_position - 1.0) / texture_size, lower, upper);
+    vec2 p12 = clamp((texel_position + w2 / w12) / texture_size, lower, upper);
+    vec2 p3 = clamp((texel_position + 2.0) / texture_size, lower, upper);
+
+    vec4 result = vec4(0.0);
+    result += texture(diffuse_texture, vec2(p0.x, p0.y)) * w0.x * w0.y;
+    result += texture(diffuse_texture, vec2(p12.x, p0.y)) * w12.x * w0.y;
+    result += texture(diffuse_texture, vec2(p3.x, p0.y)) * w3.x * w0.y;
+    result += texture(diffuse_texture, vec2(p0.x, p12.y)) * w0.x * w12.y;
+    result += texture(diffuse_texture, vec2(p12.x, p12.y)) * w12.x * w12.y;
+    result += texture(diffuse_texture, vec2(p3.x, p12.y)) * w3.x * w12.y;
+    result += texture(diffuse_texture, vec2(p0.x, p3.y)) * w0.x * w3.y;
+    result += texture(diffuse_texture, vec2(p12.x, p3.y)) * w12.x * w3.y;
+    result += texture(diffuse_texture, vec2(p3.x, p3.y)) * w3.x * w3.y;
+    return max(result, vec4(0.0));
+}
 
 void main()
 {
-    FragColor = texture(diffuse_texture, uv);
-}
\ No newline at end of file
+    FragColor = sample_catmull_rom(uv * uv_scale);
+}
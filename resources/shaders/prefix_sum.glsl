@@ -0,0 +1,46 @@
+#version 430 core
+layout(local_size_x = 512) in;
+
+// in place exclusive scan of count values by a single work group, the total
+// is written to values[count]. every invocation sums a contiguous run, the
+// run totals are scanned in shared memory and each run is then rewritten
+layout(std430, binding = 1) buffer ValueData {
+    uint values[];
+};
+
+uniform int count;
+
+shared uint partial[512];
+
+void main() {
+    uint thread = gl_LocalInvocationID.x;
+    uint run = (uint(count) + 511u) / 512u;
+    uint begin = min(thread * run, uint(count));
+    uint end = min(begin + run, uint(count));
+
+    uint sum = 0u;
+    for (uint i = begin; i < end; ++i) {
+        sum += values[i];
+    }
+    partial[thread] = sum;
+    barrier();
+
+    // inclusive Hillis-Steele scan of the run totals
+    for (uint stride = 1u; stride < 512u; stride *= 2u) {
+        uint value = thread >= stride ? partial[thread - stride] : 0u;
+        barrier();
+        partial[thread] += value;
+        barrier();
+    }
+
+    uint running = thread > 0u ? partial[thread - 1u] : 0u;
+    for (uint i = begin; i < end; ++i) {
+        uint value = values[i];
+        values[i] = running;
+        running += value;
+    }
+
+    if (thread == 511u) {
+        values[count] = partial[511];
+    }
+}
\ No newline at end of file
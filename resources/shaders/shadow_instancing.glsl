@@ -0,0 +1,34 @@
+#version 430 core
+layout (location = 0) in vec3 a_position;
+// base instance of the draw command + gl_InstanceID
+layout (location = 4) in uint a_instance;
+
+struct GrassBuffer {
+    mat4 transform;
+    mat4 sway;
+};
+
+layout(std430, binding = 0) buffer BufferData {
+    GrassBuffer grass_buffer[];
+};
+
+layout(std430, binding = 1) readonly buffer FrameConstants {
+    mat4 projection;
+    vec4 camera_position;
+};
+
+uniform vec2 wind_direction;
+uniform int instance_stride;
+uniform float caster_scale;
+
+void main()
+{
+    uint first = a_instance - uint(gl_InstanceID);
+    uint index = first + uint(gl_InstanceID * instance_stride);
+    float offset = grass_buffer[index].sway[0][1] * 2.0 - 1.0;
+    vec4 vector_offset = vec4(wind_direction.x, 0.0f, wind_direction.y, 0.0f) * offset;
+    vec3 position = vec3(a_position.x * caster_scale, a_position.y, a_position.z * caster_scale);
+    vec4 world_position = grass_buffer[index].transform * vec4(position, 1.0f);
+    world_position += vector_offset * (pow(2.0, a_position.y) - 1.0);
+    gl_Position = projection * world_position;
+}
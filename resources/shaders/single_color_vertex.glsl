@@ -7,7 +7,11 @@ layout (location = 3) in vec3 a_color;
 
 out vec3 color;
 
-uniform mat4 projection;
+layout(std430, binding = 1) readonly buffer FrameConstants {
+    mat4 projection;
+    vec4 camera_position;
+};
+
 uniform mat4 transform;
 
 void main()
@@ -0,0 +1,189 @@
+#version 430 core
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// port of the ground built by Chunk::build. the noise is siv::PerlinNoise in
+// single precision, so heights match the cpu build to a small fraction of the
+// terrain height. the first pass writes the height map layer and the full
+// ground mesh, the second copies every fourth vertex into the low poly one
+
+// laid out as Vertex in mesh.hpp
+struct GroundVertex {
+    float position[3];
+    float uv[2];
+    float normal[3];
+    float color[3];
+};
+
+layout(std430, binding = 0) buffer VertexData {
+    GroundVertex vertices[];
+};
+
+layout(std430, binding = 1) writeonly buffer IndexData {
+    int indices[];
+};
+
+// the 256 entries of siv::PerlinNoise::serialize for the seed
+layout(std430, binding = 2) readonly buffer PermutationData {
+    uint permutation[];
+};
+
+// the full ground mesh, read by the low poly pass
+layout(std430, binding = 3) readonly buffer SourceData {
+    GroundVertex source[];
+};
+
+layout(r16, binding = 0) uniform writeonly image2DArray height_map;
+
+uniform int size;
+uniform bool low_poly;
+uniform vec2 origin;
+uniform float terrain_height;
+uniform float terrain_scale;
+uniform int height_layer;
+
+// samples of the work group plus a one unit border for the normals
+shared float samples[10][10];
+
+float fade(float t) {
+    return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+float grad(uint hash, float x, float y, float z) {
+    uint h = hash & 15u;
+    float u = h < 8u ? x : y;
+    float v = h < 4u ? y : (h == 12u || h == 14u ? x : z);
+    return ((h & 1u) == 0u ? u : -u) + ((h & 2u) == 0u ? v : -v);
+}
+
+uint perm(int i) {
+    return permutation[i & 255];
+}
+
+// noise3D at the fixed z siv::PerlinNoise uses for noise2D
+float noise(vec2 p) {
+    const float z = 0.34567;
+    vec2 f = floor(p);
+    int ix = int(f.x) & 255;
+    int iy = int(f.y) & 255;
+    float fx = p.x - f.x;
+    float fy = p.y - f.y;
+
+    float u = fade(fx);
+    float v = fade(fy);
+    float w = fade(z);
+
+    int a = int(perm(ix) + uint(iy)) & 255;
+    int b = int(perm(ix + 1) + uint(iy)) & 255;
+    int aa = int(perm(a)) & 255;
+    int ab = int(perm(a + 1)) & 255;
+    int ba = int(perm(b)) & 255;
+    int bb = int(perm(b + 1)) & 255;
+
+    float p0 = grad(perm(aa), fx, fy, z);
+    float p1 = grad(perm(ba), fx - 1.0, fy, z);
+    float p2 = grad(perm(ab), fx, fy - 1.0, z);
+    float p3 = grad(perm(bb), fx - 1.0, fy - 1.0, z);
+    float p4 = grad(perm(aa + 1), fx, fy, z - 1.0);
+    float p5 = grad(perm(ba + 1), fx - 1.0, fy, z - 1.0);
+    float p6 = grad(perm(ab + 1), fx, fy - 1.0, z - 1.0);
+    float p7 = grad(perm(bb + 1), fx - 1.0, fy - 1.0, z - 1.0);
+
+    float q0 = mix(p0, p1, u);
+    float q1 = mix(p2, p3, u);
+    float q2 = mix(p4, p5, u);
+    float q3 = mix(p6, p7, u);
+    return mix(mix(q0, q1, v), mix(q2, q3, v), w);
+}
+
+// octave2D_01 with 14 octaves and a persistence of 0.5
+float octave_01(vec2 p) {
+    float result = 0.0;
+    float amplitude = 1.0;
+    for (int i = 0; i < 14; ++i) {
+        result += noise(p) * amplitude;
+        p *= 2.0;
+        amplitude *= 0.5;
+    }
+    return clamp(result * 0.5 + 0.5, 0.0, 1.0);
+}
+
+float sample_height(ivec2 cell) {
+    return samples[cell.x - int(gl_WorkGroupID.x) * 8 + 1]
+                  [cell.y - int(gl_WorkGroupID.y) * 8 + 1];
+}
+
+void build_low_poly() {
+    int low_size = size / 4;
+    int low_s = low_size + 1;
+    int x = int(gl_GlobalInvocationID.x);
+    int z = int(gl_GlobalInvocationID.y);
+    if (x > low_size || z > low_size) {
+        return;
+    }
+
+    // same vertex order and winding as Chunk::build
+    int s = size + 1;
+    vertices[x * low_s + z] = source[x * 4 + s * z * 4];
+    if (x < low_size && z < low_size) {
+        int index = (x * low_size + z) * 6;
+        indices[index + 0] = x + low_s * (z + 1);
+        indices[index + 1] = (x + 1) + low_s * z;
+        indices[index + 2] = x + low_s * z;
+        indices[index + 3] = x + low_s * (z + 1);
+        indices[index + 4] = (x + 1) + low_s * (z + 1);
+        indices[index + 5] = (x + 1) + low_s * z;
+    }
+}
+
+void main() {
+    if (low_poly) {
+        build_low_poly();
+        return;
+    }
+
+    // every invocation takes part in filling the samples before any returns
+    ivec2 corner = ivec2(gl_WorkGroupID.xy) * 8 - 1;
+    for (uint i = gl_LocalInvocationIndex; i < 100u; i += 64u) {
+        ivec2 cell = corner + ivec2(i % 10u, i / 10u);
+        vec2 position = (origin + vec2(cell)) * terrain_scale;
+        samples[i % 10u][i / 10u] = octave_01(position) * terrain_height;
+    }
+    barrier();
+
+    int s = size + 1;
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    int x = cell.x;
+    int z = cell.y;
+    if (x > size || z > size) {
+        return;
+    }
+
+    float height = sample_height(cell);
+    float h0 = sample_height(cell + ivec2(1, 0)) -
+               sample_height(cell - ivec2(1, 0));
+    float h1 = sample_height(cell + ivec2(0, 1)) -
+               sample_height(cell - ivec2(0, 1));
+    vec3 normal = normalize(vec3(-h0, -h1, -1.0));
+
+    GroundVertex vertex;
+    vertex.position = float[3](origin.x + float(x), height,
+                               origin.y + float(z));
+    vertex.uv = float[2](0.0, 0.0);
+    vertex.normal = float[3](normal.x, normal.y, normal.z);
+    vertex.color = float[3](0.06, 0.12, 0.0);
+    vertices[x * s + z] = vertex;
+
+    if (x < size && z < size) {
+        int index = (x * size + z) * 6;
+        indices[index + 0] = x + s * z;
+        indices[index + 1] = (x + 1) + s * z;
+        indices[index + 2] = x + s * (z + 1);
+        indices[index + 3] = (x + 1) + s * z;
+        indices[index + 4] = (x + 1) + s * (z + 1);
+        indices[index + 5] = x + s * (z + 1);
+    }
+
+    imageStore(height_map, ivec3(x, z, height_layer),
+               vec4(clamp(height / terrain_height, 0.0, 1.0)));
+}
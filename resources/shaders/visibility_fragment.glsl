@@ -0,0 +1,15 @@
+#version 430 core
+// ids of the front most blade triangle per pixel, shaded later by
+// visibility_resolve.glsl. x: instance + 1, 0 where no blade was drawn,
+// y: batch in the top 8 bits, triangle of the species mesh below
+layout(location = 0) out uvec2 visibility;
+
+flat in uint instance_index;
+
+uniform int batch_index;
+
+void main()
+{
+    visibility = uvec2(instance_index + 1u,
+                       uint(batch_index) << 24 | uint(gl_PrimitiveID));
+}
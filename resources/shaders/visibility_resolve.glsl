@@ -0,0 +1,183 @@
+#version 430 core
+// shades every pixel of the visibility buffer that belongs to one instance
+// buffer once. the triangle is fetched again, run through the same blade
+// transform as gpu_instancing.glsl and interpolated at the pixel
+out vec4 FragColor;
+
+in vec2 uv;
+
+struct GrassBuffer {
+    mat4 transform;
+    mat4 sway;
+};
+
+layout(std430, binding = 0) readonly buffer BufferData {
+    GrassBuffer grass_buffer[];
+};
+
+layout(std430, binding = 1) readonly buffer FrameConstants {
+    mat4 projection;
+    vec4 camera_position;
+};
+
+layout(std430, binding = 3) readonly buffer ShadowConstants {
+    mat4 light_matrices[4];
+    vec4 cascade_splits;
+    vec4 view_position;
+    vec4 view_direction;
+    // x: enabled, y: depth bias, z: texel size
+    vec4 shadow_parameters;
+};
+
+struct Species {
+    float threshold;
+    float min_height;
+    float max_height;
+    int first_index;
+};
+
+layout(std430, binding = 4) readonly buffer SpeciesData {
+    Species species[];
+};
+
+// the merged species mesh, a vertex is position, uv, normal and color
+layout(std430, binding = 7) readonly buffer VertexData {
+    float vertices[];
+};
+
+layout(std430, binding = 8) readonly buffer IndexData {
+    uint indices[];
+};
+
+// shaded blade pixels, counted while comparing the instance sort
+layout(std430, binding = 6) buffer FragmentCounter {
+    uint shaded_fragments;
+};
+uniform int count_fragments;
+
+uniform usampler2D visibility_ids;
+uniform sampler2D visibility_depth;
+uniform int batch_index;
+uniform mat4 inverse_projection;
+uniform vec2 viewport_size;
+
+uniform vec2 wind_direction;
+uniform vec2 far_field_fade;
+
+uniform vec3 light_direction;
+uniform float bias;
+uniform float view_distance;
+uniform float fog_bias;
+uniform vec3 fog_color;
+uniform int disable_fog;
+uniform sampler2DArrayShadow shadow_map;
+
+const int VERTEX_SIZE = 11;
+
+vec3 read_vector(uint vertex, int offset)
+{
+    uint i = vertex * uint(VERTEX_SIZE) + uint(offset);
+    return vec3(vertices[i], vertices[i + 1u], vertices[i + 2u]);
+}
+
+float light_visibility(vec3 world_position)
+{
+    if (shadow_parameters.x == 0.0) {
+        return 1.0;
+    }
+
+    float depth = dot(world_position - view_position.xyz, view_direction.xyz);
+    int cascade = 0;
+    while (cascade < 3 && depth > cascade_splits[cascade]) {
+        cascade++;
+    }
+    if (depth > cascade_splits[3]) {
+        return 1.0;
+    }
+
+    vec4 light_position = light_matrices[cascade] * vec4(world_position, 1.0);
+    vec3 coord = light_position.xyz / light_position.w * 0.5 + 0.5;
+    float reference = coord.z - shadow_parameters.y;
+
+    float visibility = 0.0;
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            vec2 offset = vec2(x, y) * shadow_parameters.z;
+            visibility += texture(shadow_map, vec4(coord.xy + offset, cascade, reference));
+        }
+    }
+    return visibility / 9.0;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uvec2 id = texelFetch(visibility_ids, pixel, 0).rg;
+    if (id.x == 0u || (id.y >> 24) != uint(batch_index)) {
+        discard;
+    }
+    if (count_fragments != 0) {
+        atomicAdd(shaded_fragments, 1u);
+    }
+    uint index = id.x - 1u;
+    uint primitive = id.y & 0xffffffu;
+    float depth = texelFetch(visibility_depth, pixel, 0).r;
+    gl_FragDepth = depth;
+
+    // same as the vertex stage of the forward path
+    GrassBuffer grass = grass_buffer[index];
+    float offset = grass.sway[0][1] * 2.0 - 1.0;
+    vec3 vector_offset = vec3(wind_direction.x, 0.0, wind_direction.y) * offset;
+    vec3 base = vec3(grass.transform[3]);
+    float fade = 1.0 - smoothstep(far_field_fade.x, far_field_fade.y, length(camera_position.xyz - base));
+    mat3 normal_matrix = mat3(transpose(inverse(grass.transform)));
+
+    uint first = uint(species[int(grass.sway[2][0])].first_index) + primitive * 3u;
+    vec3 corners[3];
+    vec3 normals[3];
+    vec3 colors[3];
+    for (int i = 0; i < 3; ++i) {
+        uint vertex = indices[first + uint(i)];
+        vec3 position = read_vector(vertex, 0);
+        position.y *= fade;
+        vec4 world_position = grass.transform * vec4(position, 1.0);
+        corners[i] = world_position.xyz + vector_offset * (pow(2.0, position.y) - 1.0);
+        normals[i] = normalize(normal_matrix * read_vector(vertex, 5));
+        colors[i] = read_vector(vertex, 8) * min(grass.sway[3][2] * position.y, 1.0);
+    }
+
+    // the pixel back in world space, weighted by the corners it lies between
+    vec4 ndc = vec4(gl_FragCoord.xy / viewport_size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverse_projection * ndc;
+    vec3 world_position = world.xyz / world.w;
+
+    vec3 e0 = corners[1] - corners[0];
+    vec3 e1 = corners[2] - corners[0];
+    vec3 e2 = world_position - corners[0];
+    float d00 = dot(e0, e0);
+    float d01 = dot(e0, e1);
+    float d11 = dot(e1, e1);
+    float d20 = dot(e2, e0);
+    float d21 = dot(e2, e1);
+    float denominator = max(d00 * d11 - d01 * d01, 1e-12);
+    float v = (d11 * d20 - d01 * d21) / denominator;
+    float w = (d00 * d21 - d01 * d20) / denominator;
+    vec3 weights = clamp(vec3(1.0 - v - w, v, w), 0.0, 1.0);
+
+    vec3 normal = normalize(normals[0] * weights.x + normals[1] * weights.y + normals[2] * weights.z);
+    vec3 color = colors[0] * weights.x + colors[1] * weights.y + colors[2] * weights.z;
+
+    // blades have no texture and never show the far field layer
+    float diffuse = max(-dot(normal, normalize(light_direction)) * light_visibility(world_position), bias);
+    color *= diffuse;
+
+    float conceal = 0.0;
+    if (disable_fog == 0) {
+        float distance = length(camera_position.xyz - world_position);
+        float d = max(distance - view_distance * fog_bias, 0.0);
+        float exp = d / (view_distance * (1.0 - fog_bias));
+        conceal = clamp(exp * exp, 0.0, 1.0);
+    }
+
+    FragColor = vec4(mix(color, fog_color, conceal), 1.0);
+}
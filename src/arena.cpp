@@ -0,0 +1,61 @@
+#include "arena.hpp"
+#include <algorithm>
+
+Arena::Arena(size_t block_size) : m_block_size(block_size) {}
+
+void* Arena::allocate_bytes(size_t size, size_t alignment) {
+    while (m_block < m_blocks.size()) {
+        Block& block = m_blocks[m_block];
+        size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+        if (offset + size <= block.size) {
+            m_offset = offset + size;
+            return block.data.get() + offset;
+        }
+        ++m_block;
+        m_offset = 0;
+    }
+
+    // blocks are allocated with the default new alignment, which covers
+    // everything the generation code stores
+    size_t block_size = std::max(m_block_size, size);
+    m_blocks.push_back(
+        {std::unique_ptr<uint8_t[]>(new uint8_t[block_size]), block_size});
+    ++m_allocation_count;
+
+    m_block = m_blocks.size() - 1;
+    m_offset = size;
+    return m_blocks.back().data.get();
+}
+
+Arena::Marker Arena::get_marker() const { return {m_block, m_offset}; }
+
+void Arena::rewind(const Marker& marker) {
+    m_block = marker.block;
+    m_offset = marker.offset;
+}
+
+void Arena::reset() {
+    m_block = 0;
+    m_offset = 0;
+}
+
+size_t Arena::get_allocation_count() const { return m_allocation_count; }
+
+size_t Arena::get_capacity() const {
+    size_t capacity = 0;
+    for (const Block& block : m_blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+Arena& Arena::get_thread_arena() {
+    static thread_local Arena arena;
+    return arena;
+}
+
+// arena scope
+ArenaScope::ArenaScope(Arena& arena)
+    : m_arena(arena), m_marker(arena.get_marker()) {}
+
+ArenaScope::~ArenaScope() { m_arena.rewind(m_marker); }
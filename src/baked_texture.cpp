@@ -0,0 +1,174 @@
+#include "baked_texture.hpp"
+#include "gpu_memory.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// mapped file
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        m_file = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_file, &size);
+    m_size = (size_t)size.QuadPart;
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping) {
+        m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+        void* data =
+            mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED) {
+            m_data = (const uint8_t*)data;
+            m_size = status.st_size;
+            madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+    }
+    close(file);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap((void*)m_data, m_size);
+    }
+}
+#endif
+
+bool MappedFile::is_open() const { return m_data != nullptr; }
+
+const uint8_t* MappedFile::get_data() const { return m_data; }
+
+size_t MappedFile::get_size() const { return m_size; }
+
+// bytes a level of the header's format takes, 0 for an unknown type
+static size_t get_level_bytes(const BakedTextureHeader& header,
+                              uint32_t width, uint32_t height) {
+    if (header.format == 0) {
+        return get_texture_bytes(header.internal_format,
+                                 glm::ivec2(width, height), 1);
+    }
+    // uncompressed levels are tightly packed, the upload uses an unpack
+    // alignment of 1
+    size_t component_size = 0;
+    switch (header.type) {
+    case GL_UNSIGNED_BYTE:
+        component_size = 1;
+        break;
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+        component_size = 2;
+        break;
+    case GL_FLOAT:
+        component_size = 4;
+        break;
+    }
+    return (size_t)width * height * header.channel_count * component_size;
+}
+
+// baked texture
+BakedTexture::BakedTexture(const std::filesystem::path& path) : m_file(path) {
+    if (!m_file.is_open()) {
+        std::cerr << "FAILED TO OPEN BAKED TEXTURE: " << path << std::endl;
+        return;
+    }
+
+    if (m_file.get_size() < sizeof(BakedTextureHeader)) {
+        std::cerr << "BAKED TEXTURE TOO SMALL: " << path << std::endl;
+        return;
+    }
+
+    const BakedTextureHeader* header =
+        (const BakedTextureHeader*)m_file.get_data();
+    if (std::memcmp(header->magic, BAKED_TEXTURE_MAGIC, 4) != 0 ||
+        header->version != BAKED_TEXTURE_VERSION) {
+        std::cerr << "UNSUPPORTED BAKED TEXTURE: " << path << std::endl;
+        return;
+    }
+
+    size_t table_end = sizeof(BakedTextureHeader) +
+                       header->level_count * sizeof(BakedTextureLevel);
+    if (header->level_count == 0 || header->level_count > 32 ||
+        header->width == 0 || header->height == 0 ||
+        table_end > m_file.get_size()) {
+        std::cerr << "CORRUPT BAKED TEXTURE: " << path << std::endl;
+        return;
+    }
+
+    // every level has to hold exactly its mip of the format and lie inside
+    // the file, the upload reads level.size bytes from level.offset
+    const BakedTextureLevel* levels =
+        (const BakedTextureLevel*)(m_file.get_data() +
+                                   sizeof(BakedTextureHeader));
+    size_t file_size = m_file.get_size();
+    for (uint32_t i = 0; i < header->level_count; ++i) {
+        uint32_t width = std::max(1u, header->width >> i);
+        uint32_t height = std::max(1u, header->height >> i);
+        size_t expected = get_level_bytes(*header, width, height);
+        if (levels[i].width != width || levels[i].height != height ||
+            expected == 0 || levels[i].size != expected ||
+            levels[i].offset > file_size ||
+            levels[i].size > file_size - levels[i].offset) {
+            std::cerr << "CORRUPT BAKED TEXTURE: " << path << std::endl;
+            return;
+        }
+    }
+
+    m_header = header;
+    m_levels = levels;
+}
+
+bool BakedTexture::is_valid() const { return m_header != nullptr; }
+
+const BakedTextureHeader& BakedTexture::get_header() const { return *m_header; }
+
+const BakedTextureLevel& BakedTexture::get_level(int level) const {
+    return m_levels[level];
+}
+
+const uint8_t* BakedTexture::get_level_data(int level) const {
+    return m_file.get_data() + m_levels[level].offset;
+}
+
+bool BakedTexture::is_compressed() const { return m_header->format == 0; }
+
+bool BakedTexture::is_baked_texture(const std::filesystem::path& path) {
+    return path.extension() == BAKED_TEXTURE_EXTENSION;
+}
@@ -1,184 +1,796 @@
 #include "chunk.hpp"
 #include "PerlinNoise.hpp"
+#include "arena.hpp"
+#include "compute_scheduler.hpp"
 #include "glad/glad.h"
 #include "glm/ext/vector_int2.hpp"
 #include "glm/geometric.hpp"
+#include "glm/common.hpp"
 #include "glm/matrix.hpp"
 #include "mesh.hpp"
+#include "terrain_generator.hpp"
 #include "utility.hpp"
+#include "vegetation.hpp"
+#include <algorithm>
 #include <cstdint>
+#include <iostream>
+#include <span>
+#include <string>
+
+// largest gpu height error against the cpu build, relative to the terrain
+// height. the noise runs in single precision on the gpu
+static constexpr float GPU_TERRAIN_TOLERANCE = 0.001f;
+
+std::atomic<int> Chunk::grass_count = 0;
+std::atomic<int> Chunk::build_allocations = 0;
+
+Chunk::Chunk(const SpeciesSet& species, Shader& generator, Shader& compaction,
+             ComputeScheduler& scheduler, TextureArrayPool& height_maps,
+             TextureArrayPool& noise_maps, InstanceBufferPool& instances,
+             glm::ivec3 position, int grass_per_unit, int size,
+             float terrain_height, float terrain_scale, uint64_t seed,
+             UploadService* uploads)
+    : Chunk(species, generator, compaction, scheduler, height_maps, noise_maps,
+            instances,
+            build(glm::ivec2(position.x, position.z), size, terrain_height,
+                  terrain_scale, seed),
+            grass_per_unit, uploads) {}
+
+Chunk::Chunk(const SpeciesSet& species, Shader& generator, Shader& compaction,
+             ComputeScheduler& scheduler, TextureArrayPool& height_maps,
+             TextureArrayPool& noise_maps, InstanceBufferPool& instances,
+             ChunkGeometry geometry, int grass_per_unit,
+             UploadService* uploads, TerrainGenerator* terrain)
+    : m_species(species), m_generator(generator), m_compaction(compaction),
+      m_scheduler(scheduler), m_size(geometry.size), m_grass_count(0),
+      m_grass_per_unit(grass_per_unit),
+      m_terrain_height(geometry.terrain_height), m_instance_pool(instances),
+      m_noise_maps(noise_maps) {
+    m_min = geometry.min;
+    m_max = geometry.max;
+    m_coordinate = geometry.coordinate;
+    m_heightfield = geometry.heightfield;
+
+    m_height_map = height_maps.acquire(glm::ivec2(m_size + 1));
+    if (geometry.gpu_terrain) {
+        if (!terrain) {
+            std::cerr << "GPU TERRAIN WITHOUT A TERRAIN GENERATOR" << std::endl;
+        }
+        int s = m_size + 1;
+        int low_size = m_size / 4;
+        m_ground.allocate(s * s, m_size * m_size * 6);
+        m_ground_low_poly.allocate((low_size + 1) * (low_size + 1),
+                                   low_size * low_size * 6);
+        // owned by the ground so regenerating the blades doesn't cancel it
+        if (terrain) {
+            terrain->record(m_scheduler, &m_ground,
+                            glm::vec2(m_min.x, m_min.z), m_size,
+                            m_terrain_height, geometry.terrain_scale, m_ground,
+                            m_ground_low_poly, m_height_map);
+        }
+        m_terrain_reference = geometry.heightfield;
+        m_heightfield = nullptr;
+        m_terrain_pending = true;
+    } else if (uploads) {
+        // generation starts from prepare() once the uploads have landed
+        m_uploads.push_back(m_height_map.upload_async(
+            *uploads, std::move(geometry.heights), GL_UNSIGNED_SHORT, GL_RED));
+        m_uploads.push_back(m_ground.set_async(
+            *uploads, geometry.ground_vertices, geometry.ground_indices));
+        m_uploads.push_back(
+            m_ground_low_poly.set_async(*uploads,
+                                        geometry.ground_vertices_low_poly,
+                                        geometry.ground_indices_low_poly));
+    } else {
+        m_height_map.upload(geometry.heights.data(), GL_UNSIGNED_SHORT, GL_RED);
+        m_ground.set(geometry.ground_vertices, geometry.ground_indices);
+        m_ground_low_poly.set(geometry.ground_vertices_low_poly,
+                              geometry.ground_indices_low_poly);
+    }
+    std::string label = "chunk " + std::to_string(m_coordinate.x) + " " +
+                        std::to_string(m_coordinate.y);
+    m_ground.set_label(label + " ground");
+    m_ground_low_poly.set_label(label + " low poly");
+    // the heightfield answers every cpu query about the ground
+    if (MemoryTracker::get_drop_mesh_copies()) {
+        m_ground.release_copies();
+        m_ground_low_poly.release_copies();
+    }
 
-int Chunk::grass_count = 0;
+    m_noise_map = m_noise_maps.acquire(glm::ivec2(m_size * m_grass_per_unit));
+    m_coverage.load_texture_from_byte(0, GL_UNSIGNED_BYTE,
+                                      glm::ivec2(m_size * m_grass_per_unit),
+                                      GL_R8, GL_RED);
 
-Chunk::Chunk(const Mesh& grass_mesh, Shader& generator, glm::ivec3 position,
-             int grass_per_unit, int size, float terrain_height,
-             float terrain_scale, uint64_t seed)
-    : m_grass_mesh(grass_mesh), m_size(size), m_grass_per_unit(grass_per_unit) {
-    m_grass_count = m_size * m_size * grass_per_unit * grass_per_unit;
-    grass_count += m_grass_count;
-    m_min = glm::vec3(position) * (float)size;
-    m_max = m_min + glm::vec3(m_size, 0.0f, m_size);
+    if (!uploads) {
+        begin_generation();
+        m_scheduler.flush();
+        finish_generation(true);
+        m_scheduler.flush();
+    }
+}
+
+Chunk::~Chunk() {
+    m_scheduler.cancel(this);
+    m_scheduler.cancel(&m_ground);
+    grass_count -= m_grass_count;
+    if (m_count_fence) {
+        glDeleteSync(m_count_fence);
+    }
+}
 
-    uint8_t bytes[(m_size + 1) * (m_size + 1) * 3];
-    std::vector<Vertex> ground_vertices;
-    std::vector<Vertex> ground_vertices_low_poly;
-    std::vector<int> ground_indices;
-    std::vector<int> ground_indices_low_poly;
+ChunkGeometry Chunk::build(const glm::ivec2& coordinate, int size,
+                           float terrain_height, float terrain_scale,
+                           uint64_t seed) {
+    ChunkGeometry geometry;
+    geometry.coordinate = coordinate;
+    geometry.size = size;
+    geometry.terrain_height = terrain_height;
+    geometry.terrain_scale = terrain_scale;
+    geometry.min = glm::vec3(coordinate.x, 0.0f, coordinate.y) * (float)size;
+    geometry.max = geometry.min + glm::vec3(size, 0.0f, size);
+    geometry.heightfield = std::make_shared<Heightfield>(
+        glm::vec2(geometry.min.x, geometry.min.z), size);
+
+    // all scratch memory comes from the thread's arena and is released when
+    // the build returns
+    Arena& arena = Arena::get_thread_arena();
+    size_t allocation_count = arena.get_allocation_count();
+    ArenaScope scope(arena);
+
+    // the outputs leave with the geometry, each is sized once up front
+    int heap_allocations = 0;
+    auto allocate = [&heap_allocations](auto& output, size_t count) {
+        heap_allocations += output.capacity() < count;
+        output.resize(count);
+    };
+    int s = size + 1;
+    int low_size = size / 4;
+    int low_s = low_size + 1;
+    allocate(geometry.ground_vertices, s * s);
+    allocate(geometry.ground_indices, size * size * 6);
+    allocate(geometry.ground_vertices_low_poly, low_s * low_s);
+    allocate(geometry.ground_indices_low_poly, low_size * low_size * 6);
+    allocate(geometry.heights, s * s * sizeof(uint16_t));
+    uint16_t* heights = (uint16_t*)geometry.heights.data();
 
     const siv::PerlinNoise::seed_type seed_type = seed;
     const siv::PerlinNoise perlin{seed_type};
 
-    m_min.y = 10000.0f;
-    m_max.y = -10000.0f;
-
-    for (int x = 0; x <= m_size; ++x) {
-        for (int z = 0; z <= m_size; ++z) {
-            glm::vec3 position = m_min + glm::vec3(x, 0.0f, z);
-            position.y = perlin.octave2D_01(position.x * terrain_scale,
-                                            position.z * terrain_scale, 14) *
-                         terrain_height;
-
-            if (x < m_size && z < m_size) {
-                int s = m_size + 1;
-                ground_indices.push_back(x + s * z);
-                ground_indices.push_back((x + 1) + s * z);
-                ground_indices.push_back(x + s * (z + 1));
-
-                ground_indices.push_back((x + 1) + s * z);
-                ground_indices.push_back((x + 1) + s * (z + 1));
-                ground_indices.push_back(x + s * (z + 1));
+    // every sample plus a one unit border, the normals take central
+    // differences of it instead of evaluating the noise four more times
+    int b = s + 2;
+    std::span<float> samples = arena.allocate<float>(b * b);
+    for (int x = 0; x < b; ++x) {
+        for (int z = 0; z < b; ++z) {
+            float px = geometry.min.x + x - 1;
+            float pz = geometry.min.z + z - 1;
+            samples[x + b * z] =
+                perlin.octave2D_01(px * terrain_scale, pz * terrain_scale, 14) *
+                terrain_height;
+        }
+    }
+    auto sample = [&](int x, int z) {
+        return samples[(x + 1) + b * (z + 1)];
+    };
+
+    geometry.min.y = 10000.0f;
+    geometry.max.y = -10000.0f;
+
+    int vertex = 0;
+    int index = 0;
+    for (int x = 0; x <= size; ++x) {
+        for (int z = 0; z <= size; ++z) {
+            glm::vec3 position =
+                glm::vec3(geometry.min.x, 0.0f, geometry.min.z) +
+                glm::vec3(x, 0.0f, z);
+            position.y = sample(x, z);
+
+            if (x < size && z < size) {
+                geometry.ground_indices[index++] = x + s * z;
+                geometry.ground_indices[index++] = (x + 1) + s * z;
+                geometry.ground_indices[index++] = x + s * (z + 1);
+
+                geometry.ground_indices[index++] = (x + 1) + s * z;
+                geometry.ground_indices[index++] = (x + 1) + s * (z + 1);
+                geometry.ground_indices[index++] = x + s * (z + 1);
             }
 
-            glm::vec3 p0 = position + glm::vec3(1.0f, 0.0f, 0.0f);
-            glm::vec3 p1 = position + glm::vec3(-1.0f, 0.0f, 0.0f);
-            glm::vec3 p2 = position + glm::vec3(0.0f, 0.0f, 1.0f);
-            glm::vec3 p3 = position + glm::vec3(0.0f, 0.0f, -1.0f);
-
-            p0.y = perlin.octave2D_01(p0.x * terrain_scale,
-                                      p0.z * terrain_scale, 14) *
-                   terrain_height;
-            p1.y = perlin.octave2D_01(p1.x * terrain_scale,
-                                      p1.z * terrain_scale, 14) *
-                   terrain_height;
-            p2.y = perlin.octave2D_01(p2.x * terrain_scale,
-                                      p2.z * terrain_scale, 14) *
-                   terrain_height;
-            p3.y = perlin.octave2D_01(p3.x * terrain_scale,
-                                      p3.z * terrain_scale, 14) *
-                   terrain_height;
-
-            float h0 = p0.y - p1.y;
-            float h1 = p2.y - p3.y;
+            float h0 = sample(x + 1, z) - sample(x - 1, z);
+            float h1 = sample(x, z + 1) - sample(x, z - 1);
             glm::vec3 n = glm::normalize(glm::vec3(-h0, -h1, -1.0f));
 
-            ground_vertices.push_back(
-                {position, {0.0f, 0.0f}, n, {0.06f, 0.12f, 0.0f}});
+            geometry.ground_vertices[vertex++] = {
+                position, {0.0f, 0.0f}, n, {0.06f, 0.12f, 0.0f}};
 
-            m_min.y = fmin(m_min.y, position.y);
-            m_max.y = fmax(m_max.y, position.y);
+            geometry.min.y = fmin(geometry.min.y, position.y);
+            geometry.max.y = fmax(geometry.max.y, position.y);
+
+            geometry.heightfield->set_height(x, z, position.y);
 
-            int ci = (x + (m_size + 1) * z) * 3;
             float d = position.y / terrain_height;
-            bytes[ci + 0] = (uint8_t)(d * 255.0f);
-            bytes[ci + 1] = (uint8_t)(d * 255.0f);
-            bytes[ci + 2] = (uint8_t)(d * 255.0f);
+            heights[x + s * z] =
+                (uint16_t)(glm::clamp(d, 0.0f, 1.0f) * 65535.0f);
         }
     }
-    m_max.y += 4.0f;
-
-    for (int x = 0; x <= m_size / 4; ++x) {
-        for (int z = 0; z <= m_size / 4; ++z) {
-            int i = (x * 4 + (m_size + 1) * z * 4);
-            ground_vertices_low_poly.push_back(ground_vertices[i]);
-            if (x < m_size / 4 && z < m_size / 4) {
-                int s = m_size / 4 + 1;
-                ground_indices_low_poly.push_back(x + s * (z + 1));
-                ground_indices_low_poly.push_back((x + 1) + s * z);
-                ground_indices_low_poly.push_back(x + s * z);
-
-                ground_indices_low_poly.push_back(x + s * (z + 1));
-                ground_indices_low_poly.push_back((x + 1) + s * (z + 1));
-                ground_indices_low_poly.push_back((x + 1) + s * z);
+    geometry.max.y += 4.0f;
+
+    vertex = 0;
+    index = 0;
+    for (int x = 0; x <= low_size; ++x) {
+        for (int z = 0; z <= low_size; ++z) {
+            int i = (x * 4 + s * z * 4);
+            geometry.ground_vertices_low_poly[vertex++] =
+                geometry.ground_vertices[i];
+            if (x < low_size && z < low_size) {
+                geometry.ground_indices_low_poly[index++] = x + low_s * (z + 1);
+                geometry.ground_indices_low_poly[index++] = (x + 1) + low_s * z;
+                geometry.ground_indices_low_poly[index++] = x + low_s * z;
+
+                geometry.ground_indices_low_poly[index++] = x + low_s * (z + 1);
+                geometry.ground_indices_low_poly[index++] =
+                    (x + 1) + low_s * (z + 1);
+                geometry.ground_indices_low_poly[index++] = (x + 1) + low_s * z;
             }
         }
     }
 
-    // printf("lx: %.1f, ly: %.1f, lz: %.1f\n", m_min.x, m_min.y, m_min.z);
-    // printf("hx: %.1f, hy: %.1f, hz: %.1f\n", m_max.x, m_max.y, m_max.z);
+    geometry.heightfield->build_pyramid();
+
+    // the shared heightfield control block and what the heightfield holds
+    heap_allocations += 1 + geometry.heightfield->get_allocation_count();
+    build_allocations = heap_allocations +
+                        (int)(arena.get_allocation_count() - allocation_count);
+    return geometry;
+}
+
+ChunkGeometry Chunk::build_bounds(const glm::ivec2& coordinate, int size,
+                                  float terrain_height, float terrain_scale) {
+    ChunkGeometry geometry;
+    geometry.coordinate = coordinate;
+    geometry.size = size;
+    geometry.terrain_height = terrain_height;
+    geometry.terrain_scale = terrain_scale;
+    // octave2D_01 stays within [0, 1], the blades add up to 4 on top
+    geometry.min = glm::vec3(coordinate.x, 0.0f, coordinate.y) * (float)size;
+    geometry.max = geometry.min + glm::vec3(size, terrain_height + 4.0f, size);
+    geometry.gpu_terrain = true;
+    return geometry;
+}
+
+bool Chunk::prepare() {
+    if (m_generating) {
+        finish_generation(false);
+    }
+    if (m_generated || m_generating) {
+        return m_generated;
+    }
+
+    for (const std::shared_ptr<const UploadTicket>& upload : m_uploads) {
+        if (!upload->is_ready()) {
+            return false;
+        }
+    }
+    m_uploads.clear();
+    begin_generation();
+    return false;
+}
+
+void Chunk::regenerate(int grass_per_unit) {
+    m_grass_per_unit = grass_per_unit;
+    m_evicted = false;
+    glm::ivec2 noise_size = glm::ivec2(m_size * m_grass_per_unit);
+    if (m_noise_map.get_size() != noise_size) {
+        m_noise_map = m_noise_maps.acquire(noise_size);
+    }
+    m_coverage.load_texture_from_byte(0, GL_UNSIGNED_BYTE,
+                                      glm::ivec2(m_size * m_grass_per_unit),
+                                      GL_R8, GL_RED);
+
+    // a chunk still waiting on its uploads picks the new settings up later
+    if (!m_uploads.empty()) {
+        return;
+    }
+    m_scheduler.cancel(this);
+    if (m_count_fence) {
+        glDeleteSync(m_count_fence);
+        m_count_fence = nullptr;
+    }
+    begin_generation();
+}
+
+void Chunk::set_procedural(bool procedural) { m_procedural = procedural; }
+
+bool Chunk::is_procedural() const { return m_procedural_generated; }
+
+bool Chunk::evict() {
+    if (m_evicted || is_animated() || !m_generated || m_generating) {
+        return false;
+    }
+
+    // the noise layer goes back to its pool, the memory only once the
+    // whole array is unused
+    m_instances = InstanceRange();
+    m_species_offsets.clear();
+    m_sorted = false;
+    m_noise_map = TextureLayer();
+    grass_count -= m_grass_count;
+    m_grass_count = 0;
+    m_evicted = true;
+    return true;
+}
+
+float Chunk::get_last_used() const { return m_last_used; }
+
+void Chunk::set_generation_uniforms(bool write_instances) {
+    int width = m_size * m_grass_per_unit;
+    m_generator.set_uniform_int("width", width);
+    m_generator.set_uniform_int("height", width);
+    m_generator.set_uniform_vector3("lower_bound", m_min);
+    m_generator.set_uniform_vector3("upper_bound", m_max);
+    m_generator.set_uniform_float("spacing", 1.0f / m_grass_per_unit);
+    m_generator.set_uniform_float("terrain_scale", m_terrain_height);
+    m_generator.set_uniform_int("write_instances", write_instances);
+    m_generator.set_uniform_texture_array("height_map",
+                                          m_height_map.get_array(), 0);
+    m_generator.set_uniform_int("height_layer", m_height_map.get_layer());
+    m_generator.set_uniform_int("species_count", m_species.get_count());
+    m_species.bind();
+}
+
+void Chunk::begin_generation() {
+    // one flag per cell and species, scanned species after species so the
+    // instances of a species end up next to each other
+    int width = m_size * m_grass_per_unit;
+    int cell_count = width * width * m_species.get_count();
+    m_offsets.allocate(cell_count + 1);
+    m_generating = true;
+
+    m_scheduler
+        .record(this,
+                [this, width]() {
+                    set_generation_uniforms(false);
+                    m_generator.set_buffer(m_offsets, 1);
+                    glBindImageTexture(0, m_coverage.get_id(), 0, GL_FALSE, 0,
+                                       GL_WRITE_ONLY, GL_R8);
+                    FrameCounters::add(FrameCounter::TextureBinds);
+                    m_generator.dispatch(
+                        glm::ivec3((width + 7) / 8, (width + 7) / 8, 1));
+                    m_generator.flush_textures();
+                })
+        .read_texture_layer(m_height_map.get_array().get_id(),
+                            m_height_map.get_layer())
+        .write_buffer(m_offsets.get_id())
+        .write_texture(m_coverage.get_id());
+
+    m_scheduler
+        .record(this,
+                [this, cell_count]() {
+                    m_compaction.set_uniform_int("count", cell_count);
+                    m_compaction.set_buffer(m_offsets, 1);
+                    m_compaction.dispatch(glm::ivec3(1));
+                    gl_check_error();
+                })
+        .read_buffer(m_offsets.get_id())
+        .write_buffer(m_offsets.get_id());
+
+    // the total is read back by the cpu once the fence has passed, along
+    // with a ground mesh the gpu built
+    ComputePass& fence =
+        m_scheduler
+            .record(this,
+                    [this]() {
+                        m_count_fence =
+                            glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    })
+            .read_buffer(m_offsets.get_id(), ComputeAccess::Readback);
+    if (m_terrain_pending) {
+        fence.read_buffer(m_ground.get_vertex_buffer_id(),
+                          ComputeAccess::Readback);
+    }
+}
+
+void Chunk::read_terrain() {
+    int s = m_size + 1;
+    std::vector<Vertex> vertices(s * s);
+    glBindBuffer(GL_ARRAY_BUFFER, m_ground.get_vertex_buffer_id());
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex),
+                       vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    std::shared_ptr<Heightfield> heightfield =
+        std::make_shared<Heightfield>(glm::vec2(m_min.x, m_min.z), m_size);
+    float error = 0.0f;
+    for (int x = 0; x <= m_size; ++x) {
+        for (int z = 0; z <= m_size; ++z) {
+            float height = vertices[x * s + z].position.y;
+            heightfield->set_height(x, z, height);
+            if (m_terrain_reference) {
+                error = std::max(
+                    error,
+                    std::abs(height - m_terrain_reference->get_height(x, z)));
+            }
+        }
+    }
+    heightfield->build_pyramid();
+
+    if (m_terrain_reference &&
+        error > GPU_TERRAIN_TOLERANCE * m_terrain_height) {
+        std::cerr << "GPU TERRAIN MISMATCH IN CHUNK " << m_coordinate.x << " "
+                  << m_coordinate.y << ": " << error << std::endl;
+    }
+
+    m_heightfield = heightfield;
+    m_terrain_reference = nullptr;
+    m_terrain_pending = false;
+    m_terrain_read = true;
+}
+
+bool Chunk::finish_generation(bool wait) {
+    // the counting passes haven't been flushed yet
+    if (!m_count_fence) {
+        return false;
+    }
+    GLenum status =
+        glClientWaitSync(m_count_fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                         wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return false;
+    }
+    glDeleteSync(m_count_fence);
+    m_count_fence = nullptr;
+    if (m_terrain_pending) {
+        read_terrain();
+    }
+
+    int width = m_size * m_grass_per_unit;
+    int species_count = m_species.get_count();
+    m_species_offsets.resize(species_count + 1);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_offsets.get_id());
+    for (int i = 0; i <= species_count; ++i) {
+        uint32_t offset = 0;
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                           (GLintptr)i * width * width * sizeof(uint32_t),
+                           sizeof(uint32_t), &offset);
+        m_species_offsets[i] = offset;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    int count = m_species_offsets[species_count];
+    grass_count += count - m_grass_count;
+    m_grass_count = count;
+    m_sorted = false;
+    m_procedural_generated = m_procedural;
+    // the counts are all a procedural chunk keeps, the vertex shader redoes
+    // the rest of the pass per frame
+    if (m_procedural) {
+        m_instances = InstanceRange();
+        m_generated = true;
+        m_generating = false;
+        return true;
+    }
+
+    // a bare chunk keeps a single unused instance
+    m_instances = m_instance_pool.acquire(std::max(m_grass_count, 1));
+
+    // the run starts in generation order, so it draws correctly before its
+    // first sort whatever the order buffer held
+    if (m_grass_count > 0) {
+        GLuint buffer = m_instances.get_buffer().get_id();
+        GLuint order = m_instances.get_buffer().get_order_id();
+        m_scheduler
+            .record(this,
+                    [this, width, buffer, order]() {
+                        set_generation_uniforms(true);
+                        m_generator.set_uniform_int(
+                            "first_instance", (int)m_instances.get_first());
+                        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+                        glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                                         INSTANCE_ORDER_BINDING, order);
+                        m_generator.set_buffer(m_offsets, 1);
+                        m_generator.dispatch(
+                            glm::ivec3((width + 7) / 8, (width + 7) / 8, 1));
+                        gl_check_error();
+                        m_generator.flush_textures();
+                    })
+            .read_texture_layer(m_height_map.get_array().get_id(),
+                                m_height_map.get_layer())
+            .read_buffer(m_offsets.get_id())
+            .write_buffer_range(buffer, m_instances.get_first())
+            .write_buffer_range(order, m_instances.get_first());
+    }
+
+    m_generated = true;
+    m_generating = false;
+    return true;
+}
+
+bool Chunk::is_ready() const { return m_generated && !m_generating; }
+
+glm::ivec2 Chunk::get_coordinate() const { return m_coordinate; }
+
+const InstanceRange& Chunk::get_instances() const { return m_instances; }
+
+int Chunk::get_species_first(int species) const {
+    return m_species_offsets.empty() ? 0 : m_species_offsets[species];
+}
+
+int Chunk::get_species_count(int species) const {
+    if (m_species_offsets.empty()) {
+        return 0;
+    }
+    return m_species_offsets[species + 1] - m_species_offsets[species];
+}
+
+ProceduralBlades Chunk::get_procedural_blades(int species) const {
+    // the uniforms of the generation
+    ProceduralBlades blades = {};
+    blades.lower_bound =
+        glm::vec4(m_min.x, m_min.y, m_min.z, 1.0f / m_grass_per_unit);
+    blades.upper_bound =
+        glm::vec4(m_max.x, m_max.y, m_max.z, m_terrain_height);
+    blades.width = m_size * m_grass_per_unit;
+    blades.height_layer = m_height_map.get_layer();
+    blades.noise_layer = m_noise_map.get_layer();
+    blades.species = species;
+    return blades;
+}
+
+const TextureLayer& Chunk::get_height_map() const { return m_height_map; }
+
+const TextureLayer& Chunk::get_noise_map() const { return m_noise_map; }
+
+const Texture& Chunk::get_coverage() const { return m_coverage; }
+
+int Chunk::get_grass_count() const { return m_grass_count; }
 
-    m_height_map.load_texture_from_byte(bytes, GL_UNSIGNED_BYTE,
-                                        glm::ivec2(m_size + 1, m_size + 1),
-                                        GL_RGB, GL_RGB);
-    m_height_map.set_filter_mode(GL_LINEAR);
-    m_height_map.set_wrap_mode(GL_CLAMP_TO_EDGE);
-    m_ground.set(ground_vertices, ground_indices);
-    m_ground_low_poly.set(ground_vertices_low_poly, ground_indices_low_poly);
+glm::vec3 Chunk::get_min() const { return m_min; }
 
-    std::vector<GrassBuffer> grass(m_grass_count);
-    m_grass_buffer.load_data(grass);
+glm::vec3 Chunk::get_max() const { return m_max; }
 
-    generator.set_uniform_int("width", m_size * m_grass_per_unit);
-    generator.set_uniform_int("height", m_size * m_grass_per_unit);
-    generator.set_uniform_vector3("lower_bound", m_min);
-    generator.set_uniform_vector3("upper_bound", m_max);
-    generator.set_uniform_float("spacing", 1.0f / m_grass_per_unit);
-    generator.set_uniform_float("terrain_scale", terrain_height);
-    generator.set_uniform_texture("height_map", m_height_map, 0);
+int Chunk::get_grass_per_unit() const { return m_grass_per_unit; }
 
-    generator.set_buffer(m_grass_buffer, 0);
-    generator.dispatch(
-        glm::ivec3(m_size * m_grass_per_unit, m_size * m_grass_per_unit, 1));
-    gl_check_error();
-    generator.flush_textures();
+std::shared_ptr<const Heightfield> Chunk::get_heightfield() const {
+    return m_heightfield;
+}
+
+bool Chunk::take_terrain_readback() {
+    bool read = m_terrain_read;
+    m_terrain_read = false;
+    return read;
+}
+
+void Chunk::update_wind(ComputeScheduler& scheduler, Shader& flow_field,
+                        ShaderBuffer<ChunkParameters>& parameters,
+                        const std::vector<std::shared_ptr<Chunk>>& chunks,
+                        float time) {
+    // chunks grouped by the array holding their noise layer
+    std::vector<std::pair<const TextureArray*, std::vector<ChunkParameters>>>
+        batches;
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        if (!chunk->m_generated || chunk->m_grass_count == 0 ||
+            !chunk->m_noise_map.is_valid() || !chunk->is_animated()) {
+            continue;
+        }
+        const TextureArray* array = &chunk->m_noise_map.get_array();
+        auto batch = std::find_if(batches.begin(), batches.end(),
+                                  [array](const auto& batch) {
+                                      return batch.first == array;
+                                  });
+        if (batch == batches.end()) {
+            batches.push_back({array, {}});
+            batch = batches.end() - 1;
+        }
+        batch->second.push_back(chunk->get_parameters(time));
+    }
+
+    for (auto& [array, batch] : batches) {
+        size_t offset = parameters.push(batch.data(), batch.size());
+        if (offset == ShaderBuffer<ChunkParameters>::npos) {
+            continue;
+        }
 
-    m_noise_map.load_texture_from_byte(0, GL_FLOAT,
-                                       glm::ivec2(m_size * m_grass_per_unit),
-                                       GL_RGBA32F, GL_RGBA);
-    m_noise_map.set_filter_mode(GL_LINEAR);
+        // batches of different arrays don't depend on each other and share
+        // a level of the scheduler, each only writes the layers it animates
+        size_t count = batch.size();
+        ComputePass& pass = scheduler.record(
+            array, [&flow_field, &parameters, array, offset, count]() {
+                parameters.bind_range(CHUNK_PARAMETERS_BINDING, offset, count);
+                glm::ivec2 size = array->get_size();
+                glBindImageTexture(0, array->get_id(), 0, GL_TRUE, 0,
+                                   GL_WRITE_ONLY, array->get_internal_format());
+                FrameCounters::add(FrameCounter::TextureBinds);
+                flow_field.dispatch(
+                    glm::ivec3((size.x + 7) / 8, (size.y + 7) / 8, count));
+            });
+        for (const ChunkParameters& chunk : batch) {
+            pass.write_texture_layer(array->get_id(), chunk.layer);
+        }
+    }
 }
 
-void Chunk::update(Shader& flow_field, Shader& displacement,
+void Chunk::update(Shader& displacement,
+                   ShaderBuffer<ChunkParameters>& parameters,
                    float wind_direction, float time) {
-    if (m_cull || m_far) {
+    if (!prepare()) {
         return;
     }
 
-    flow_field.set_uniform_float("shift", time);
-    flow_field.set_uniform_vector2("offset", glm::vec2(m_min.x, m_min.z) *
-                                                 (float)(m_grass_per_unit));
+    if (!is_animated()) {
+        return;
+    }
+    m_last_used = time;
+    if (m_evicted) {
+        regenerate(m_grass_per_unit);
+        return;
+    }
+    // procedural blades sample the wind themselves
+    if (m_grass_count == 0 || m_procedural_generated) {
+        return;
+    }
+
+    size_t offset = parameters.push(get_parameters(time));
+    if (offset == ShaderBuffer<ChunkParameters>::npos) {
+        return;
+    }
+
+    // chunks sharing an instance buffer write disjoint runs of it and
+    // don't wait on each other
+    GLuint buffer = m_instances.get_buffer().get_id();
+    m_scheduler
+        .record(this,
+                [this, &displacement, &parameters, offset, buffer]() {
+                    parameters.bind_range(CHUNK_PARAMETERS_BINDING, offset);
+                    displacement.set_uniform_texture_array(
+                        "noise_map", m_noise_map.get_array(), 0);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+                    displacement.dispatch(
+                        glm::ivec3((m_grass_count + 63) / 64, 1, 1));
+                    displacement.flush_textures();
+                })
+        .read_texture_layer(m_noise_map.get_array().get_id(),
+                            m_noise_map.get_layer())
+        .write_buffer_range(buffer, m_instances.get_first());
+}
+
+bool Chunk::sort_instances(Shader& sort, const glm::vec3& eye, float range,
+                           float resort_distance) {
+    if (!is_ready() || m_grass_count == 0 || m_procedural_generated ||
+        m_visibility.cull || !m_visibility.grass) {
+        return false;
+    }
+    if (m_sorted && glm::distance(eye, m_sort_position) < resort_distance) {
+        return false;
+    }
+    m_sorted = true;
+    m_sort_position = eye;
+
+    // zeroed counts and their total, then the species runs the keys need
+    int key_count = m_species.get_count() * SORT_BUCKET_COUNT;
+    std::vector<uint32_t> buckets(key_count + 1, 0u);
+    buckets.insert(buckets.end(), m_species_offsets.begin(),
+                   m_species_offsets.end());
+    m_sort_buckets.load_data(buckets);
+
+    const InstanceBuffer& instances = m_instances.get_buffer();
+    GLuint buffer = instances.get_id();
+    GLuint order = instances.get_order_id();
+    size_t first = m_instances.get_first();
+    auto dispatch = [this, &sort, eye, range, buffer, order,
+                     first](bool scatter) {
+        sort.set_uniform_int("instance_count", m_grass_count);
+        sort.set_uniform_int("first_instance", (int)first);
+        sort.set_uniform_int("species_count", m_species.get_count());
+        sort.set_uniform_int("bucket_count", SORT_BUCKET_COUNT);
+        sort.set_uniform_int("scatter", scatter);
+        sort.set_uniform_vector3("eye", eye);
+        sort.set_uniform_float("sort_range", range);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_ORDER_BINDING,
+                         order);
+        sort.set_buffer(m_sort_buckets, 1);
+        sort.dispatch(glm::ivec3((m_grass_count + 63) / 64, 1, 1));
+    };
+
+    m_scheduler.record(this, [dispatch]() { dispatch(false); })
+        .read_buffer_range(buffer, first)
+        .write_buffer(m_sort_buckets.get_id());
+
+    m_scheduler
+        .record(this,
+                [this, key_count]() {
+                    m_compaction.set_uniform_int("count", key_count);
+                    m_compaction.set_buffer(m_sort_buckets, 1);
+                    m_compaction.dispatch(glm::ivec3(1));
+                })
+        .read_buffer(m_sort_buckets.get_id())
+        .write_buffer(m_sort_buckets.get_id());
+
+    m_scheduler.record(this, [dispatch]() { dispatch(true); })
+        .read_buffer_range(buffer, first)
+        .write_buffer(m_sort_buckets.get_id())
+        .write_buffer_range(order, first);
+    return true;
+}
 
-    flow_field.dispatch_texture(m_noise_map,
-                                glm::ivec3(m_noise_map.get_size(), 1));
+void Chunk::submit(RenderQueue& queue, VegetationBatch& vegetation,
+                   Shader& standard) {
+    if (m_visibility.cull || !m_generated) {
+        return;
+    }
 
-    displacement.set_uniform_int("width", m_size * m_grass_per_unit);
-    displacement.set_uniform_int("height", m_size * m_grass_per_unit);
-    displacement.set_uniform_texture("noise_map", m_noise_map, 0);
-    displacement.set_buffer(m_grass_buffer, 0);
-    displacement.dispatch(
-        glm::ivec3(m_size * m_grass_per_unit, m_size * m_grass_per_unit, 1));
-    displacement.flush_textures();
+    glm::vec3 center = m_min + (m_max - m_min) * 0.5f;
+    queue.submit(RenderPass::Opaque,
+                 m_visibility.far ? m_ground_low_poly : m_ground, standard,
+                 glm::mat4(1.0f), center);
+    if (m_visibility.grass) {
+        vegetation.add(*this);
+    }
 }
 
-void Chunk::render(Renderer& renderer, Shader& standard, Shader& gpu_instancing,
-                   bool debug) {
-    if (m_cull) {
+void Chunk::render_terrain_depth(Renderer& renderer, const Camera& light,
+                                 Shader& depth, bool low_detail) {
+    if (!m_generated || is_outside(light.get_matrix())) {
         return;
     }
 
-    renderer.draw(m_far ? m_ground_low_poly : m_ground, glm::mat4(1.0f),
-                  standard);
-    renderer.draw_instances(m_grass_mesh, m_grass_buffer, gpu_instancing,
-                            m_grass_count);
+    renderer.draw(low_detail ? m_ground_low_poly : m_ground, glm::mat4(1.0f),
+                  depth);
 }
 
-void Chunk::frustum_test(const Camera& camera) {
+void Chunk::add_grass_depth(VegetationBatch& casters, const Camera& light,
+                            int stride) {
+    if (!m_generated || m_grass_count / stride == 0 ||
+        is_outside(light.get_matrix())) {
+        return;
+    }
+
+    casters.add(*this, stride);
+}
+
+void Chunk::frustum_test(const Camera& camera, float grass_distance) {
+    set_visibility(test_visibility(camera, grass_distance));
+}
+
+ChunkVisibility Chunk::test_visibility(const Camera& camera,
+                                       float grass_distance) const {
+    ChunkVisibility visibility;
+
     glm::vec3 d = camera.get_position() - (m_min + (m_max - m_min) * 0.5f);
     float r = camera.get_far_clip_plane() * 0.85f;
-    m_far = glm::dot(d, d) > r * r;
+    visibility.far = glm::dot(d, d) > r * r;
+
+    glm::vec3 nearest = glm::clamp(camera.get_position(), m_min, m_max);
+    visibility.grass =
+        glm::length(nearest - camera.get_position()) < grass_distance;
+
+    visibility.cull = is_outside(camera.get_matrix());
+    return visibility;
+}
 
+void Chunk::set_visibility(const ChunkVisibility& visibility) {
+    m_visibility = visibility;
+}
+
+bool Chunk::is_animated() const {
+    return !m_visibility.cull && !m_visibility.far && m_visibility.grass;
+}
+
+ChunkParameters Chunk::get_parameters(float time) const {
+    ChunkParameters parameters = {};
+    parameters.offset = glm::vec2(m_min.x, m_min.z) * (float)(m_grass_per_unit);
+    parameters.shift = time;
+    parameters.size = m_size * m_grass_per_unit;
+    parameters.grass_count = m_grass_count;
+    parameters.layer = m_noise_map.get_layer();
+    parameters.first_instance = (int)m_instances.get_first();
+    return parameters;
+}
+
+bool Chunk::is_outside(const glm::mat4& matrix) const {
     glm::vec4 planes[6];
 
-    glm::mat4 mat = glm::transpose(camera.get_matrix());
+    glm::mat4 mat = glm::transpose(matrix);
 
     planes[0] = mat[3] + mat[0];
     planes[1] = mat[3] - mat[0];
@@ -192,7 +804,6 @@ void Chunk::frustum_test(const Camera& camera) {
         planes[i] /= length;
     }
 
-    m_cull = false;
     for (int i = 0; i < 6; ++i) {
         glm::vec3 n;
         n.x = (planes[i].x <= 0.0f) ? m_min.x : m_max.x;
@@ -202,8 +813,9 @@ void Chunk::frustum_test(const Camera& camera) {
         float distance = glm::dot(glm::vec3(planes[i]), n) + planes[i].w;
 
         if (distance < 0.0f) {
-            m_cull = true;
-            break;
+            return true;
         }
     }
+
+    return false;
 }
\ No newline at end of file
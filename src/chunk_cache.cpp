@@ -0,0 +1,234 @@
+#include "chunk_cache.hpp"
+#include "world.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static size_t align(size_t offset) { return (offset + 15) & ~(size_t)15; }
+
+// byte sizes of the arrays of one chunk, in file order
+static void get_array_sizes(int size, size_t sizes[5]) {
+    size_t s = size + 1;
+    size_t low_size = size / 4;
+    sizes[0] = s * s * sizeof(Vertex);
+    sizes[1] = (size_t)size * size * 6 * sizeof(int);
+    sizes[2] = (low_size + 1) * (low_size + 1) * sizeof(Vertex);
+    sizes[3] = low_size * low_size * 6 * sizeof(int);
+    sizes[4] = s * s * sizeof(uint16_t);
+}
+
+static int64_t get_key(int x, int y) {
+    return ((int64_t)x << 32) | (uint32_t)y;
+}
+
+uint64_t get_chunk_cache_key(const WorldConfig& config) {
+    // fnv-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](const void* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+        }
+    };
+    add(&config.chunk_size, sizeof(config.chunk_size));
+    add(&config.terrain_height, sizeof(config.terrain_height));
+    add(&config.terrain_scale, sizeof(config.terrain_scale));
+    add(&config.seed, sizeof(config.seed));
+    return hash;
+}
+
+bool ChunkCache::write(const std::filesystem::path& path,
+                       const WorldConfig& config) {
+    std::vector<glm::ivec2> layout;
+    for (int x = config.chunk_min.x; x < config.chunk_max.x; ++x) {
+        for (int y = config.chunk_min.y; y < config.chunk_max.y; ++y) {
+            layout.push_back(glm::ivec2(x, y));
+        }
+    }
+
+    std::vector<ChunkGeometry> chunks(layout.size());
+    std::atomic<size_t> next = 0;
+    auto build = [&]() {
+        for (size_t i = next++; i < layout.size(); i = next++) {
+            chunks[i] = Chunk::build(layout[i], config.chunk_size,
+                                     config.terrain_height,
+                                     config.terrain_scale, config.seed);
+        }
+    };
+    std::vector<std::thread> workers;
+    unsigned int worker_count =
+        std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < worker_count; ++i) {
+        workers.emplace_back(build);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // written next to the destination and renamed, a reader never maps a
+    // half written file
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "FAILED TO OPEN CHUNK CACHE: " << temporary << std::endl;
+        return false;
+    }
+
+    ChunkCacheHeader header;
+    std::memcpy(header.magic, CHUNK_CACHE_MAGIC, 4);
+    header.version = CHUNK_CACHE_VERSION;
+    header.key = get_chunk_cache_key(config);
+    header.chunk_count = chunks.size();
+    header.chunk_size = config.chunk_size;
+
+    size_t sizes[5];
+    get_array_sizes(config.chunk_size, sizes);
+    size_t chunk_bytes = 0;
+    for (size_t size : sizes) {
+        chunk_bytes = align(chunk_bytes + size);
+    }
+
+    std::vector<ChunkCacheEntry> entries(chunks.size());
+    size_t offset = align(sizeof(ChunkCacheHeader) +
+                          entries.size() * sizeof(ChunkCacheEntry));
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        entries[i] = {chunks[i].coordinate.x, chunks[i].coordinate.y,
+                      chunks[i].min.y, chunks[i].max.y, offset};
+        offset += chunk_bytes;
+    }
+
+    static const char padding[16] = {};
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)entries.data(),
+               entries.size() * sizeof(ChunkCacheEntry));
+    size_t position = sizeof(header) + entries.size() * sizeof(ChunkCacheEntry);
+    auto put = [&](const void* data, size_t size) {
+        file.write((const char*)data, size);
+        position += size;
+        file.write(padding, align(position) - position);
+        position = align(position);
+    };
+    file.write(padding, align(position) - position);
+    position = align(position);
+    for (const ChunkGeometry& chunk : chunks) {
+        put(chunk.ground_vertices.data(), sizes[0]);
+        put(chunk.ground_indices.data(), sizes[1]);
+        put(chunk.ground_vertices_low_poly.data(), sizes[2]);
+        put(chunk.ground_indices_low_poly.data(), sizes[3]);
+        put(chunk.heights.data(), sizes[4]);
+    }
+    file.close();
+    if (!file) {
+        std::cerr << "FAILED TO WRITE CHUNK CACHE: " << temporary << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "FAILED TO WRITE CHUNK CACHE: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+ChunkCache::ChunkCache(const std::filesystem::path& path) : m_file(path) {
+    if (!m_file.is_open()) {
+        std::cerr << "FAILED TO OPEN CHUNK CACHE: " << path << std::endl;
+        return;
+    }
+
+    if (m_file.get_size() < sizeof(ChunkCacheHeader)) {
+        std::cerr << "CHUNK CACHE TOO SMALL: " << path << std::endl;
+        return;
+    }
+
+    const ChunkCacheHeader* header = (const ChunkCacheHeader*)m_file.get_data();
+    if (std::memcmp(header->magic, CHUNK_CACHE_MAGIC, 4) != 0 ||
+        header->version != CHUNK_CACHE_VERSION) {
+        std::cerr << "UNSUPPORTED CHUNK CACHE: " << path << std::endl;
+        return;
+    }
+
+    size_t sizes[5];
+    get_array_sizes(header->chunk_size, sizes);
+    size_t chunk_bytes = 0;
+    for (size_t size : sizes) {
+        chunk_bytes = align(chunk_bytes + size);
+    }
+
+    size_t table_end = sizeof(ChunkCacheHeader) +
+                       header->chunk_count * sizeof(ChunkCacheEntry);
+    if (table_end > m_file.get_size()) {
+        std::cerr << "CORRUPT CHUNK CACHE: " << path << std::endl;
+        return;
+    }
+
+    const ChunkCacheEntry* entries =
+        (const ChunkCacheEntry*)(m_file.get_data() + sizeof(ChunkCacheHeader));
+    for (uint32_t i = 0; i < header->chunk_count; ++i) {
+        if (entries[i].offset + chunk_bytes > m_file.get_size()) {
+            std::cerr << "CORRUPT CHUNK CACHE: " << path << std::endl;
+            m_entries.clear();
+            return;
+        }
+        m_entries[get_key(entries[i].x, entries[i].y)] = &entries[i];
+    }
+
+    m_header = header;
+}
+
+bool ChunkCache::is_valid() const { return m_header != nullptr; }
+
+bool ChunkCache::load(const glm::ivec2& coordinate, const WorldConfig& config,
+                      ChunkGeometry& geometry) const {
+    if (!m_header || m_header->key != get_chunk_cache_key(config)) {
+        return false;
+    }
+    auto found = m_entries.find(get_key(coordinate.x, coordinate.y));
+    if (found == m_entries.end()) {
+        return false;
+    }
+    const ChunkCacheEntry& entry = *found->second;
+
+    int size = m_header->chunk_size;
+    geometry.coordinate = coordinate;
+    geometry.size = size;
+    geometry.terrain_height = config.terrain_height;
+    geometry.terrain_scale = config.terrain_scale;
+    geometry.min = glm::vec3(coordinate.x, 0.0f, coordinate.y) * (float)size;
+    geometry.max = geometry.min + glm::vec3(size, 0.0f, size);
+    geometry.min.y = entry.min_height;
+    geometry.max.y = entry.max_height;
+
+    size_t sizes[5];
+    get_array_sizes(size, sizes);
+    const uint8_t* data = m_file.get_data() + entry.offset;
+    auto take = [&](auto& output, size_t bytes) {
+        output.resize(bytes / sizeof(output[0]));
+        std::memcpy(output.data(), data, bytes);
+        data += align(bytes);
+    };
+    take(geometry.ground_vertices, sizes[0]);
+    take(geometry.ground_indices, sizes[1]);
+    take(geometry.ground_vertices_low_poly, sizes[2]);
+    take(geometry.ground_indices_low_poly, sizes[3]);
+    take(geometry.heights, sizes[4]);
+
+    // same samples as the build, they are the vertex heights
+    int s = size + 1;
+    geometry.heightfield = std::make_shared<Heightfield>(
+        glm::vec2(geometry.min.x, geometry.min.z), size);
+    for (int x = 0; x < s; ++x) {
+        for (int z = 0; z < s; ++z) {
+            geometry.heightfield->set_height(
+                x, z, geometry.ground_vertices[x * s + z].position.y);
+        }
+    }
+    geometry.heightfield->build_pyramid();
+    return true;
+}
@@ -0,0 +1,212 @@
+#include "compute_scheduler.hpp"
+#include "frame_counters.hpp"
+#include "gl_debug.hpp"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+// a flush deeper than this serializes passes that should share a level, the
+// longest chain of a chunk is its terrain, generation and count read back
+static constexpr int EXPECTED_LEVEL_COUNT = 16;
+
+static GLbitfield get_barrier(ComputeAccess access) {
+    switch (access) {
+    case ComputeAccess::Storage:
+        return GL_SHADER_STORAGE_BARRIER_BIT;
+    case ComputeAccess::Image:
+        return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    case ComputeAccess::Sampled:
+        return GL_TEXTURE_FETCH_BARRIER_BIT;
+    case ComputeAccess::Readback:
+        return GL_BUFFER_UPDATE_BARRIER_BIT;
+    default:
+        return GL_ALL_BARRIER_BITS;
+    }
+}
+
+// buffer and texture names overlap, keep them apart in the key
+static uint64_t get_buffer_key(GLuint buffer) { return buffer; }
+
+static uint64_t get_texture_key(GLuint texture) {
+    return (uint64_t)1 << 32 | texture;
+}
+
+static uint64_t get_range_key(GLuint buffer, size_t first) {
+    return (uint64_t)1 << 63 | (uint64_t)buffer << 32 | (uint32_t)first;
+}
+
+static uint64_t get_layer_key(GLuint texture, int layer) {
+    return (uint64_t)1 << 62 | (uint64_t)texture << 16 | (uint16_t)layer;
+}
+
+// pass
+ComputePass& ComputePass::read_buffer(GLuint buffer, ComputeAccess access) {
+    return add(get_buffer_key(buffer), access, false);
+}
+
+ComputePass& ComputePass::write_buffer(GLuint buffer, ComputeAccess access) {
+    return add(get_buffer_key(buffer), access, true);
+}
+
+ComputePass& ComputePass::read_buffer_range(GLuint buffer, size_t first,
+                                            ComputeAccess access) {
+    return add(get_range_key(buffer, first), access, false);
+}
+
+ComputePass& ComputePass::write_buffer_range(GLuint buffer, size_t first,
+                                             ComputeAccess access) {
+    return add(get_range_key(buffer, first), access, true);
+}
+
+ComputePass& ComputePass::read_texture(GLuint texture, ComputeAccess access) {
+    return add(get_texture_key(texture), access, false);
+}
+
+ComputePass& ComputePass::write_texture(GLuint texture,
+                                        ComputeAccess access) {
+    return add(get_texture_key(texture), access, true);
+}
+
+ComputePass& ComputePass::read_texture_layer(GLuint texture, int layer,
+                                             ComputeAccess access) {
+    return add(get_layer_key(texture, layer), access, false,
+               get_texture_key(texture));
+}
+
+ComputePass& ComputePass::write_texture_layer(GLuint texture, int layer,
+                                              ComputeAccess access) {
+    return add(get_layer_key(texture, layer), access, true,
+               get_texture_key(texture));
+}
+
+ComputePass& ComputePass::add(uint64_t resource, ComputeAccess access,
+                              bool write, uint64_t texture) {
+    m_accesses.push_back({resource, get_barrier(access), write, texture});
+    return *this;
+}
+
+// scheduler
+ComputePass& ComputeScheduler::record(const void* owner,
+                                      std::function<void()> execute) {
+    ComputePass& pass = m_passes.emplace_back();
+    pass.m_owner = owner;
+    pass.m_execute = std::move(execute);
+    return pass;
+}
+
+void ComputeScheduler::cancel(const void* owner) {
+    std::erase_if(m_passes, [owner](const ComputePass& pass) {
+        return pass.m_owner == owner;
+    });
+}
+
+void ComputeScheduler::flush(GLbitfield final_barriers) {
+    // passes recorded while executing wait for the next flush
+    std::deque<ComputePass> passes;
+    passes.swap(m_passes);
+    if (passes.empty()) {
+        return;
+    }
+    GlDebugGroup group("compute");
+
+    struct ResourceState {
+        int write_level = -1;
+        int read_level = -1;
+        // latest accesses to any layer of a texture
+        int layer_write_level = -1;
+        int layer_read_level = -1;
+    };
+    std::unordered_map<uint64_t, ResourceState> resources;
+
+    // a pass goes one level above the last writer of what it reads and above
+    // every earlier access of what it writes
+    int level_count = 0;
+    for (ComputePass& pass : passes) {
+        pass.m_level = 0;
+        pass.m_barrier = 0;
+        for (const ComputePass::Access& access : pass.m_accesses) {
+            ResourceState state = resources[access.resource];
+            int level = state.write_level;
+            if (access.write) {
+                level = std::max(level, state.read_level);
+            }
+            // a layer waits on the whole texture and the whole texture on
+            // every layer
+            if (access.texture) {
+                const ResourceState& texture = resources[access.texture];
+                level = std::max(level, texture.write_level);
+                if (access.write) {
+                    level = std::max(level, texture.read_level);
+                }
+            } else {
+                level = std::max(level, state.layer_write_level);
+                if (access.write) {
+                    level = std::max(level, state.layer_read_level);
+                }
+            }
+            if (level >= 0) {
+                pass.m_level = std::max(pass.m_level, level + 1);
+                pass.m_barrier |= access.barrier;
+            }
+        }
+
+        for (const ComputePass::Access& access : pass.m_accesses) {
+            ResourceState& state = resources[access.resource];
+            if (access.write) {
+                state.write_level = pass.m_level;
+                state.read_level = -1;
+            } else {
+                state.read_level = std::max(state.read_level, pass.m_level);
+            }
+            if (access.texture) {
+                ResourceState& texture = resources[access.texture];
+                int& level = access.write ? texture.layer_write_level
+                                          : texture.layer_read_level;
+                level = std::max(level, pass.m_level);
+            }
+        }
+        level_count = std::max(level_count, pass.m_level + 1);
+    }
+
+    m_statistics.levels = std::max(m_statistics.levels, level_count);
+#ifndef NDEBUG
+    if (level_count > EXPECTED_LEVEL_COUNT) {
+        std::cerr << "COMPUTE FLUSH OF " << passes.size() << " PASSES NEEDED "
+                  << level_count << " LEVELS" << std::endl;
+    }
+#endif
+
+    std::vector<std::vector<ComputePass*>> levels(level_count);
+    for (ComputePass& pass : passes) {
+        levels[pass.m_level].push_back(&pass);
+    }
+
+    for (std::vector<ComputePass*>& level : levels) {
+        GLbitfield barrier = 0;
+        for (ComputePass* pass : level) {
+            barrier |= pass->m_barrier;
+        }
+        if (barrier) {
+            glMemoryBarrier(barrier);
+            m_statistics.barriers++;
+            FrameCounters::add(FrameCounter::Barriers);
+        }
+
+        for (ComputePass* pass : level) {
+            pass->m_execute();
+            m_statistics.passes++;
+        }
+    }
+
+    if (final_barriers) {
+        glMemoryBarrier(final_barriers);
+        m_statistics.barriers++;
+        FrameCounters::add(FrameCounter::Barriers);
+    }
+}
+
+void ComputeScheduler::begin_frame() { m_statistics = ComputeStatistics(); }
+
+ComputeStatistics ComputeScheduler::get_statistics() const {
+    return m_statistics;
+}
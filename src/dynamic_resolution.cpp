@@ -0,0 +1,102 @@
+#include "dynamic_resolution.hpp"
+#include <algorithm>
+#include <cmath>
+
+// weight of a new sample in the smoothed frame time
+static constexpr float GPU_TIME_SMOOTHING = 0.1f;
+// relative error ignored by the controller so the scale does not oscillate
+static constexpr float SCALE_DEAD_ZONE = 0.05f;
+static constexpr float SCALE_MAX_STEP = 0.02f;
+
+DynamicResolution::DynamicResolution(const glm::ivec2& max_size, float budget,
+                                     float min_scale, float max_scale)
+    : m_max_size(max_size), m_budget(budget), m_min_scale(min_scale),
+      m_max_scale(max_scale), m_scale(max_scale) {
+    glGenQueries(QUERY_COUNT * 2, &m_queries[0][0]);
+}
+
+DynamicResolution::~DynamicResolution() {
+    glDeleteQueries(QUERY_COUNT * 2, &m_queries[0][0]);
+}
+
+void DynamicResolution::begin_frame() {
+    // results are read back QUERY_COUNT frames later, if the gpu is even
+    // further behind this frame goes unmeasured instead of stalling
+    int slot = m_frame % QUERY_COUNT;
+    if (m_pending[slot]) {
+        GLint available = 0;
+        glGetQueryObjectiv(m_queries[slot][1], GL_QUERY_RESULT_AVAILABLE,
+                           &available);
+        if (available) {
+            GLuint64 begin;
+            GLuint64 end;
+            glGetQueryObjectui64v(m_queries[slot][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(m_queries[slot][1], GL_QUERY_RESULT, &end);
+            m_pending[slot] = false;
+            update_scale((end - begin) / 1000000.0f);
+        }
+    }
+
+    m_timing = !m_pending[slot];
+    if (m_timing) {
+        glQueryCounter(m_queries[slot][0], GL_TIMESTAMP);
+    }
+}
+
+void DynamicResolution::end_frame() {
+    int slot = m_frame % QUERY_COUNT;
+    if (m_timing) {
+        glQueryCounter(m_queries[slot][1], GL_TIMESTAMP);
+        m_pending[slot] = true;
+    }
+    ++m_frame;
+}
+
+void DynamicResolution::set_enabled(bool enabled) {
+    m_enabled = enabled;
+    if (!m_enabled) {
+        m_scale = m_max_scale;
+    }
+}
+
+void DynamicResolution::set_budget(float budget) { m_budget = budget; }
+
+bool DynamicResolution::is_enabled() const { return m_enabled; }
+
+float DynamicResolution::get_budget() const { return m_budget; }
+
+float DynamicResolution::get_scale() const { return m_scale; }
+
+float DynamicResolution::get_gpu_time() const { return m_gpu_time; }
+
+glm::ivec2 DynamicResolution::get_viewport_size() const {
+    return glm::ivec2(std::max((int)std::round(m_max_size.x * m_scale), 1),
+                      std::max((int)std::round(m_max_size.y * m_scale), 1));
+}
+
+glm::vec2 DynamicResolution::get_uv_scale() const {
+    glm::ivec2 size = get_viewport_size();
+    return glm::vec2((float)size.x / m_max_size.x,
+                     (float)size.y / m_max_size.y);
+}
+
+void DynamicResolution::update_scale(float gpu_time) {
+    if (m_gpu_time == 0.0f) {
+        m_gpu_time = gpu_time;
+    }
+    m_gpu_time += (gpu_time - m_gpu_time) * GPU_TIME_SMOOTHING;
+    if (!m_enabled || m_gpu_time <= 0.0f) {
+        return;
+    }
+
+    // fill cost follows the pixel count, which goes with the square of the
+    // scale
+    float target = m_scale * std::sqrt(m_budget / m_gpu_time);
+    float error = (target - m_scale) / m_scale;
+    if (std::fabs(error) < SCALE_DEAD_ZONE) {
+        return;
+    }
+
+    m_scale += std::clamp(target - m_scale, -SCALE_MAX_STEP, SCALE_MAX_STEP);
+    m_scale = std::clamp(m_scale, m_min_scale, m_max_scale);
+}
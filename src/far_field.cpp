@@ -0,0 +1,100 @@
+#include "far_field.hpp"
+#include "gl_debug.hpp"
+
+FarField::FarField(const Mesh& grass_mesh, Shader& baker,
+                   const glm::vec2& origin, const glm::ivec2& size)
+    : m_baker(baker) {
+    set_bounds(origin, size);
+    m_texture.set_filter_mode(GL_LINEAR);
+    m_texture.set_wrap_mode(GL_CLAMP_TO_EDGE);
+
+    // the layer is tinted with the average blade colour
+    m_grass_color = glm::vec3(0.0f);
+    for (const Vertex& vertex : grass_mesh.get_vertices()) {
+        m_grass_color += vertex.color;
+    }
+    if (!grass_mesh.get_vertices().empty()) {
+        m_grass_color /= (float)grass_mesh.get_vertices().size();
+    }
+}
+
+void FarField::update(const std::vector<std::shared_ptr<Chunk>>& chunks) {
+    GlDebugGroup group("far field");
+    bool baked = false;
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        glm::ivec2 coordinate = chunk->get_coordinate();
+        int64_t key = ((int64_t)coordinate.x << 32) | (uint32_t)coordinate.y;
+        if (!chunk->is_ready() || m_baked.count(key)) {
+            continue;
+        }
+        bake(*chunk);
+        m_baked.insert(key);
+        baked = true;
+    }
+
+    if (baked) {
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        FrameCounters::add(FrameCounter::Barriers);
+    }
+
+    glActiveTexture(GL_TEXTURE0 + FAR_FIELD_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_texture.get_id());
+    glActiveTexture(GL_TEXTURE0);
+    FrameCounters::add(FrameCounter::TextureBinds);
+}
+
+void FarField::invalidate() {
+    glClearTexImage(m_texture.get_id(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    m_baked.clear();
+}
+
+void FarField::set_bounds(const glm::vec2& origin, const glm::ivec2& size) {
+    m_origin = origin;
+    m_size = size;
+    m_texture.load_texture_from_byte(0, GL_UNSIGNED_BYTE, m_size, GL_RGBA8,
+                                     GL_RGBA);
+    invalidate();
+}
+
+void FarField::set_fade(float start, float end) {
+    m_fade_start = start;
+    m_fade_end = end;
+}
+
+void FarField::apply(Shader& shader, bool terrain, bool fade) const {
+    shader.set_uniform_int("far_field", FAR_FIELD_TEXTURE_UNIT);
+    shader.set_uniform_int("far_field_layer", terrain && fade);
+    shader.set_uniform_vector4("far_field_bounds",
+                               glm::vec4(m_origin, 1.0f / m_size.x,
+                                         1.0f / m_size.y));
+    shader.set_uniform_vector2("far_field_fade",
+                               fade ? glm::vec2(m_fade_start, m_fade_end)
+                                    : glm::vec2(1e30f, 2e30f));
+    shader.set_uniform_vector3("grass_color", m_grass_color);
+}
+
+float FarField::get_fade_end() const { return m_fade_end; }
+
+const Texture& FarField::get_texture() const { return m_texture; }
+
+void FarField::bake(const Chunk& chunk) {
+    glm::ivec2 size = glm::ivec2(chunk.get_max().x - chunk.get_min().x,
+                                 chunk.get_max().z - chunk.get_min().z);
+    glm::ivec2 offset =
+        glm::ivec2(chunk.get_min().x, chunk.get_min().z) - glm::ivec2(m_origin);
+    if (offset.x < 0 || offset.y < 0 || offset.x + size.x > m_size.x ||
+        offset.y + size.y > m_size.y) {
+        return;
+    }
+
+    m_baker.set_uniform_int("blades_per_texel", chunk.get_grass_per_unit());
+    m_baker.set_uniform_vector2("texel_offset", offset);
+    m_baker.set_uniform_vector2("texel_count", size);
+
+    glBindImageTexture(0, m_texture.get_id(), 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                       GL_RGBA8);
+    glBindImageTexture(1, chunk.get_coverage().get_id(), 0, GL_FALSE, 0,
+                       GL_READ_ONLY, GL_R8);
+    FrameCounters::add(FrameCounter::TextureBinds, 2);
+    m_baker.dispatch(glm::ivec3((size.x + 7) / 8, (size.y + 7) / 8, 1));
+}
@@ -0,0 +1,302 @@
+#include "frame_capture.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// png
+// there is no image writer among the dependencies, and the capture has to
+// stay cheap on the writer thread, so the png is written with stored
+// (uncompressed) deflate blocks
+static const std::array<uint32_t, 256>& crc_table() {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> result;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            result[i] = c;
+        }
+        return result;
+    }();
+    return table;
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t* data, size_t size) {
+    const std::array<uint32_t, 256>& table = crc_table();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void put_u32(std::vector<uint8_t>& output, uint32_t value) {
+    output.push_back(value >> 24);
+    output.push_back((value >> 16) & 0xff);
+    output.push_back((value >> 8) & 0xff);
+    output.push_back(value & 0xff);
+}
+
+static void write_chunk(std::ofstream& file, const char* type,
+                        const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> header;
+    put_u32(header, data.size());
+    header.insert(header.end(), type, type + 4);
+    uint32_t crc = crc_update(0xffffffffu, header.data() + 4, 4);
+    crc = crc_update(crc, data.data(), data.size()) ^ 0xffffffffu;
+    std::vector<uint8_t> footer;
+    put_u32(footer, crc);
+
+    file.write((const char*)header.data(), header.size());
+    file.write((const char*)data.data(), data.size());
+    file.write((const char*)footer.data(), footer.size());
+}
+
+// rgba8, rows bottom up as read back from OpenGL
+static void write_png(std::ofstream& file, const uint8_t* pixels,
+                      const glm::ivec2& size) {
+    static const uint8_t signature[8] = {0x89, 'P',  'N',  'G',
+                                         '\r', '\n', 0x1a, '\n'};
+    file.write((const char*)signature, 8);
+
+    std::vector<uint8_t> header;
+    put_u32(header, size.x);
+    put_u32(header, size.y);
+    // 8 bit rgba, default compression, filter and interlace
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    write_chunk(file, "IHDR", header);
+
+    // zlib stream: every scanline is a filter byte plus the row, split into
+    // stored blocks of at most 65535 bytes
+    size_t row_size = (size_t)size.x * 4;
+    size_t raw_size = (row_size + 1) * size.y;
+    std::vector<uint8_t> data;
+    data.reserve(raw_size + raw_size / 65535 * 5 + 16);
+    data.push_back(0x78);
+    data.push_back(0x01);
+
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    size_t block_left = 0;
+    size_t remaining = raw_size;
+    auto append = [&](const uint8_t* bytes, size_t count) {
+        while (count > 0) {
+            if (block_left == 0) {
+                block_left = std::min<size_t>(remaining, 65535);
+                remaining -= block_left;
+                data.push_back(remaining == 0 ? 1 : 0);
+                data.push_back(block_left & 0xff);
+                data.push_back(block_left >> 8);
+                data.push_back(~block_left & 0xff);
+                data.push_back((~block_left >> 8) & 0xff);
+            }
+            size_t step = std::min(count, block_left);
+            // 5552 bytes is the most that can be summed before the 32 bit
+            // sums overflow
+            for (size_t i = 0; i < step; i += 5552) {
+                size_t end = std::min(step, i + 5552);
+                for (size_t j = i; j < end; ++j) {
+                    adler_a += bytes[j];
+                    adler_b += adler_a;
+                }
+                adler_a %= 65521;
+                adler_b %= 65521;
+            }
+            data.insert(data.end(), bytes, bytes + step);
+            bytes += step;
+            count -= step;
+            block_left -= step;
+        }
+    };
+
+    const uint8_t filter = 0;
+    for (int y = size.y - 1; y >= 0; --y) {
+        append(&filter, 1);
+        append(pixels + row_size * y, row_size);
+    }
+    put_u32(data, (adler_b << 16) | adler_a);
+    write_chunk(file, "IDAT", data);
+    write_chunk(file, "IEND", {});
+}
+
+std::string get_capture_file_name(uint64_t frame, CaptureFormat format) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%06llu.%s",
+                  (unsigned long long)frame,
+                  format == CaptureFormat::PNG ? "png" : "rgba");
+    return name;
+}
+
+bool write_image(const std::filesystem::path& path, const uint8_t* pixels,
+                 const glm::ivec2& size, CaptureFormat format) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "FAILED TO OPEN CAPTURE FILE: " << path << std::endl;
+        return false;
+    }
+
+    if (format == CaptureFormat::PNG) {
+        write_png(file, pixels, size);
+    } else {
+        // top down rows, like every other raw image tool expects
+        size_t row_size = (size_t)size.x * 4;
+        for (int y = size.y - 1; y >= 0; --y) {
+            file.write((const char*)pixels + row_size * y, row_size);
+        }
+    }
+    return true;
+}
+
+// frame capture
+FrameCapture::FrameCapture(const glm::ivec2& size,
+                           const std::filesystem::path& directory,
+                           CaptureFormat format, bool lossless, int ring_size)
+    : m_size(size), m_frame_size((size_t)size.x * size.y * 4),
+      m_directory(directory), m_format(format), m_lossless(lossless),
+      m_ring_size(ring_size), m_slots(std::make_unique<Slot[]>(ring_size)),
+      m_allocation(MemoryCategory::Staging) {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error) {
+        std::cerr << "FAILED TO CREATE CAPTURE DIRECTORY: " << m_directory
+                  << std::endl;
+    }
+
+    GLbitfield flags =
+        GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (int i = 0; i < m_ring_size; ++i) {
+        Slot& slot = m_slots[i];
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, m_frame_size, nullptr, flags);
+        slot.data = (uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                               m_frame_size, flags);
+        if (!slot.data) {
+            std::cerr << "FAILED TO MAP CAPTURE BUFFER" << std::endl;
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_allocation.resize(m_frame_size * m_ring_size);
+
+    m_writer = std::thread(&FrameCapture::run, this);
+}
+
+FrameCapture::~FrameCapture() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_condition.notify_one();
+    m_writer.join();
+
+    for (int i = 0; i < m_ring_size; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[i].buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glDeleteBuffers(1, &m_slots[i].buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCapture::capture() {
+    resolve(false);
+
+    Slot& slot = m_slots[m_next];
+    if (slot.state.load(std::memory_order_acquire) != SlotState::Free) {
+        if (!m_lossless) {
+            m_dropped++;
+            m_frame++;
+            return;
+        }
+        if (slot.state.load() == SlotState::InFlight) {
+            resolve(true);
+        }
+        slot.state.wait(SlotState::Writing, std::memory_order_acquire);
+    }
+    if (!slot.data) {
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, m_size.x, m_size.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = m_frame++;
+    slot.state.store(SlotState::InFlight, std::memory_order_release);
+    m_in_flight.push_back(m_next);
+    m_next = (m_next + 1) % m_ring_size;
+}
+
+void FrameCapture::flush() {
+    while (!m_in_flight.empty()) {
+        resolve(true);
+    }
+    for (int i = 0; i < m_ring_size; ++i) {
+        m_slots[i].state.wait(SlotState::Writing, std::memory_order_acquire);
+    }
+}
+
+void FrameCapture::set_sink(FrameSink sink) { m_sink = std::move(sink); }
+
+int FrameCapture::get_written_count() const { return m_written.load(); }
+
+int FrameCapture::get_dropped_count() const { return m_dropped; }
+
+void FrameCapture::resolve(bool wait) {
+    while (!m_in_flight.empty()) {
+        Slot& slot = m_slots[m_in_flight.front()];
+        GLenum status =
+            glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                             wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return;
+        }
+
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.state.store(SlotState::Writing, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(m_in_flight.front());
+        }
+        m_condition.notify_one();
+        m_in_flight.pop_front();
+        // only the oldest frame is worth blocking for
+        wait = false;
+    }
+}
+
+void FrameCapture::run() {
+    while (true) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock,
+                             [this]() { return !m_running || !m_jobs.empty(); });
+            if (m_jobs.empty()) {
+                break;
+            }
+            index = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        Slot& slot = m_slots[index];
+        write(slot);
+        m_written++;
+        slot.state.store(SlotState::Free, std::memory_order_release);
+        slot.state.notify_all();
+    }
+}
+
+void FrameCapture::write(const Slot& slot) const {
+    if (m_sink) {
+        m_sink(slot.frame, slot.data, m_size);
+        return;
+    }
+    write_image(m_directory / get_capture_file_name(slot.frame, m_format),
+                slot.data, m_size, m_format);
+}
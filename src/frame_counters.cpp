@@ -0,0 +1,132 @@
+#include "frame_counters.hpp"
+
+static const GLenum PIPELINE_QUERY_TARGETS[PIPELINE_COUNTER_COUNT] = {
+    GL_VERTEX_SHADER_INVOCATIONS, GL_PRIMITIVES_SUBMITTED,
+    GL_FRAGMENT_SHADER_INVOCATIONS};
+
+const char* get_frame_counter_name(FrameCounter counter) {
+    switch (counter) {
+    case FrameCounter::DrawCalls:
+        return "draw_calls";
+    case FrameCounter::Dispatches:
+        return "dispatches";
+    case FrameCounter::Instances:
+        return "instances";
+    case FrameCounter::VisibleChunks:
+        return "visible_chunks";
+    case FrameCounter::UploadedBytes:
+        return "uploaded_bytes";
+    case FrameCounter::ProgramBinds:
+        return "program_binds";
+    case FrameCounter::TextureBinds:
+        return "texture_binds";
+    case FrameCounter::Barriers:
+        return "barriers";
+    default:
+        return "unknown";
+    }
+}
+
+const char* get_pipeline_counter_name(PipelineCounter counter) {
+    switch (counter) {
+    case PipelineCounter::VertexInvocations:
+        return "vertex_invocations";
+    case PipelineCounter::Primitives:
+        return "primitives";
+    case PipelineCounter::FragmentInvocations:
+        return "fragment_invocations";
+    default:
+        return "unknown";
+    }
+}
+
+// counters
+std::atomic<int64_t> FrameCounters::m_counters[FRAME_COUNTER_COUNT] = {};
+
+void FrameCounters::add(FrameCounter counter, int64_t count) {
+    m_counters[(int)counter] += count;
+}
+
+FrameCounts FrameCounters::take() {
+    FrameCounts counts;
+    for (int i = 0; i < FRAME_COUNTER_COUNT; ++i) {
+        counts.counters[i] = m_counters[i].exchange(0);
+    }
+    return counts;
+}
+
+// pipeline statistics
+PipelineStatistics::PipelineStatistics()
+    : m_supported(GLAD_GL_ARB_pipeline_statistics_query) {
+    if (m_supported) {
+        glGenQueries(QUERY_COUNT * PIPELINE_COUNTER_COUNT, &m_queries[0][0]);
+    }
+}
+
+PipelineStatistics::~PipelineStatistics() {
+    if (m_supported) {
+        glDeleteQueries(QUERY_COUNT * PIPELINE_COUNTER_COUNT,
+                        &m_queries[0][0]);
+    }
+}
+
+void PipelineStatistics::begin_frame() {
+    if (!m_supported) {
+        return;
+    }
+
+    int slot = m_frame % QUERY_COUNT;
+    if (m_pending[slot]) {
+        GLint available = 0;
+        glGetQueryObjectiv(m_queries[slot][PIPELINE_COUNTER_COUNT - 1],
+                           GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            for (int i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+                GLuint64 result;
+                glGetQueryObjectui64v(m_queries[slot][i], GL_QUERY_RESULT,
+                                      &result);
+                m_latest[i] = (int64_t)result;
+                m_totals[i] += (int64_t)result;
+            }
+            m_measured_frames++;
+            m_pending[slot] = false;
+        }
+    }
+
+    m_measuring = !m_pending[slot];
+    if (m_measuring) {
+        for (int i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+            glBeginQuery(PIPELINE_QUERY_TARGETS[i], m_queries[slot][i]);
+        }
+    }
+}
+
+void PipelineStatistics::end_frame() {
+    if (!m_supported) {
+        return;
+    }
+
+    int slot = m_frame % QUERY_COUNT;
+    if (m_measuring) {
+        for (int i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+            glEndQuery(PIPELINE_QUERY_TARGETS[i]);
+        }
+        m_pending[slot] = true;
+    }
+    ++m_frame;
+}
+
+bool PipelineStatistics::is_supported() const { return m_supported; }
+
+void PipelineStatistics::read(FrameCounts& counts) const {
+    for (int i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+        counts.pipeline[i] = m_latest[i];
+    }
+}
+
+double PipelineStatistics::get_average(PipelineCounter counter) const {
+    if (!m_supported || m_measured_frames == 0) {
+        return -1.0;
+    }
+    return (double)m_totals[(int)counter] / m_measured_frames;
+}
@@ -0,0 +1,117 @@
+#include "frame_pacing.hpp"
+#include "GLFW/glfw3.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// frame pacer
+FramePacer::FramePacer(double target_fps, double spin_margin)
+    : m_target_fps(target_fps), m_spin_margin(spin_margin) {}
+
+void FramePacer::set_target_fps(double target_fps) {
+    m_target_fps = target_fps;
+}
+
+double FramePacer::get_target_fps() const { return m_target_fps; }
+
+double FramePacer::wait() {
+    double now = glfwGetTime();
+    if (m_target_fps > 0.0) {
+        double period = 1.0 / m_target_fps;
+        m_deadline += period;
+        // after a hitch start over instead of rushing frames to catch up
+        if (m_deadline < now) {
+            m_deadline = now;
+        }
+
+        double remaining = m_deadline - now - m_spin_margin;
+        if (remaining > 0.0) {
+            std::this_thread::sleep_for(
+                std::chrono::duration<double>(remaining));
+        }
+        while (glfwGetTime() < m_deadline) {
+            std::this_thread::yield();
+        }
+        now = glfwGetTime();
+    } else {
+        m_deadline = now;
+    }
+
+    if (m_last_frame < 0.0) {
+        m_last_frame = now;
+        return m_delta_time;
+    }
+
+    m_raw_delta_time = now - m_last_frame;
+    m_last_frame = now;
+
+    double delta_time = std::min(m_raw_delta_time, MAX_DELTA_TIME);
+    if (m_delta_time == 0.0) {
+        m_delta_time = delta_time;
+    }
+    float deviation =
+        (float)std::abs(m_raw_delta_time - m_delta_time) * 1000.0f;
+    m_delta_time += (delta_time - m_delta_time) * 0.2;
+    m_jitter += (deviation - m_jitter) * 0.1f;
+    return m_delta_time;
+}
+
+double FramePacer::get_delta_time() const { return m_delta_time; }
+
+double FramePacer::get_raw_delta_time() const { return m_raw_delta_time; }
+
+float FramePacer::get_jitter() const { return m_jitter; }
+
+// present latency
+PresentLatency::PresentLatency() { glGenQueries(QUERY_COUNT, m_queries); }
+
+PresentLatency::~PresentLatency() { glDeleteQueries(QUERY_COUNT, m_queries); }
+
+void PresentLatency::record(double input_time) {
+    if (m_calibration_age++ >= CALIBRATION_INTERVAL) {
+        calibrate();
+    }
+
+    int slot = m_frame % QUERY_COUNT;
+    m_frame++;
+
+    if (m_pending[slot]) {
+        GLint available = 0;
+        glGetQueryObjectiv(m_queries[slot], GL_QUERY_RESULT_AVAILABLE,
+                           &available);
+        if (!available) {
+            // still in flight after QUERY_COUNT frames, drop the new sample
+            // rather than stall on the old one
+            return;
+        }
+
+        GLuint64 timestamp = 0;
+        glGetQueryObjectui64v(m_queries[slot], GL_QUERY_RESULT, &timestamp);
+        double present_time = timestamp * 1e-9 - m_clock_offset;
+        float latency =
+            (float)std::max(present_time - m_input_times[slot], 0.0) * 1000.0f;
+        m_latency = m_latency == 0.0f
+                        ? latency
+                        : m_latency + (latency - m_latency) * 0.1f;
+        m_pending[slot] = false;
+    }
+
+    if (input_time < 0.0) {
+        return;
+    }
+
+    glQueryCounter(m_queries[slot], GL_TIMESTAMP);
+    m_input_times[slot] = input_time;
+    m_pending[slot] = true;
+}
+
+float PresentLatency::get_latency() const { return m_latency; }
+
+void PresentLatency::calibrate() {
+    GLint64 gpu_time = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+    double cpu_time = glfwGetTime();
+    m_clock_offset = gpu_time * 1e-9 - cpu_time;
+    m_calibration_age = 0;
+}
@@ -0,0 +1,94 @@
+#include "frame_pipeline.hpp"
+#include "GLFW/glfw3.h"
+#include <utility>
+
+// draw data snapshot
+DrawDataSnapshot::~DrawDataSnapshot() { release(); }
+
+DrawDataSnapshot::DrawDataSnapshot(DrawDataSnapshot&& other) noexcept {
+    *this = std::move(other);
+}
+
+DrawDataSnapshot&
+DrawDataSnapshot::operator=(DrawDataSnapshot&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_draw_data = other.m_draw_data;
+        m_valid = other.m_valid;
+        // the lists now belong to this snapshot
+        other.m_draw_data.CmdLists.clear();
+        other.m_valid = false;
+    }
+    return *this;
+}
+
+void DrawDataSnapshot::capture(const ImDrawData* draw_data) {
+    release();
+    if (!draw_data || !draw_data->Valid) {
+        return;
+    }
+
+    m_draw_data = *draw_data;
+    m_draw_data.CmdLists.clear();
+    for (ImDrawList* list : draw_data->CmdLists) {
+        m_draw_data.CmdLists.push_back(list->CloneOutput());
+    }
+    m_valid = true;
+}
+
+ImDrawData* DrawDataSnapshot::get() { return m_valid ? &m_draw_data : nullptr; }
+
+void DrawDataSnapshot::release() {
+    for (ImDrawList* list : m_draw_data.CmdLists) {
+        IM_DELETE(list);
+    }
+    m_draw_data.CmdLists.clear();
+    m_valid = false;
+}
+
+// frame pipeline
+FramePipeline::FramePipeline(GLFWwindow* context, RenderFunction render)
+    : m_context(context), m_render(std::move(render)) {
+    glfwMakeContextCurrent(0);
+    m_thread = std::thread(&FramePipeline::run, this);
+}
+
+FramePipeline::~FramePipeline() { stop(); }
+
+void FramePipeline::submit(FramePacket packet) {
+    m_queue.push(std::move(packet));
+}
+
+void FramePipeline::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    FramePacket packet;
+    packet.quit = true;
+    m_queue.push(std::move(packet));
+    m_thread.join();
+    glfwMakeContextCurrent(m_context);
+}
+
+void FramePipeline::publish(const RenderStatistics& statistics) {
+    std::lock_guard<std::mutex> lock(m_statistics_mutex);
+    m_statistics = statistics;
+}
+
+RenderStatistics FramePipeline::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_statistics_mutex);
+    return m_statistics;
+}
+
+void FramePipeline::run() {
+    glfwMakeContextCurrent(m_context);
+    while (true) {
+        FramePacket packet = m_queue.pop();
+        if (packet.quit) {
+            break;
+        }
+        m_render(packet);
+    }
+    glfwMakeContextCurrent(0);
+}
@@ -0,0 +1,107 @@
+#include "gl_debug.hpp"
+
+#ifndef NDEBUG
+
+#include "GLFW/glfw3.h"
+#include <atomic>
+#include <iostream>
+
+// set by the main context, the upload context installs its own callback
+// but follows the same driver
+static std::atomic<bool> installed = false;
+
+static const char* get_source_name(GLenum source) {
+    switch (source) {
+    case GL_DEBUG_SOURCE_API:
+        return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+        return "WINDOW SYSTEM";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER:
+        return "SHADER COMPILER";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:
+        return "THIRD PARTY";
+    case GL_DEBUG_SOURCE_APPLICATION:
+        return "APPLICATION";
+    default:
+        return "OTHER";
+    }
+}
+
+static const char* get_type_name(GLenum type) {
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR:
+        return "ERROR";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+        return "DEPRECATED BEHAVIOR";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+        return "UNDEFINED BEHAVIOR";
+    case GL_DEBUG_TYPE_PORTABILITY:
+        return "PORTABILITY";
+    case GL_DEBUG_TYPE_PERFORMANCE:
+        return "PERFORMANCE";
+    default:
+        return "OTHER";
+    }
+}
+
+// runs on whatever thread the driver reports from, possibly long after the
+// call that caused it
+static void GLAPIENTRY debug_callback(GLenum source, GLenum type, GLuint id,
+                                      GLenum severity, GLsizei length,
+                                      const GLchar* message,
+                                      const void* user_parameter) {
+    (void)length;
+    (void)user_parameter;
+    if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP) {
+        return;
+    }
+    const char* level = severity == GL_DEBUG_SEVERITY_HIGH     ? "HIGH"
+                        : severity == GL_DEBUG_SEVERITY_MEDIUM ? "MEDIUM"
+                                                               : "LOW";
+    std::cerr << "GL " << get_type_name(type) << " (" << level << ", "
+              << get_source_name(source) << " " << id << "): " << message
+              << std::endl;
+}
+
+void gl_debug_request_context() {
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+}
+
+bool gl_debug_install() {
+    if (!GLAD_GL_VERSION_4_3 && !GLAD_GL_KHR_debug) {
+        std::cerr << "KHR_DEBUG NOT AVAILABLE, FALLING BACK TO GLGETERROR"
+                  << std::endl;
+        return false;
+    }
+
+    // asynchronous, GL_DEBUG_OUTPUT_SYNCHRONOUS would serialize the driver
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(debug_callback, nullptr);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                          GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr,
+                          GL_FALSE);
+    installed = true;
+    return true;
+}
+
+bool gl_debug_is_installed() { return installed; }
+
+void gl_debug_label(GLenum identifier, GLuint name, const std::string& label) {
+    if (installed && name) {
+        glObjectLabel(identifier, name, (GLsizei)label.size(), label.c_str());
+    }
+}
+
+void gl_debug_push_group(const char* name) {
+    if (installed) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+    }
+}
+
+void gl_debug_pop_group() {
+    if (installed) {
+        glPopDebugGroup();
+    }
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include "gpu_memory.hpp"
+#include "glm/common.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+std::atomic<int64_t> MemoryTracker::m_bytes[MEMORY_CATEGORY_COUNT] = {};
+std::atomic<int64_t> MemoryTracker::m_total = 0;
+std::atomic<int64_t> MemoryTracker::m_peak = 0;
+std::atomic<size_t> MemoryTracker::m_budget = 0;
+std::atomic<int> MemoryTracker::m_evictions = 0;
+std::atomic<bool> MemoryTracker::m_drop_mesh_copies = false;
+
+const char* get_memory_category_name(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Texture:
+        return "texture";
+    case MemoryCategory::RenderTarget:
+        return "render_target";
+    case MemoryCategory::Geometry:
+        return "geometry";
+    case MemoryCategory::Buffer:
+        return "buffer";
+    case MemoryCategory::Instances:
+        return "instances";
+    case MemoryCategory::Staging:
+        return "staging";
+    case MemoryCategory::MeshCopy:
+        return "mesh_copy";
+    default:
+        return "unknown";
+    }
+}
+
+size_t get_texture_bytes(GLenum internal_format, const glm::ivec2& size,
+                         int levels) {
+    // block compressed formats store 4x4 texels per block
+    size_t block_size = 0;
+    size_t texel_size = 4;
+    switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        block_size = 8;
+        break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        block_size = 16;
+        break;
+    case GL_R8:
+    case GL_RED:
+        texel_size = 1;
+        break;
+    case GL_R16:
+    case GL_R16F:
+    case GL_RG8:
+    case GL_RG:
+        texel_size = 2;
+        break;
+    case GL_RGBA16F:
+    case GL_RGB16F:
+    case GL_RG32UI:
+        texel_size = 8;
+        break;
+    case GL_RGBA32F:
+        texel_size = 16;
+        break;
+    default:
+        // rgb8 is padded to four bytes by every driver we run on
+        texel_size = 4;
+        break;
+    }
+
+    size_t bytes = 0;
+    glm::ivec2 level_size = size;
+    for (int level = 0; levels == 0 || level < levels; ++level) {
+        if (block_size) {
+            bytes += (size_t)((level_size.x + 3) / 4) *
+                     ((level_size.y + 3) / 4) * block_size;
+        } else {
+            bytes += (size_t)level_size.x * level_size.y * texel_size;
+        }
+        if (level_size.x <= 1 && level_size.y <= 1) {
+            break;
+        }
+        level_size = glm::max(level_size / 2, glm::ivec2(1));
+    }
+    return bytes;
+}
+
+// allocation
+GpuAllocation::GpuAllocation(MemoryCategory category)
+    : m_category(category) {}
+
+GpuAllocation::~GpuAllocation() { resize(0); }
+
+GpuAllocation::GpuAllocation(const GpuAllocation& other)
+    : m_category(other.m_category) {
+    resize(other.m_size);
+}
+
+GpuAllocation& GpuAllocation::operator=(const GpuAllocation& other) {
+    if (this != &other) {
+        resize(0);
+        m_category = other.m_category;
+        resize(other.m_size);
+    }
+    return *this;
+}
+
+void GpuAllocation::resize(size_t size) {
+    MemoryTracker::add(m_category, (int64_t)size - (int64_t)m_size);
+    m_size = size;
+}
+
+size_t GpuAllocation::get_size() const { return m_size; }
+
+// tracker
+void MemoryTracker::add(MemoryCategory category, int64_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    m_bytes[(int)category] += bytes;
+    if (category == MemoryCategory::MeshCopy) {
+        return;
+    }
+
+    int64_t total = m_total += bytes;
+    int64_t peak = m_peak;
+    while (total > peak && !m_peak.compare_exchange_weak(peak, total)) {
+    }
+}
+
+void MemoryTracker::set_budget(size_t bytes) { m_budget = bytes; }
+
+size_t MemoryTracker::get_budget() { return m_budget; }
+
+size_t MemoryTracker::get_total() {
+    return (size_t)std::max<int64_t>(m_total, 0);
+}
+
+size_t MemoryTracker::get_overflow() {
+    size_t budget = m_budget;
+    size_t total = get_total();
+    return budget && total > budget ? total - budget : 0;
+}
+
+void MemoryTracker::count_eviction() { m_evictions++; }
+
+void MemoryTracker::set_drop_mesh_copies(bool drop) {
+    m_drop_mesh_copies = drop;
+}
+
+bool MemoryTracker::get_drop_mesh_copies() { return m_drop_mesh_copies; }
+
+MemoryStatistics MemoryTracker::get_statistics() {
+    MemoryStatistics statistics;
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+        statistics.bytes[i] = (size_t)std::max<int64_t>(m_bytes[i], 0);
+    }
+    statistics.total = get_total();
+    statistics.peak = (size_t)std::max<int64_t>(m_peak, 0);
+    statistics.budget = m_budget;
+    statistics.evictions = m_evictions;
+    return statistics;
+}
+
+bool MemoryTracker::write_statistics(const std::filesystem::path& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "FAILED TO OPEN MEMORY STATISTICS: " << path << std::endl;
+        return false;
+    }
+
+    MemoryStatistics statistics = get_statistics();
+    file << "{\n";
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+        file << "  \"" << get_memory_category_name((MemoryCategory)i)
+             << "\": " << statistics.bytes[i] << ",\n";
+    }
+    file << "  \"total\": " << statistics.total << ",\n";
+    file << "  \"peak\": " << statistics.peak << ",\n";
+    file << "  \"budget\": " << statistics.budget << ",\n";
+    file << "  \"evictions\": " << statistics.evictions << "\n";
+    file << "}\n";
+    return true;
+}
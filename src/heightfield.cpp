@@ -0,0 +1,372 @@
+#include "heightfield.hpp"
+#include "glm/geometric.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static bool intersect_box(const glm::vec3& origin, const glm::vec3& direction,
+                          const glm::vec3& low, const glm::vec3& high,
+                          float& t_enter, float& t_exit) {
+    t_enter = 0.0f;
+    t_exit = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+        if (std::abs(direction[axis]) < 1e-8f) {
+            if (origin[axis] < low[axis] || origin[axis] > high[axis]) {
+                return false;
+            }
+            continue;
+        }
+        float inverse = 1.0f / direction[axis];
+        float t0 = (low[axis] - origin[axis]) * inverse;
+        float t1 = (high[axis] - origin[axis]) * inverse;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        t_enter = std::max(t_enter, t0);
+        t_exit = std::min(t_exit, t1);
+        if (t_enter > t_exit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool intersect_triangle(const glm::vec3& origin,
+                               const glm::vec3& direction, const glm::vec3& a,
+                               const glm::vec3& b, const glm::vec3& c,
+                               float& t) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 p = glm::cross(direction, ac);
+    float determinant = glm::dot(ab, p);
+    if (std::abs(determinant) < 1e-8f) {
+        return false;
+    }
+
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = origin - a;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    glm::vec3 q = glm::cross(s, ab);
+    float v = glm::dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+
+    t = glm::dot(ac, q) * inverse;
+    return t >= 0.0f;
+}
+
+// heightfield
+Heightfield::Heightfield(const glm::vec2& origin, int resolution,
+                         float spacing)
+    : m_origin(origin), m_resolution(resolution), m_spacing(spacing),
+      m_samples((resolution + 1) * (resolution + 1), 0.0f) {}
+
+void Heightfield::set_height(int x, int z, float height) {
+    m_samples[x + (m_resolution + 1) * z] = height;
+}
+
+float Heightfield::get_height(int x, int z) const {
+    return m_samples[x + (m_resolution + 1) * z];
+}
+
+void Heightfield::build_pyramid() {
+    m_pyramid.clear();
+    m_level_size.clear();
+    int level_count = 1;
+    for (int size = m_resolution; size > 1; size = (size + 1) / 2) {
+        level_count++;
+    }
+    m_pyramid.reserve(level_count);
+    m_level_size.reserve(level_count);
+
+    std::vector<glm::vec2> cells(m_resolution * m_resolution);
+    for (int z = 0; z < m_resolution; ++z) {
+        for (int x = 0; x < m_resolution; ++x) {
+            float h0 = get_height(x, z);
+            float h1 = get_height(x + 1, z);
+            float h2 = get_height(x, z + 1);
+            float h3 = get_height(x + 1, z + 1);
+            cells[x + m_resolution * z] =
+                glm::vec2(std::min({h0, h1, h2, h3}), std::max({h0, h1, h2, h3}));
+        }
+    }
+    m_pyramid.push_back(std::move(cells));
+    m_level_size.push_back(m_resolution);
+
+    while (m_level_size.back() > 1) {
+        const std::vector<glm::vec2>& below = m_pyramid.back();
+        int below_size = m_level_size.back();
+        int size = (below_size + 1) / 2;
+
+        std::vector<glm::vec2> level(size * size,
+                                     glm::vec2(std::numeric_limits<float>::max(),
+                                               -std::numeric_limits<float>::max()));
+        for (int z = 0; z < below_size; ++z) {
+            for (int x = 0; x < below_size; ++x) {
+                glm::vec2& node = level[x / 2 + size * (z / 2)];
+                const glm::vec2& child = below[x + below_size * z];
+                node.x = std::min(node.x, child.x);
+                node.y = std::max(node.y, child.y);
+            }
+        }
+        m_pyramid.push_back(std::move(level));
+        m_level_size.push_back(size);
+    }
+}
+
+int Heightfield::get_allocation_count() const {
+    return 1 + (m_pyramid.capacity() > 0) + (m_level_size.capacity() > 0) +
+           (int)m_pyramid.size();
+}
+
+glm::vec2 Heightfield::to_local(float x, float z) const {
+    glm::vec2 local = (glm::vec2(x, z) - m_origin) / m_spacing;
+    return glm::clamp(local, 0.0f, (float)m_resolution);
+}
+
+float Heightfield::height_at(float x, float z) const {
+    glm::vec2 local = to_local(x, z);
+    int i = std::min((int)local.x, m_resolution - 1);
+    int j = std::min((int)local.y, m_resolution - 1);
+    float fx = local.x - i;
+    float fz = local.y - j;
+
+    float h0 = get_height(i, j);
+    float h1 = get_height(i + 1, j);
+    float h2 = get_height(i, j + 1);
+    float h3 = get_height(i + 1, j + 1);
+    return (h0 * (1.0f - fx) + h1 * fx) * (1.0f - fz) +
+           (h2 * (1.0f - fx) + h3 * fx) * fz;
+}
+
+glm::vec3 Heightfield::normal_at(float x, float z) const {
+    glm::vec2 local = to_local(x, z);
+    int i = std::min((int)local.x, m_resolution - 1);
+    int j = std::min((int)local.y, m_resolution - 1);
+    float fx = local.x - i;
+    float fz = local.y - j;
+
+    float h0 = get_height(i, j);
+    float h1 = get_height(i + 1, j);
+    float h2 = get_height(i, j + 1);
+    float h3 = get_height(i + 1, j + 1);
+
+    // gradient of the bilinear patch
+    float dx = ((h1 - h0) * (1.0f - fz) + (h3 - h2) * fz) / m_spacing;
+    float dz = ((h2 - h0) * (1.0f - fx) + (h3 - h1) * fx) / m_spacing;
+    return glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+}
+
+bool Heightfield::raycast(const glm::vec3& origin, const glm::vec3& direction,
+                          float max_distance, RayHit& hit) const {
+    if (m_pyramid.empty()) {
+        return false;
+    }
+    hit.distance = max_distance;
+    return intersect_node(origin, direction, max_distance,
+                          m_pyramid.size() - 1, 0, 0, hit);
+}
+
+bool Heightfield::intersect_node(const glm::vec3& origin,
+                                 const glm::vec3& direction,
+                                 float max_distance, int level, int i, int j,
+                                 RayHit& hit) const {
+    if (level == 0) {
+        return intersect_cell(origin, direction, max_distance, i, j, hit);
+    }
+
+    struct Child {
+        int i;
+        int j;
+        float t;
+    };
+    Child children[4];
+    int count = 0;
+
+    int below = level - 1;
+    int below_size = m_level_size[below];
+    int span = 1 << below;
+    for (int cj = j * 2; cj <= j * 2 + 1 && cj < below_size; ++cj) {
+        for (int ci = i * 2; ci <= i * 2 + 1 && ci < below_size; ++ci) {
+            const glm::vec2& bounds = m_pyramid[below][ci + below_size * cj];
+            glm::vec2 low = m_origin + glm::vec2(ci, cj) * (float)span * m_spacing;
+            glm::vec2 high =
+                m_origin + glm::vec2(std::min((ci + 1) * span, m_resolution),
+                                     std::min((cj + 1) * span, m_resolution)) *
+                               m_spacing;
+
+            float t_enter;
+            float t_exit;
+            if (intersect_box(origin, direction,
+                              glm::vec3(low.x, bounds.x, low.y),
+                              glm::vec3(high.x, bounds.y, high.y), t_enter,
+                              t_exit) &&
+                t_enter <= max_distance) {
+                children[count++] = {ci, cj, t_enter};
+            }
+        }
+    }
+
+    std::sort(children, children + count,
+              [](const Child& a, const Child& b) { return a.t < b.t; });
+
+    bool found = false;
+    for (int c = 0; c < count; ++c) {
+        if (found && children[c].t > hit.distance) {
+            break;
+        }
+        if (intersect_node(origin, direction,
+                           found ? hit.distance : max_distance, below,
+                           children[c].i, children[c].j, hit)) {
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool Heightfield::intersect_cell(const glm::vec3& origin,
+                                 const glm::vec3& direction,
+                                 float max_distance, int i, int j,
+                                 RayHit& hit) const {
+    auto corner = [this](int x, int z) {
+        return glm::vec3(m_origin.x + x * m_spacing, get_height(x, z),
+                         m_origin.y + z * m_spacing);
+    };
+    glm::vec3 a = corner(i, j);
+    glm::vec3 b = corner(i + 1, j);
+    glm::vec3 c = corner(i, j + 1);
+    glm::vec3 d = corner(i + 1, j + 1);
+
+    // same split as the ground mesh
+    float t0 = std::numeric_limits<float>::max();
+    float t1 = std::numeric_limits<float>::max();
+    bool first = intersect_triangle(origin, direction, a, b, c, t0);
+    bool second = intersect_triangle(origin, direction, b, d, c, t1);
+    if (!first && !second) {
+        return false;
+    }
+
+    float t = std::min(t0, t1);
+    if (t > max_distance) {
+        return false;
+    }
+
+    glm::vec3 normal = t0 < t1 ? glm::cross(c - a, b - a)
+                               : glm::cross(c - b, d - b);
+    hit.distance = t;
+    hit.position = origin + direction * t;
+    hit.normal = glm::normalize(normal);
+    return true;
+}
+
+glm::vec2 Heightfield::get_origin() const { return m_origin; }
+
+int Heightfield::get_resolution() const { return m_resolution; }
+
+float Heightfield::get_min_height() const {
+    return m_pyramid.empty() ? 0.0f : m_pyramid.back()[0].x;
+}
+
+float Heightfield::get_max_height() const {
+    return m_pyramid.empty() ? 0.0f : m_pyramid.back()[0].y;
+}
+
+const std::vector<float>& Heightfield::get_samples() const {
+    return m_samples;
+}
+
+// heightfield store
+HeightfieldStore::HeightfieldStore(int chunk_size) : m_chunk_size(chunk_size) {}
+
+int64_t HeightfieldStore::key(const glm::ivec2& chunk) {
+    return ((int64_t)chunk.x << 32) | (uint32_t)chunk.y;
+}
+
+void HeightfieldStore::insert(const glm::ivec2& chunk,
+                              std::shared_ptr<const Heightfield> heightfield) {
+    m_chunks[key(chunk)] = heightfield;
+}
+
+void HeightfieldStore::remove(const glm::ivec2& chunk) {
+    m_chunks.erase(key(chunk));
+}
+
+const Heightfield* HeightfieldStore::find_chunk(const glm::ivec2& chunk) const {
+    auto it = m_chunks.find(key(chunk));
+    return it == m_chunks.end() ? nullptr : it->second.get();
+}
+
+const Heightfield* HeightfieldStore::find(float x, float z) const {
+    return find_chunk(glm::ivec2((int)std::floor(x / m_chunk_size),
+                                 (int)std::floor(z / m_chunk_size)));
+}
+
+bool HeightfieldStore::contains(float x, float z) const {
+    return find(x, z) != nullptr;
+}
+
+float HeightfieldStore::height_at(float x, float z) const {
+    const Heightfield* heightfield = find(x, z);
+    return heightfield ? heightfield->height_at(x, z) : 0.0f;
+}
+
+glm::vec3 HeightfieldStore::normal_at(float x, float z) const {
+    const Heightfield* heightfield = find(x, z);
+    return heightfield ? heightfield->normal_at(x, z)
+                       : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+bool HeightfieldStore::raycast(const glm::vec3& origin,
+                               const glm::vec3& direction, float max_distance,
+                               RayHit& hit) const {
+    // walk the chunk grid along the ray, chunks do not overlap so the first
+    // hit is the nearest
+    glm::vec2 position(origin.x, origin.z);
+    glm::vec2 step_direction(direction.x, direction.z);
+    glm::ivec2 cell((int)std::floor(position.x / m_chunk_size),
+                    (int)std::floor(position.y / m_chunk_size));
+
+    glm::ivec2 step;
+    glm::vec2 t_max;
+    glm::vec2 t_delta;
+    for (int axis = 0; axis < 2; ++axis) {
+        if (std::abs(step_direction[axis]) < 1e-8f) {
+            step[axis] = 0;
+            t_max[axis] = std::numeric_limits<float>::max();
+            t_delta[axis] = std::numeric_limits<float>::max();
+            continue;
+        }
+        step[axis] = step_direction[axis] > 0.0f ? 1 : -1;
+        float boundary = (cell[axis] + (step[axis] > 0 ? 1 : 0)) *
+                         (float)m_chunk_size;
+        t_max[axis] = (boundary - position[axis]) / step_direction[axis];
+        t_delta[axis] = m_chunk_size / std::abs(step_direction[axis]);
+    }
+
+    float t = 0.0f;
+    while (t <= max_distance) {
+        const Heightfield* heightfield = find_chunk(cell);
+        if (heightfield &&
+            heightfield->raycast(origin, direction, max_distance, hit)) {
+            return true;
+        }
+
+        if (step.x == 0 && step.y == 0) {
+            break;
+        }
+        if (t_max.x < t_max.y) {
+            t = t_max.x;
+            t_max.x += t_delta.x;
+            cell.x += step.x;
+        } else {
+            t = t_max.y;
+            t_max.y += t_delta.y;
+            cell.y += step.y;
+        }
+    }
+    return false;
+}
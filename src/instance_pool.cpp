@@ -0,0 +1,160 @@
+#include "instance_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+
+// instance buffer
+InstanceBuffer::InstanceBuffer(size_t capacity, size_t stride)
+    : m_capacity(capacity), m_allocation(MemoryCategory::Instances),
+      m_order_allocation(MemoryCategory::Instances) {
+    glGenBuffers(1, &m_id);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, m_capacity * stride, nullptr, 0);
+    m_allocation.resize(m_capacity * stride);
+
+    glGenBuffers(1, &m_order);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_order);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, m_capacity * sizeof(uint32_t),
+                    nullptr, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_order_allocation.resize(m_capacity * sizeof(uint32_t));
+
+    m_free.push_back({0, m_capacity});
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    glDeleteBuffers(1, &m_id);
+    glDeleteBuffers(1, &m_order);
+}
+
+size_t InstanceBuffer::acquire(size_t count) {
+    // first fit keeps the used runs packed at the front
+    for (size_t i = 0; i < m_free.size(); ++i) {
+        auto& [first, free_count] = m_free[i];
+        if (free_count < count) {
+            continue;
+        }
+        size_t result = first;
+        first += count;
+        free_count -= count;
+        if (free_count == 0) {
+            m_free.erase(m_free.begin() + i);
+        }
+        m_used += count;
+        return result;
+    }
+    return npos;
+}
+
+void InstanceBuffer::release(size_t first, size_t count) {
+    m_used -= count;
+
+    auto next = std::upper_bound(
+        m_free.begin(), m_free.end(), first,
+        [](size_t first, const std::pair<size_t, size_t>& run) {
+            return first < run.first;
+        });
+    next = m_free.insert(next, {first, count});
+
+    // merge with the neighbouring runs
+    if (next + 1 != m_free.end() &&
+        next->first + next->second == (next + 1)->first) {
+        next->second += (next + 1)->second;
+        m_free.erase(next + 1);
+    }
+    if (next != m_free.begin() &&
+        (next - 1)->first + (next - 1)->second == next->first) {
+        (next - 1)->second += next->second;
+        m_free.erase(next);
+    }
+}
+
+GLuint InstanceBuffer::get_id() const { return m_id; }
+
+GLuint InstanceBuffer::get_order_id() const { return m_order; }
+
+size_t InstanceBuffer::get_capacity() const { return m_capacity; }
+
+size_t InstanceBuffer::get_used_count() const { return m_used; }
+
+// instance range
+InstanceRange::InstanceRange(std::shared_ptr<InstanceBuffer> buffer,
+                             size_t first, size_t count)
+    : m_buffer(std::move(buffer)), m_first(first), m_count(count) {}
+
+InstanceRange::~InstanceRange() { reset(); }
+
+InstanceRange::InstanceRange(InstanceRange&& other)
+    : m_buffer(std::move(other.m_buffer)), m_first(other.m_first),
+      m_count(other.m_count) {
+    other.m_count = 0;
+}
+
+InstanceRange& InstanceRange::operator=(InstanceRange&& other) {
+    if (this != &other) {
+        reset();
+        m_buffer = std::move(other.m_buffer);
+        m_first = other.m_first;
+        m_count = other.m_count;
+        other.m_count = 0;
+    }
+    return *this;
+}
+
+void InstanceRange::reset() {
+    if (m_buffer) {
+        m_buffer->release(m_first, m_count);
+    }
+    m_buffer.reset();
+    m_first = 0;
+    m_count = 0;
+}
+
+bool InstanceRange::is_valid() const { return m_buffer != nullptr; }
+
+const InstanceBuffer& InstanceRange::get_buffer() const { return *m_buffer; }
+
+size_t InstanceRange::get_first() const { return m_first; }
+
+size_t InstanceRange::get_count() const { return m_count; }
+
+// pool
+InstanceBufferPool::InstanceBufferPool(size_t stride,
+                                       size_t instances_per_buffer)
+    : m_stride(stride), m_instances_per_buffer(instances_per_buffer) {}
+
+InstanceRange InstanceBufferPool::acquire(size_t count) {
+    for (std::shared_ptr<InstanceBuffer>& buffer : m_buffers) {
+        size_t first = buffer->acquire(count);
+        if (first != InstanceBuffer::npos) {
+            return InstanceRange(buffer, first, count);
+        }
+    }
+
+    // a chunk denser than a whole buffer gets one of its own
+    std::shared_ptr<InstanceBuffer> buffer = std::make_shared<InstanceBuffer>(
+        std::max(count, m_instances_per_buffer), m_stride);
+    m_buffers.push_back(buffer);
+    m_idle_trims.push_back(0);
+    return InstanceRange(buffer, buffer->acquire(count), count);
+}
+
+void InstanceBufferPool::trim(int idle_trims) {
+    size_t kept = 0;
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+        int idle =
+            m_buffers[i]->get_used_count() == 0 ? m_idle_trims[i] + 1 : 0;
+        if (idle > idle_trims) {
+            continue;
+        }
+        m_buffers[kept] = std::move(m_buffers[i]);
+        m_idle_trims[kept] = idle;
+        kept++;
+    }
+    m_buffers.resize(kept);
+    m_idle_trims.resize(kept);
+}
+
+const std::vector<std::shared_ptr<InstanceBuffer>>&
+InstanceBufferPool::get_buffers() const {
+    return m_buffers;
+}
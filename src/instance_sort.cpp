@@ -0,0 +1,91 @@
+#include "instance_sort.hpp"
+
+InstanceSort::InstanceSort(Shader& sort, float resort_distance)
+    : m_sort(sort), m_resort_distance(resort_distance) {
+    glGenBuffers(2, m_counters);
+    for (GLuint counter : m_counters) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), nullptr,
+                     GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+InstanceSort::~InstanceSort() {
+    for (GLsync fence : m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    glDeleteBuffers(2, m_counters);
+}
+
+void InstanceSort::set_enabled(bool enabled) { m_enabled = enabled; }
+
+void InstanceSort::set_counting(bool counting) { m_counting = counting; }
+
+void InstanceSort::update(const std::vector<std::shared_ptr<Chunk>>& chunks,
+                          const glm::vec3& eye, float range) {
+    m_statistics.sorted_chunks = 0;
+    if (!m_enabled) {
+        return;
+    }
+
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        if (chunk->sort_instances(m_sort, eye, range, m_resort_distance)) {
+            m_statistics.sorted_chunks++;
+        }
+    }
+}
+
+void InstanceSort::begin_draw(std::initializer_list<Shader*> shaders) {
+    int slot = m_frame % 2;
+    bool sorted = m_enabled && !(m_counting && slot == 1);
+    for (Shader* shader : shaders) {
+        shader->set_uniform_int("sorted_instances", sorted);
+        shader->set_uniform_int("count_fragments", m_counting);
+    }
+
+    // the frame that used this counter is two frames old, so the wait is
+    // normally over at once
+    GLsync& fence = m_fences[slot];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counters[slot]);
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+
+        uint32_t count = 0;
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t),
+                           &count);
+        if (m_counted_sorted[slot]) {
+            m_statistics.sorted_fragments = count;
+        } else {
+            m_statistics.unsorted_fragments = count;
+        }
+    }
+
+    if (m_counting) {
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                          GL_UNSIGNED_INT, nullptr);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FRAGMENT_COUNTER_BINDING,
+                         m_counters[slot]);
+        m_counted_sorted[slot] = sorted;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void InstanceSort::end_draw() {
+    if (m_counting) {
+        // the counter is read with glGetBufferSubData after the fence
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        FrameCounters::add(FrameCounter::Barriers);
+        m_fences[m_frame % 2] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FRAGMENT_COUNTER_BINDING, 0);
+    }
+    m_frame++;
+}
+
+InstanceSortStatistics InstanceSort::get_statistics() const {
+    return m_statistics;
+}
@@ -1,8 +1,109 @@
 #include "mesh.hpp"
+#include "frame_counters.hpp"
+#include "gl_debug.hpp"
+#include "upload.hpp"
+#include <cstring>
+
+Mesh::Mesh()
+    : m_allocation(MemoryCategory::Geometry),
+      m_copy_allocation(MemoryCategory::MeshCopy) {}
 
 void Mesh::set(std::vector<Vertex>& vertices, std::vector<int>& indices) {
     m_vertices = std::move(vertices);
     m_indices = std::move(indices);
+    upload();
+}
+
+void Mesh::set(std::span<const Vertex> vertices, std::span<const int> indices) {
+    m_vertices.assign(vertices.begin(), vertices.end());
+    m_indices.assign(indices.begin(), indices.end());
+    upload();
+}
+
+std::shared_ptr<const UploadTicket> Mesh::set_async(UploadService& uploads,
+                                                    std::vector<Vertex>& vertices,
+                                                    std::vector<int>& indices) {
+    m_vertices = std::move(vertices);
+    m_indices = std::move(indices);
+    return upload_async(uploads);
+}
+
+std::shared_ptr<const UploadTicket>
+Mesh::set_async(UploadService& uploads, std::span<const Vertex> vertices,
+                std::span<const int> indices) {
+    m_vertices.assign(vertices.begin(), vertices.end());
+    m_indices.assign(indices.begin(), indices.end());
+    return upload_async(uploads);
+}
+
+void Mesh::allocate(int vertex_count, int index_count) {
+    m_vertices.clear();
+    m_indices.clear();
+    m_index_count = index_count;
+    create_vertex_array();
+
+    glBindVertexArray(m_vertex_array);
+    glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(Vertex), nullptr,
+                 GL_DYNAMIC_COPY);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(int), nullptr,
+                 GL_DYNAMIC_COPY);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_allocation.resize(vertex_count * sizeof(Vertex) +
+                        index_count * sizeof(int));
+    m_copy_allocation.resize(0);
+}
+
+void Mesh::upload() {
+    m_index_count = m_indices.size();
+    create_vertex_array();
+
+    glBindVertexArray(m_vertex_array);
+    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex),
+                 m_vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(int),
+                 m_indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    track();
+    FrameCounters::add(FrameCounter::UploadedBytes,
+                       m_vertices.size() * sizeof(Vertex) +
+                           m_indices.size() * sizeof(int));
+}
+
+std::shared_ptr<const UploadTicket> Mesh::upload_async(UploadService& uploads) {
+    m_index_count = m_indices.size();
+    create_vertex_array();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    std::vector<uint8_t> vertex_data(m_vertices.size() * sizeof(Vertex));
+    std::memcpy(vertex_data.data(), m_vertices.data(), vertex_data.size());
+    std::vector<uint8_t> index_data(m_indices.size() * sizeof(int));
+    std::memcpy(index_data.data(), m_indices.data(), index_data.size());
+
+    track();
+
+    // jobs complete in order, the second ticket covers both buffers
+    uploads.upload_buffer(m_vertex_buffer, GL_STATIC_DRAW,
+                          std::move(vertex_data));
+    return uploads.upload_buffer(m_element_buffer, GL_STATIC_DRAW,
+                                 std::move(index_data));
+}
+
+void Mesh::track() {
+    size_t size = m_vertices.size() * sizeof(Vertex) +
+                  m_indices.size() * sizeof(int);
+    m_allocation.resize(size);
+    m_copy_allocation.resize(size);
+}
+
+void Mesh::release_copies() {
+    m_vertices = std::vector<Vertex>();
+    m_indices = std::vector<int>();
+    m_copy_allocation.resize(0);
+}
+
+void Mesh::create_vertex_array() {
     glGenVertexArrays(1, &m_vertex_array);
     glBindVertexArray(m_vertex_array);
 
@@ -22,19 +123,10 @@ void Mesh::set(std::vector<Vertex>& vertices, std::vector<int>& indices) {
                           (void*)(2 * sizeof(glm::vec3) + sizeof(glm::vec2)));
     glEnableVertexAttribArray(3);
 
-    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex),
-                 m_vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    // element buffer
+    // element buffer, stays bound to the vertex array
     glGenBuffers(1, &m_element_buffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_element_buffer);
 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(int),
-                 m_indices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
     glBindVertexArray(0);
 }
 
@@ -44,16 +136,26 @@ Mesh::~Mesh() {
     glDeleteVertexArrays(1, &m_vertex_array);
 }
 
+void Mesh::set_label(const std::string& label) const {
+    gl_debug_label(GL_VERTEX_ARRAY, m_vertex_array, label);
+    gl_debug_label(GL_BUFFER, m_vertex_buffer, label + " vertices");
+    gl_debug_label(GL_BUFFER, m_element_buffer, label + " indices");
+}
+
 GLuint Mesh::get_vertex_array_id() const { return m_vertex_array; }
 
 GLuint Mesh::get_vertex_buffer_id() const { return m_vertex_buffer; }
 
+GLuint Mesh::get_element_buffer_id() const { return m_element_buffer; }
+
 const std::vector<Vertex>& Mesh::get_vertices() const { return m_vertices; }
 
 const std::vector<int>& Mesh::get_indices() const { return m_indices; }
 
+int Mesh::get_index_count() const { return m_index_count; }
+
 std::shared_ptr<const Texture> Mesh::get_texture() const { return m_texture; }
 
 void Mesh::set_texture(std::shared_ptr<const Texture> texture) {
     m_texture = texture;
-}
\ No newline at end of file
+}
@@ -0,0 +1,488 @@
+#include "render_farm.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+static bool write_all(int socket, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t written = send(socket, bytes, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool read_all(int socket, void* data, size_t size) {
+    uint8_t* bytes = (uint8_t*)data;
+    while (size > 0) {
+        ssize_t count = recv(socket, bytes, size, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+static FarmMessage make_message(FarmMessageType type) {
+    FarmMessage message;
+    std::memset(&message, 0, sizeof(message));
+    message.type = type;
+    return message;
+}
+
+// render farm
+RenderFarm::RenderFarm(const FarmSettings& settings) : m_settings(settings) {
+    if (m_settings.worker_count <= 0) {
+        m_settings.worker_count =
+            std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_settings.tiles = std::max(m_settings.tiles, 1);
+    m_settings.frame_range = std::max(m_settings.frame_range, 1);
+    if (m_settings.split == FarmSplit::Tiles) {
+        m_tile_size = (m_settings.size + m_settings.tiles - 1) /
+                      m_settings.tiles;
+        m_tiles_per_frame = m_settings.tiles * m_settings.tiles;
+    } else {
+        m_tile_size = m_settings.size;
+        m_tiles_per_frame = 1;
+    }
+}
+
+bool RenderFarm::run() {
+    queue_tasks();
+
+    std::error_code error;
+    std::filesystem::create_directories(m_settings.directory, error);
+    if (error) {
+        std::cerr << "FAILED TO CREATE CAPTURE DIRECTORY: "
+                  << m_settings.directory << std::endl;
+        return false;
+    }
+
+    std::filesystem::path socket_path =
+        std::filesystem::temp_directory_path() /
+        ("grass_farm_" + std::to_string(getpid()) + ".sock");
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.string().size() >= sizeof(address.sun_path)) {
+        std::cerr << "FARM SOCKET PATH TOO LONG: " << socket_path << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listener < 0 ||
+        bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, m_settings.worker_count) != 0) {
+        std::cerr << "FAILED TO OPEN FARM SOCKET: " << socket_path << std::endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return false;
+    }
+
+    // llvmpipe rasterizes on one thread per core by default, split the cores
+    // between the workers instead of oversubscribing them
+    std::vector<std::string> environment;
+    bool has_thread_count = false;
+    for (char** variable = environ; *variable; ++variable) {
+        environment.push_back(*variable);
+        has_thread_count |=
+            environment.back().rfind("LP_NUM_THREADS=", 0) == 0;
+    }
+    if (!has_thread_count) {
+        int threads = std::max(1, (int)std::thread::hardware_concurrency() /
+                                      m_settings.worker_count);
+        environment.push_back("LP_NUM_THREADS=" + std::to_string(threads));
+    }
+    std::vector<char*> environment_pointers;
+    for (std::string& variable : environment) {
+        environment_pointers.push_back(variable.data());
+    }
+    environment_pointers.push_back(nullptr);
+
+    std::filesystem::path executable =
+        std::filesystem::read_symlink("/proc/self/exe", error);
+    if (error) {
+        executable = m_settings.executable;
+    }
+    std::vector<std::string> arguments = {executable.string(), "--farm-worker",
+                                          socket_path.string()};
+    arguments.insert(arguments.end(), m_settings.arguments.begin(),
+                     m_settings.arguments.end());
+    std::vector<char*> argument_pointers;
+    for (std::string& argument : arguments) {
+        argument_pointers.push_back(argument.data());
+    }
+    argument_pointers.push_back(nullptr);
+
+    int running = 0;
+    auto spawn = [&]() {
+        pid_t pid;
+        if (posix_spawn(&pid, executable.c_str(), nullptr, nullptr,
+                        argument_pointers.data(),
+                        environment_pointers.data()) != 0) {
+            std::cerr << "FAILED TO START FARM WORKER: " << executable
+                      << std::endl;
+            return;
+        }
+        running++;
+    };
+    for (int i = 0; i < m_settings.worker_count; ++i) {
+        spawn();
+    }
+    // replacements for workers that die once the others were told to quit
+    int respawns = m_settings.worker_count;
+
+    struct Connection {
+        int socket = -1;
+        // results arrive in task order, received counts those of the front
+        std::deque<FarmTask> tasks;
+        int received = 0;
+        bool waiting = false;
+        // sent done, takes no more tasks
+        bool done = false;
+    };
+    std::vector<Connection> connections;
+
+    FarmMessage hello = make_message(FarmMessageType::Hello);
+    hello.tile[2] = m_tile_size.x;
+    hello.tile[3] = m_tile_size.y;
+    hello.size[0] = m_settings.size.x;
+    hello.size[1] = m_settings.size.y;
+
+    auto send_task = [&](Connection& connection) {
+        FarmTask task = m_tasks.front();
+        m_tasks.pop_front();
+        FarmMessage message = make_message(FarmMessageType::Task);
+        message.frame = task.first_frame;
+        message.frame_count = task.frame_count;
+        for (int i = 0; i < 4; ++i) {
+            message.tile[i] = task.tile[i];
+        }
+        connection.tasks.push_back(task);
+        connection.waiting = false;
+        return write_all(connection.socket, &message, sizeof(message));
+    };
+
+    // hands the unfinished part of its tasks to the others, or to a new
+    // worker when all of them were already told to quit
+    auto drop = [&](size_t index) {
+        Connection& connection = connections[index];
+        for (size_t i = 0; i < connection.tasks.size(); ++i) {
+            FarmTask task = connection.tasks[i];
+            if (i == 0) {
+                task.first_frame += connection.received;
+                task.frame_count -= connection.received;
+            }
+            m_tasks.push_back(task);
+        }
+        if (!connection.tasks.empty()) {
+            std::cerr << "FARM WORKER LEFT WITH " << connection.tasks.size()
+                      << " TASKS IN FLIGHT" << std::endl;
+        }
+        bool requeued = !connection.tasks.empty();
+        close(connection.socket);
+        connections.erase(connections.begin() + index);
+
+        bool taker = std::any_of(
+            connections.begin(), connections.end(),
+            [](const Connection& connection) { return !connection.done; });
+        if (requeued && !taker && respawns > 0) {
+            respawns--;
+            spawn();
+        }
+    };
+
+    while (m_written < m_settings.frame_count) {
+        int status;
+        while (waitpid(-1, &status, WNOHANG) > 0) {
+            running--;
+        }
+        if (running <= 0 && connections.empty()) {
+            break;
+        }
+
+        // a second at most, so workers that die before connecting are seen
+        std::vector<pollfd> descriptors = {{listener, POLLIN, 0}};
+        for (const Connection& connection : connections) {
+            descriptors.push_back({connection.socket, POLLIN, 0});
+        }
+        if (poll(descriptors.data(), descriptors.size(), 1000) <= 0) {
+            continue;
+        }
+
+        for (size_t i = descriptors.size() - 1; i > 0; --i) {
+            if (!descriptors[i].revents) {
+                continue;
+            }
+            Connection& connection = connections[i - 1];
+            FarmMessage message;
+            if (!read_all(connection.socket, &message, sizeof(message))) {
+                drop(i - 1);
+                continue;
+            }
+
+            if (message.type == FarmMessageType::Request) {
+                connection.waiting = true;
+            } else if (message.type == FarmMessageType::Result) {
+                size_t tile_bytes = (size_t)m_tile_size.x * m_tile_size.y * 4;
+                std::vector<uint8_t> pixels(tile_bytes);
+                if (message.payload != tile_bytes ||
+                    connection.tasks.empty() ||
+                    !read_all(connection.socket, pixels.data(),
+                              pixels.size())) {
+                    std::cerr << "BAD FARM RESULT" << std::endl;
+                    drop(i - 1);
+                    continue;
+                }
+                gather(message.frame,
+                       glm::ivec4(message.tile[0], message.tile[1],
+                                  message.tile[2], message.tile[3]),
+                       pixels);
+                if (++connection.received ==
+                    connection.tasks.front().frame_count) {
+                    connection.tasks.pop_front();
+                    connection.received = 0;
+                }
+            }
+        }
+
+        if (descriptors[0].revents) {
+            int worker = accept(listener, nullptr, nullptr);
+            if (worker >= 0) {
+                if (write_all(worker, &hello, sizeof(hello))) {
+                    connections.emplace_back().socket = worker;
+                } else {
+                    close(worker);
+                }
+            }
+        }
+
+        // a worker holds back the captures of its last frames until it
+        // quits, so it is never kept waiting for tasks that may come back.
+        // those are left to the workers still asking
+        for (size_t i = connections.size(); i-- > 0;) {
+            Connection& connection = connections[i];
+            if (!connection.waiting) {
+                continue;
+            }
+            if (!m_tasks.empty()) {
+                if (!send_task(connection)) {
+                    drop(i);
+                }
+            } else {
+                FarmMessage done = make_message(FarmMessageType::Done);
+                write_all(connection.socket, &done, sizeof(done));
+                connection.waiting = false;
+                connection.done = true;
+            }
+        }
+    }
+
+    // the workers see the socket close and quit
+    for (Connection& connection : connections) {
+        FarmMessage done = make_message(FarmMessageType::Done);
+        write_all(connection.socket, &done, sizeof(done));
+        close(connection.socket);
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+    while (running > 0 && waitpid(-1, nullptr, 0) > 0) {
+        running--;
+    }
+
+    if (m_written < m_settings.frame_count) {
+        std::cerr << "FARM FINISHED " << m_written << " OF "
+                  << m_settings.frame_count << " FRAMES" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void RenderFarm::queue_tasks() {
+    int count = m_settings.frame_count;
+    if (m_settings.split == FarmSplit::Frames) {
+        for (int first = 0; first < count; first += m_settings.frame_range) {
+            int frames = std::min(m_settings.frame_range, count - first);
+            m_tasks.push_back({(uint64_t)first, frames,
+                               glm::ivec4(glm::ivec2(0), m_settings.size)});
+        }
+        return;
+    }
+
+    for (int frame = 0; frame < count; ++frame) {
+        for (int y = 0; y < m_settings.tiles; ++y) {
+            for (int x = 0; x < m_settings.tiles; ++x) {
+                m_tasks.push_back({(uint64_t)frame, 1,
+                                   glm::ivec4(glm::ivec2(x, y) * m_tile_size,
+                                              m_tile_size)});
+            }
+        }
+    }
+}
+
+void RenderFarm::gather(uint64_t frame, const glm::ivec4& tile,
+                        const std::vector<uint8_t>& pixels) {
+    glm::ivec2 size = m_settings.size;
+    Assembly& assembly = m_frames[frame];
+    if (assembly.pixels.empty()) {
+        assembly.pixels.resize((size_t)size.x * size.y * 4);
+        assembly.remaining = m_tiles_per_frame;
+    }
+
+    // the last row and column of tiles reach past the image
+    int width = std::min(tile.z, size.x - tile.x);
+    int height = std::min(tile.w, size.y - tile.y);
+    for (int row = 0; row < height; ++row) {
+        std::memcpy(&assembly.pixels[((size_t)(tile.y + row) * size.x +
+                                      tile.x) * 4],
+                    &pixels[(size_t)row * tile.z * 4], (size_t)width * 4);
+    }
+
+    if (--assembly.remaining == 0) {
+        write_image(m_settings.directory /
+                        get_capture_file_name(frame, m_settings.format),
+                    assembly.pixels.data(), size, m_settings.format);
+        m_frames.erase(frame);
+        m_written++;
+    }
+}
+
+// farm worker
+FarmWorker::FarmWorker(const std::filesystem::path& socket_path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socket_path.c_str(),
+                 sizeof(address.sun_path) - 1);
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    FarmMessage hello;
+    if (m_socket < 0 ||
+        connect(m_socket, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        !read_all(m_socket, &hello, sizeof(hello)) ||
+        hello.type != FarmMessageType::Hello) {
+        std::cerr << "FAILED TO CONNECT TO FARM: " << socket_path << std::endl;
+        if (m_socket >= 0) {
+            close(m_socket);
+        }
+        m_socket = -1;
+        return;
+    }
+    m_image_size = glm::ivec2(hello.size[0], hello.size[1]);
+    m_tile_size = glm::ivec2(hello.tile[2], hello.tile[3]);
+}
+
+FarmWorker::~FarmWorker() {
+    if (m_socket >= 0) {
+        close(m_socket);
+    }
+}
+
+bool FarmWorker::next_task(FarmTask& task) {
+    if (m_socket < 0) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        FarmMessage request = make_message(FarmMessageType::Request);
+        if (!write_all(m_socket, &request, sizeof(request))) {
+            return false;
+        }
+    }
+
+    // only tasks and done come this way, so no lock is needed to read
+    FarmMessage message;
+    if (!read_all(m_socket, &message, sizeof(message)) ||
+        message.type != FarmMessageType::Task) {
+        return false;
+    }
+    task.first_frame = message.frame;
+    task.frame_count = message.frame_count;
+    task.tile = glm::ivec4(message.tile[0], message.tile[1], message.tile[2],
+                           message.tile[3]);
+    return true;
+}
+
+void FarmWorker::send_result(const uint8_t* pixels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_frames.empty() || m_socket < 0) {
+        return;
+    }
+    auto [frame, tile] = m_frames.front();
+    m_frames.pop_front();
+
+    FarmMessage message = make_message(FarmMessageType::Result);
+    message.frame = frame;
+    message.frame_count = 1;
+    for (int i = 0; i < 4; ++i) {
+        message.tile[i] = tile[i];
+    }
+    message.payload = (uint64_t)m_tile_size.x * m_tile_size.y * 4;
+    if (!write_all(m_socket, &message, sizeof(message)) ||
+        !write_all(m_socket, pixels, message.payload)) {
+        std::cerr << "FAILED TO SEND FARM RESULT" << std::endl;
+    }
+}
+#else
+RenderFarm::RenderFarm(const FarmSettings& settings)
+    : m_settings(settings), m_tile_size(settings.size), m_tiles_per_frame(1) {}
+
+bool RenderFarm::run() {
+    std::cerr << "RENDER FARM NOT SUPPORTED ON THIS PLATFORM" << std::endl;
+    return false;
+}
+
+void RenderFarm::queue_tasks() {}
+
+void RenderFarm::gather(uint64_t, const glm::ivec4&,
+                        const std::vector<uint8_t>&) {}
+
+FarmWorker::FarmWorker(const std::filesystem::path&) {
+    std::cerr << "RENDER FARM NOT SUPPORTED ON THIS PLATFORM" << std::endl;
+}
+
+FarmWorker::~FarmWorker() {}
+
+bool FarmWorker::next_task(FarmTask&) { return false; }
+
+void FarmWorker::send_result(const uint8_t*) {}
+#endif
+
+bool FarmWorker::is_connected() const { return m_socket >= 0; }
+
+glm::ivec2 FarmWorker::get_image_size() const { return m_image_size; }
+
+glm::ivec2 FarmWorker::get_tile_size() const { return m_tile_size; }
+
+void FarmWorker::queue_frame(uint64_t frame, const glm::ivec4& tile) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frames.push_back({frame, tile});
+}
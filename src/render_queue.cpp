@@ -0,0 +1,172 @@
+#include "render_queue.hpp"
+#include "frame_counters.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include <algorithm>
+
+static constexpr int KEY_PASS_SHIFT = 60;
+static constexpr int KEY_PROGRAM_SHIFT = 48;
+static constexpr int KEY_DEPTH_SHIFT = 24;
+static constexpr uint64_t KEY_PROGRAM_MASK = (1ull << 12) - 1;
+static constexpr uint64_t KEY_DEPTH_MASK = (1ull << 24) - 1;
+static constexpr uint64_t KEY_MESH_MASK = (1ull << 24) - 1;
+
+RenderQueue::RenderQueue() {
+#ifndef NDEBUG
+    glGenQueries(2, m_overdraw_queries);
+#endif
+}
+
+RenderQueue::~RenderQueue() {
+#ifndef NDEBUG
+    glDeleteQueries(2, m_overdraw_queries);
+#endif
+}
+
+void RenderQueue::set_view(const Camera& camera) {
+    m_view_position = camera.get_position();
+    m_view_distance = camera.get_far_clip_plane();
+}
+
+void RenderQueue::submit(RenderPass pass, const Mesh& mesh, Shader& shader,
+                         const glm::mat4& transform, const glm::vec3& position,
+                         GLenum mode) {
+    push({make_key(pass, mesh, shader, position), &mesh, &shader, transform, 0,
+          0, mode});
+}
+
+void RenderQueue::submit_indirect(RenderPass pass, const Mesh& mesh,
+                                  Shader& shader, GLuint instance_buffer,
+                                  GLuint order_buffer, GLuint indirect_buffer,
+                                  size_t indirect_offset, int command_count,
+                                  const glm::vec3& position, GLenum mode) {
+    push({make_key(pass, mesh, shader, position), &mesh, &shader,
+          glm::mat4(1.0f), instance_buffer, 0, mode, indirect_buffer,
+          indirect_offset, command_count, order_buffer});
+}
+
+void RenderQueue::flush() {
+    m_statistics.draw_count = 0;
+    m_statistics.program_changes = 0;
+    m_statistics.mesh_changes = 0;
+
+    std::sort(m_items.begin(), m_items.end(),
+              [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+    const Shader* shader = nullptr;
+    const Mesh* mesh = nullptr;
+    GLint transform_location = -1;
+    GLint has_texture_location = -1;
+    GLint texture_location = -1;
+    for (const DrawItem& item : m_items) {
+        if (item.shader != shader) {
+            shader = item.shader;
+            glUseProgram(shader->get_id());
+            transform_location =
+                glGetUniformLocation(shader->get_id(), "transform");
+            has_texture_location =
+                glGetUniformLocation(shader->get_id(), "has_texture");
+            texture_location =
+                glGetUniformLocation(shader->get_id(), "diffuse_texture");
+            glUniform1i(texture_location, 0);
+            mesh = nullptr;
+            ++m_statistics.program_changes;
+            FrameCounters::add(FrameCounter::ProgramBinds);
+        }
+
+        if (item.mesh != mesh) {
+            mesh = item.mesh;
+            glBindVertexArray(mesh->get_vertex_array_id());
+            glUniform1i(has_texture_location, mesh->get_texture() != nullptr);
+            if (mesh->get_texture()) {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, mesh->get_texture()->get_id());
+                FrameCounters::add(FrameCounter::TextureBinds);
+            }
+            ++m_statistics.mesh_changes;
+        }
+
+        if (item.indirect_buffer) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, item.instance_buffer);
+            if (item.order_buffer) {
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                                 INSTANCE_ORDER_BINDING, item.order_buffer);
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, item.indirect_buffer);
+            glMultiDrawElementsIndirect(item.mode, GL_UNSIGNED_INT,
+                                        (const void*)item.indirect_offset,
+                                        item.command_count, 0);
+        } else if (item.instance_buffer) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, item.instance_buffer);
+            glDrawElementsInstanced(item.mode, mesh->get_index_count(),
+                                    GL_UNSIGNED_INT, nullptr,
+                                    item.instance_count);
+            FrameCounters::add(FrameCounter::Instances, item.instance_count);
+        } else {
+            glUniformMatrix4fv(transform_location, 1, GL_FALSE,
+                               glm::value_ptr(item.transform));
+            glDrawElements(item.mode, mesh->get_index_count(), GL_UNSIGNED_INT,
+                           nullptr);
+        }
+        ++m_statistics.draw_count;
+        FrameCounters::add(FrameCounter::DrawCalls);
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_ORDER_BINDING, 0);
+    glUseProgram(0);
+    m_items.clear();
+}
+
+void RenderQueue::begin_overdraw() {
+#ifndef NDEBUG
+    // read back the query of two frames ago without waiting on it
+    int query = m_frame % 2;
+    if (m_overdraw_pending[query]) {
+        GLint available = 0;
+        glGetQueryObjectiv(m_overdraw_queries[query], GL_QUERY_RESULT_AVAILABLE,
+                           &available);
+        if (available) {
+            GLuint64 samples;
+            glGetQueryObjectui64v(m_overdraw_queries[query], GL_QUERY_RESULT,
+                                  &samples);
+            m_statistics.overdraw = (float)samples / m_overdraw_pixels[query];
+        }
+        m_overdraw_pending[query] = false;
+    }
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    m_overdraw_pixels[query] = std::max(viewport[2] * viewport[3], 1);
+    glBeginQuery(GL_SAMPLES_PASSED, m_overdraw_queries[query]);
+#endif
+}
+
+void RenderQueue::end_overdraw() {
+#ifndef NDEBUG
+    glEndQuery(GL_SAMPLES_PASSED);
+    m_overdraw_pending[m_frame % 2] = true;
+    ++m_frame;
+#endif
+}
+
+const RenderQueueStatistics& RenderQueue::get_statistics() const {
+    return m_statistics;
+}
+
+uint64_t RenderQueue::make_key(RenderPass pass, const Mesh& mesh,
+                               const Shader& shader,
+                               const glm::vec3& position) const {
+    float distance = glm::length(position - m_view_position) / m_view_distance;
+    uint64_t depth = (uint64_t)(std::clamp(distance, 0.0f, 1.0f) *
+                                KEY_DEPTH_MASK);
+
+    return ((uint64_t)pass << KEY_PASS_SHIFT) |
+           ((shader.get_id() & KEY_PROGRAM_MASK) << KEY_PROGRAM_SHIFT) |
+           (depth << KEY_DEPTH_SHIFT) |
+           (mesh.get_vertex_array_id() & KEY_MESH_MASK);
+}
+
+void RenderQueue::push(const DrawItem& item) { m_items.push_back(item); }
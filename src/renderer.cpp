@@ -37,6 +37,17 @@ void Camera::look_at(const glm::vec3 position) {
     }
 }
 
+void Camera::crop(const glm::vec2& min, const glm::vec2& max) {
+    glm::vec2 scale = glm::vec2(2.0f) / (max - min);
+    glm::vec2 center = (min + max) * 0.5f;
+    glm::mat4 crop(1.0f);
+    crop[0][0] = scale.x;
+    crop[1][1] = scale.y;
+    crop[3][0] = -scale.x * center.x;
+    crop[3][1] = -scale.y * center.y;
+    m_projection = crop * m_projection;
+}
+
 glm::mat4 Camera::get_matrix() const {
     return m_projection *
            glm::lookAt(m_position, m_position + m_direction, m_up);
@@ -60,6 +71,7 @@ Renderer::Renderer() {
         if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
             std::cout << "Failed to initialize GLAD" << std::endl;
         }
+        gl_debug_install();
         glEnable(GL_DEPTH_TEST);
         glDepthFunc(GL_LESS);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -68,15 +80,26 @@ Renderer::Renderer() {
         glFrontFace(GL_CCW);
     }
     m_glad_initialized = true;
+
+    // a handful of cameras per frame: the view, debug view and shadow passes
+    m_frame_constants.create_ring(64);
+    m_frame_constants.set_label("frame constants");
 }
 
+void Renderer::begin_frame() { m_frame_constants.begin_frame(); }
+
+void Renderer::end_frame() { m_frame_constants.end_frame(); }
+
 void Renderer::set_camera(const Camera& camera) {
-    m_camera_matrix = camera.get_matrix();
+    FrameConstants constants;
+    constants.projection = camera.get_matrix();
+    constants.camera_position = glm::vec4(camera.get_position(), 1.0f);
+    m_frame_constants.bind_range(FRAME_CONSTANTS_BINDING,
+                                 m_frame_constants.push(constants));
 }
 
 void Renderer::draw(const Mesh& mesh, const glm::mat4& transform,
                     Shader& shader, GLuint mode) {
-    shader.set_uniform_matrix4("projection", m_camera_matrix);
     shader.set_uniform_matrix4("transform", transform);
     shader.set_uniform_int("has_texture", mesh.get_texture() != nullptr);
     if (mesh.get_texture()) {
@@ -86,8 +109,9 @@ void Renderer::draw(const Mesh& mesh, const glm::mat4& transform,
     }
     glBindVertexArray(mesh.get_vertex_array_id());
 
-    glDrawElements(mode, mesh.get_indices().size(), GL_UNSIGNED_INT,
-                   mesh.get_indices().data());
+    glDrawElements(mode, mesh.get_index_count(), GL_UNSIGNED_INT, nullptr);
+    FrameCounters::add(FrameCounter::DrawCalls);
+    FrameCounters::add(FrameCounter::ProgramBinds);
 
     glBindVertexArray(0);
     if (mesh.get_texture()) {
@@ -1,4 +1,5 @@
 #include "scene.hpp"
+#include "world.hpp"
 #include <fstream>
 #include <sstream>
 
@@ -93,6 +94,8 @@ Scene::Scene(const std::filesystem::path& shader_directory,
         shader_directory / "default_fragment.glsl", GL_FRAGMENT_SHADER);
     m_grass_generation_shader.load_shader_from_path(
         shader_directory / "grass_generation.glsl", GL_COMPUTE_SHADER);
+    m_grass_compaction.load_shader_from_path(
+        shader_directory / "prefix_sum.glsl", GL_COMPUTE_SHADER);
     m_flow_field.load_shader_from_path(shader_directory / "flow_field.glsl",
                                        GL_COMPUTE_SHADER);
     m_displacement.load_shader_from_path(shader_directory / "displacement.glsl",
@@ -117,28 +120,60 @@ Scene::Scene(const std::filesystem::path& shader_directory,
         "wind_direction", glm::vec2(cos(m_settings.wind_direction),
                                     sin(m_settings.wind_direction)));
 
+    // no far field here, blades keep their height
+    m_gpu_instancing_shader.set_uniform_vector2(
+        "far_field_fade", glm::vec2(m_camera.get_far_clip_plane(),
+                                    m_camera.get_far_clip_plane() * 2.0f));
+
     m_flow_field.set_uniform_vector2("wind_direction",
                                      glm::vec2(cos(m_settings.wind_direction),
                                                sin(m_settings.wind_direction)));
 
     m_grass_mesh = load_model(model_directory / "grass_model.txt");
+    m_species = std::make_unique<SpeciesSet>(
+        std::vector<Species>{{"grass", &m_grass_mesh}});
+    m_vegetation = std::make_unique<VegetationBatch>(*m_species);
+
+    // no density map here, only the terrain masks thin the grass
+    uint8_t white[4] = {255, 255, 255, 255};
+    m_density_map.load_texture_from_byte(white, GL_UNSIGNED_BYTE, glm::ivec2(1),
+                                         GL_RGBA8, GL_RGBA);
+    m_grass_generation_shader.set_uniform_texture("density_map", m_density_map,
+                                                  DENSITY_MAP_TEXTURE_UNIT);
+    m_grass_generation_shader.set_uniform_vector2("slope_fade",
+                                                  glm::vec2(35.0f, 50.0f));
+    m_grass_generation_shader.set_uniform_vector2("altitude_range",
+                                                  glm::vec2(0.0f, 1.0f));
+    glActiveTexture(GL_TEXTURE0);
 
     for (int x = -8; x < 8; ++x) {
         for (int y = -8; y < 8; ++y) {
             std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>(
-                m_grass_mesh, m_grass_generation_shader, glm::ivec3(x, 0, y), 2,
-                32, 34.0f, 0.01f, 0u);
+                *m_species, m_grass_generation_shader, m_grass_compaction,
+                m_compute_scheduler, m_height_maps, m_noise_maps, m_instances,
+                glm::ivec3(x, 0, y), 2, 32, 34.0f, 0.01f, 0u);
             m_chunks.push_back(chunk);
         }
     }
+    m_chunk_parameters.create_ring(m_chunks.size() * 2);
+    m_vegetation->reserve(m_chunks.size());
 }
 
 void Scene::update(float time) {
+    m_chunk_parameters.begin_frame();
     for (std::shared_ptr<Chunk> chunk : m_chunks) {
         chunk->frustum_test(m_camera);
-        chunk->update(m_flow_field, m_displacement,
+    }
+    m_compute_scheduler.begin_frame();
+    Chunk::update_wind(m_compute_scheduler, m_flow_field, m_chunk_parameters,
+                       m_chunks, time * 6.0f);
+    for (std::shared_ptr<Chunk> chunk : m_chunks) {
+        chunk->update(m_displacement, m_chunk_parameters,
                       glm::radians(m_settings.wind_direction), time * 6.0f);
     }
+    m_compute_scheduler.flush(GL_SHADER_STORAGE_BARRIER_BIT |
+                              GL_TEXTURE_FETCH_BARRIER_BIT);
+    m_chunk_parameters.end_frame();
 }
 
 void Scene::render(Renderer& renderer, const Camera& external_camera) {
@@ -147,12 +182,15 @@ void Scene::render(Renderer& renderer, const Camera& external_camera) {
     m_gpu_instancing_shader.set_uniform_float("fog_bias",
                                               m_settings.fog_percent);
     m_default_shader.set_uniform_int("disable_fog", 0);
-    m_default_shader.set_uniform_vector3("camera_position",
-                                         m_camera.get_position());
     m_gpu_instancing_shader.set_uniform_int("disable_fog", 0);
-    m_gpu_instancing_shader.set_uniform_vector3("camera_position",
-                                                m_camera.get_position());
+    m_render_queue.set_view(external_camera);
+    m_vegetation->begin_frame();
     for (std::shared_ptr<Chunk> chunk : m_chunks) {
-        chunk->render(renderer, m_default_shader, m_gpu_instancing_shader);
+        chunk->submit(m_render_queue, *m_vegetation, m_default_shader);
     }
+    m_vegetation->submit(m_render_queue, RenderPass::Opaque,
+                         m_gpu_instancing_shader,
+                         external_camera.get_position());
+    m_render_queue.flush();
+    m_vegetation->end_frame();
 }
@@ -18,8 +18,8 @@ check_shader_compilation_error(GLuint shader,
     if (!success) {
         char error_log[512];
         glGetShaderInfoLog(shader, 512, NULL, error_log);
-        std::cout << "FILE: " << file_path << std::endl;
-        std::cout << error_log << std::endl;
+        std::cerr << "ERROR COMPILING SHADER: " << file_path << std::endl;
+        std::cerr << error_log << std::endl;
     }
 
     return success;
@@ -32,8 +32,8 @@ static bool check_shader_linking_error(GLuint shader_program,
     if (!success) {
         char error_log[512];
         glGetProgramInfoLog(shader_program, 512, NULL, error_log);
-        std::cout << "ERROR LINKING PROGRAM: " << path << std::endl;
-        std::cout << error_log << std::endl;
+        std::cerr << "ERROR LINKING PROGRAM: " << path << std::endl;
+        std::cerr << error_log << std::endl;
     }
 
     return success;
@@ -75,6 +75,19 @@ bool Shader::load_shader_from_path(const std::filesystem::path& shader_path,
 
     glDeleteShader(shader);
 
+    // named after its stages in frame debuggers
+    if (type == GL_VERTEX_SHADER) {
+        m_vertex_shader_path = shader_path;
+    } else {
+        m_fragment_shader_path = shader_path;
+    }
+    std::string label = m_vertex_shader_path.stem().string();
+    if (!m_fragment_shader_path.empty()) {
+        label += (label.empty() ? "" : " + ") +
+                 m_fragment_shader_path.stem().string();
+    }
+    gl_debug_label(GL_PROGRAM, m_id, label);
+
     return true;
 }
 
@@ -149,31 +162,34 @@ void Shader::set_uniform_texture(const std::string& name,
 
     glActiveTexture(GL_TEXTURE0 + index);
     glBindTexture(GL_TEXTURE_2D, texture.get_id());
+    FrameCounters::add(FrameCounter::TextureBinds);
 }
 
-void Shader::flush_textures() {
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUseProgram(0);
-}
-
-GLuint Shader::get_id() const { return m_id; };
-
-void Shader::dispatch_texture(Texture& texture, const glm::ivec3& work_groups) {
+void Shader::set_uniform_texture_array(const std::string& name,
+                                       const TextureArray& texture,
+                                       int index) {
+    GLuint location = glGetUniformLocation(m_id, name.c_str());
     glUseProgram(m_id);
-    glBindTexture(GL_TEXTURE_2D, texture.get_id());
 
-    glBindImageTexture(0, texture.get_id(), 0, GL_FALSE, 0, GL_READ_WRITE,
-                       GL_RGBA32F);
-    glDispatchCompute(work_groups.x, work_groups.y, work_groups.z);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glUniform1i(location, index);
+
+    glActiveTexture(GL_TEXTURE0 + index);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture.get_id());
+    FrameCounters::add(FrameCounter::TextureBinds);
+}
 
+void Shader::flush_textures() {
     glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     glUseProgram(0);
 }
 
+GLuint Shader::get_id() const { return m_id; };
+
 void Shader::dispatch(const glm::ivec3& work_groups) {
     glUseProgram(m_id);
     glDispatchCompute(work_groups.x, work_groups.y, work_groups.z);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
     glUseProgram(0);
+    FrameCounters::add(FrameCounter::Dispatches);
+    FrameCounters::add(FrameCounter::ProgramBinds);
 }
\ No newline at end of file
@@ -0,0 +1,300 @@
+#include "shadow.hpp"
+#include "gl_debug.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/geometric.hpp"
+#include "glm/matrix.hpp"
+#include <cmath>
+#include <iostream>
+
+// room behind a cascade for casters that sit outside the view frustum
+static constexpr float SHADOW_CASTER_MARGIN = 64.0f;
+// blend between logarithmic and uniform cascade splits
+static constexpr float SHADOW_SPLIT_LAMBDA = 0.8f;
+
+static GLuint create_depth_array(int resolution) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, resolution,
+                   resolution, SHADOW_CASCADE_COUNT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+                    GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+                    GL_CLAMP_TO_BORDER);
+    float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+}
+
+ShadowMap::ShadowMap(SpeciesSet& species, Shader& terrain_depth,
+                     Shader& grass_depth, Shader& procedural_depth,
+                     int resolution)
+    : m_casters(species, true), m_terrain_depth(terrain_depth),
+      m_grass_depth(grass_depth), m_procedural_depth(procedural_depth),
+      m_resolution(resolution),
+      m_allocation(MemoryCategory::RenderTarget) {
+    m_terrain_texture = create_depth_array(m_resolution);
+    m_depth_texture = create_depth_array(m_resolution);
+    m_allocation.resize(2 * SHADOW_CASCADE_COUNT *
+                        get_texture_bytes(GL_DEPTH_COMPONENT24,
+                                          glm::ivec2(m_resolution)));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depth_texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                    GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &m_frame_buffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frame_buffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              m_depth_texture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR WHILE INITIALIZING SHADOW FRAMEBUFFER" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // full blades in the first cascade, thinned in the second and none
+    // further out where a blade is smaller than a texel
+    m_cascades[0].grass_stride = 1;
+    m_cascades[1].grass_stride = 4;
+
+    m_constants.create_ring(1);
+    glGenQueries(2, m_queries);
+}
+
+ShadowMap::~ShadowMap() {
+    glDeleteQueries(2, m_queries);
+    glDeleteFramebuffers(1, &m_frame_buffer);
+    glDeleteTextures(1, &m_terrain_texture);
+    glDeleteTextures(1, &m_depth_texture);
+}
+
+void ShadowMap::update(Renderer& renderer, const Camera& camera,
+                       const glm::vec3& light_direction,
+                       const std::vector<std::shared_ptr<Chunk>>& chunks) {
+    GlDebugGroup group("shadows");
+    // fences the segment the previous frame's draws read from
+    m_constants.end_frame();
+    m_constants.begin_frame();
+    m_casters.end_frame();
+    m_casters.reserve(chunks.size(), SHADOW_CASCADE_COUNT);
+    m_casters.begin_frame();
+
+    GLuint query = m_queries[m_frame % 2];
+    if (m_query_pending[m_frame % 2]) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            m_gpu_time = elapsed / 1000000.0f;
+        }
+        m_query_pending[m_frame % 2] = false;
+    }
+
+    m_terrain_refreshes = 0;
+    if (m_enabled) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+
+        GLint viewport[4];
+        GLint frame_buffer;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &frame_buffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_frame_buffer);
+        glViewport(0, 0, m_resolution, m_resolution);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        // chunks streaming in change the terrain of every cascade
+        int ready_chunks = 0;
+        for (const std::shared_ptr<Chunk>& chunk : chunks) {
+            ready_chunks += chunk->is_ready();
+        }
+        glm::vec3 direction = glm::normalize(light_direction);
+        if (direction != m_light_direction || ready_chunks != m_ready_chunks) {
+            for (Cascade& cascade : m_cascades) {
+                cascade.valid = false;
+            }
+            m_light_direction = direction;
+            m_ready_chunks = ready_chunks;
+        }
+
+        float near = camera.get_near_clip_plane();
+        float far = camera.get_far_clip_plane();
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+            float t = (float)(i + 1) / SHADOW_CASCADE_COUNT;
+            float logarithmic = near * std::pow(far / near, t);
+            float uniform = near + (far - near) * t;
+            m_splits[i] = SHADOW_SPLIT_LAMBDA * logarithmic +
+                          (1.0f - SHADOW_SPLIT_LAMBDA) * uniform;
+        }
+
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+            Cascade& cascade = m_cascades[i];
+            glm::vec3 origin;
+            float extent;
+            fit_cascade(camera, i == 0 ? near : m_splits[i - 1],
+                        m_splits[i], direction, origin, extent);
+            bool moved = !cascade.valid || origin != cascade.origin ||
+                         extent != cascade.extent;
+
+            // terrain-only cascades are static while nothing moves, when they
+            // do they take turns so at most one is re-rendered per frame
+            bool grass = cascade.grass_stride > 0;
+            bool refresh =
+                moved && (grass || !cascade.valid || (m_frame + i) % 2 == 0);
+            if (refresh) {
+                cascade.origin = origin;
+                cascade.extent = extent;
+                float depth = extent + SHADOW_CASTER_MARGIN;
+                cascade.camera =
+                    Camera(origin - direction * depth, glm::vec2(extent), 0.0f,
+                           depth + extent);
+                cascade.camera.look_at(origin);
+                cascade.matrix = cascade.camera.get_matrix();
+                cascade.valid = true;
+                render_terrain(renderer, cascade, i, chunks);
+                ++m_terrain_refreshes;
+            }
+
+            if (refresh || grass) {
+                glCopyImageSubData(m_terrain_texture, GL_TEXTURE_2D_ARRAY, 0, 0,
+                                   0, i, m_depth_texture, GL_TEXTURE_2D_ARRAY,
+                                   0, 0, 0, i, m_resolution, m_resolution, 1);
+            }
+            if (grass) {
+                render_grass(renderer, cascade, i, chunks);
+            }
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        glEndQuery(GL_TIME_ELAPSED);
+        m_query_pending[m_frame % 2] = true;
+    }
+
+    ShadowConstants constants;
+    for (int i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+        constants.light_matrices[i] = m_cascades[i].matrix;
+    }
+    constants.cascade_splits =
+        glm::vec4(m_splits[0], m_splits[1], m_splits[2], m_splits[3]);
+    constants.view_position = glm::vec4(camera.get_position(), 1.0f);
+    constants.view_direction = glm::vec4(camera.get_direction(), 0.0f);
+    constants.parameters =
+        glm::vec4(m_enabled ? 1.0f : 0.0f, 0.0005f, 1.0f / m_resolution, 0.0f);
+    m_constants.bind_range(SHADOW_CONSTANTS_BINDING,
+                           m_constants.push(constants));
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depth_texture);
+    glActiveTexture(GL_TEXTURE0);
+    FrameCounters::add(FrameCounter::TextureBinds);
+
+    ++m_frame;
+}
+
+void ShadowMap::set_enabled(bool enabled) { m_enabled = enabled; }
+
+void ShadowMap::invalidate() {
+    for (Cascade& cascade : m_cascades) {
+        cascade.valid = false;
+    }
+}
+
+bool ShadowMap::is_enabled() const { return m_enabled; }
+
+float ShadowMap::get_gpu_time() const { return m_gpu_time; }
+
+int ShadowMap::get_terrain_refreshes() const { return m_terrain_refreshes; }
+
+void ShadowMap::fit_cascade(const Camera& camera, float near, float far,
+                            const glm::vec3& light_direction,
+                            glm::vec3& origin, float& extent) const {
+    // bounding sphere of the frustum slice, computed in view space so its
+    // radius only depends on the projection and stays put while the camera
+    // turns
+    glm::mat4 inverse_projection = glm::inverse(camera.get_projection());
+    glm::vec3 corners[8];
+    glm::vec3 center(0.0f);
+    for (int i = 0; i < 4; ++i) {
+        glm::vec4 point = inverse_projection *
+                          glm::vec4(i & 1 ? 1.0f : -1.0f,
+                                    i & 2 ? 1.0f : -1.0f, -1.0f, 1.0f);
+        glm::vec3 ray = glm::vec3(point) / point.w /
+                        camera.get_near_clip_plane();
+        corners[i * 2] = ray * near;
+        corners[i * 2 + 1] = ray * far;
+        center += corners[i * 2] + corners[i * 2 + 1];
+    }
+    center /= 8.0f;
+
+    float radius = 0.0f;
+    for (const glm::vec3& corner : corners) {
+        radius = std::fmax(radius, glm::length(corner - center));
+    }
+    radius = std::ceil(radius);
+
+    // the origin snaps to steps of an eighth of the map, the extra extent
+    // keeps the slice covered in between so the cached depth stays valid
+    extent = radius * 4.0f / 3.0f;
+    float step = extent / 4.0f;
+
+    glm::vec3 up = std::fabs(glm::dot(light_direction,
+                                      glm::vec3(0.0f, 1.0f, 0.0f))) == 1.0f
+                       ? glm::vec3(0.0f, 0.0f, 1.0f)
+                       : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 light_view = glm::lookAt(glm::vec3(0.0f), light_direction, up);
+    glm::vec3 world_center =
+        glm::vec3(camera.get_transform() * glm::vec4(center, 1.0f));
+    glm::vec3 light_center =
+        glm::vec3(light_view * glm::vec4(world_center, 1.0f));
+    light_center.x = std::floor(light_center.x / step + 0.5f) * step;
+    light_center.y = std::floor(light_center.y / step + 0.5f) * step;
+    light_center.z = std::floor(light_center.z / step + 0.5f) * step;
+    origin = glm::vec3(glm::inverse(light_view) *
+                       glm::vec4(light_center, 1.0f));
+}
+
+void ShadowMap::render_terrain(
+    Renderer& renderer, Cascade& cascade, int layer,
+    const std::vector<std::shared_ptr<Chunk>>& chunks) {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              m_terrain_texture, 0, layer);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    renderer.set_camera(cascade.camera);
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        chunk->render_terrain_depth(renderer, cascade.camera, m_terrain_depth,
+                                    cascade.grass_stride == 0);
+    }
+}
+
+void ShadowMap::render_grass(
+    Renderer& renderer, Cascade& cascade, int layer,
+    const std::vector<std::shared_ptr<Chunk>>& chunks) {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              m_depth_texture, 0, layer);
+
+    // thinned blades are widened to keep roughly the same coverage
+    for (Shader* shader : {&m_grass_depth, &m_procedural_depth}) {
+        shader->set_uniform_int("instance_stride", cascade.grass_stride);
+        shader->set_uniform_float("caster_scale",
+                                  std::sqrt((float)cascade.grass_stride));
+    }
+
+    glDisable(GL_CULL_FACE);
+    renderer.set_camera(cascade.camera);
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        chunk->add_grass_depth(m_casters, cascade.camera, cascade.grass_stride);
+    }
+    m_casters.draw(m_grass_depth, &m_procedural_depth);
+    glEnable(GL_CULL_FACE);
+}
@@ -0,0 +1,78 @@
+#include "terrain_generator.hpp"
+#include "PerlinNoise.hpp"
+#include "compute_scheduler.hpp"
+#include "utility.hpp"
+#include <vector>
+
+TerrainGenerator::TerrainGenerator(Shader& shader) : m_shader(shader) {}
+
+void TerrainGenerator::set_seed(uint64_t seed) {
+    if (m_seeded && seed == m_seed) {
+        return;
+    }
+    const siv::PerlinNoise::seed_type seed_type = seed;
+    const siv::PerlinNoise perlin{seed_type};
+    const siv::PerlinNoise::state_type& state = perlin.serialize();
+    m_permutation.load_data(std::vector<uint32_t>(state.begin(), state.end()));
+    m_seed = seed;
+    m_seeded = true;
+}
+
+void TerrainGenerator::record(ComputeScheduler& scheduler, const void* owner,
+                              const glm::vec2& origin, int size,
+                              float terrain_height, float terrain_scale,
+                              Mesh& ground, Mesh& low_poly,
+                              const TextureLayer& height_map) {
+    GLuint vertices = ground.get_vertex_buffer_id();
+    GLuint height_array = height_map.get_array().get_id();
+    int layer = height_map.get_layer();
+    GLenum format = height_map.get_array().get_internal_format();
+
+    // the permutation is bound when the pass runs. passes run with the
+    // flush of the frame that recorded them, before a new seed can be set
+    scheduler
+        .record(owner,
+                [this, &ground, origin, size, terrain_height, terrain_scale,
+                 height_array, layer, format]() {
+                    m_shader.set_uniform_int("size", size);
+                    m_shader.set_uniform_int("low_poly", 0);
+                    m_shader.set_uniform_vector2("origin", origin);
+                    m_shader.set_uniform_float("terrain_height",
+                                               terrain_height);
+                    m_shader.set_uniform_float("terrain_scale", terrain_scale);
+                    m_shader.set_uniform_int("height_layer", layer);
+                    m_shader.set_buffer(m_permutation, 2);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0,
+                                     ground.get_vertex_buffer_id());
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1,
+                                     ground.get_element_buffer_id());
+                    glBindImageTexture(0, height_array, 0, GL_TRUE, 0,
+                                       GL_WRITE_ONLY, format);
+                    FrameCounters::add(FrameCounter::TextureBinds);
+                    int groups = (size + 1 + 7) / 8;
+                    m_shader.dispatch(glm::ivec3(groups, groups, 1));
+                    gl_check_error();
+                })
+        .write_buffer(vertices)
+        .write_buffer(ground.get_element_buffer_id())
+        .write_texture_layer(height_array, layer);
+
+    scheduler
+        .record(owner,
+                [this, &ground, &low_poly, size]() {
+                    m_shader.set_uniform_int("size", size);
+                    m_shader.set_uniform_int("low_poly", 1);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0,
+                                     low_poly.get_vertex_buffer_id());
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1,
+                                     low_poly.get_element_buffer_id());
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3,
+                                     ground.get_vertex_buffer_id());
+                    int groups = (size / 4 + 1 + 7) / 8;
+                    m_shader.dispatch(glm::ivec3(groups, groups, 1));
+                    gl_check_error();
+                })
+        .read_buffer(vertices)
+        .write_buffer(low_poly.get_vertex_buffer_id())
+        .write_buffer(low_poly.get_element_buffer_id());
+}
@@ -1,10 +1,12 @@
 #include "texture.hpp"
+#include "baked_texture.hpp"
 #include "glad/glad.h"
 #include "stb_image.h"
+#include "upload.hpp"
 #include "utility.hpp"
 #include <iostream>
 
-Texture::Texture() {
+Texture::Texture(MemoryCategory category) : m_allocation(category) {
     glGenTextures(1, &m_id);
     glBindTexture(GL_TEXTURE_2D, m_id);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -21,10 +23,17 @@ void Texture::load_texture_from_byte(uint8_t* pixel_data, GLuint type,
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, m_size.x, m_size.y, 0,
                  format, type, pixel_data);
     glBindTexture(GL_TEXTURE_2D, 0);
+    m_allocation.resize(get_texture_bytes(internal_format, m_size));
 }
 
 void Texture::load_texture_from_path(
     const std::filesystem::path& texture_path) {
+    set_label(texture_path.filename().string());
+    if (BakedTexture::is_baked_texture(texture_path)) {
+        load_texture_from_baked(texture_path);
+        return;
+    }
+
     stbi_set_flip_vertically_on_load(true);
     glm::ivec2 size;
     uint8_t* pixel_data =
@@ -52,10 +61,55 @@ void Texture::load_texture_from_path(
     glBindTexture(GL_TEXTURE_2D, m_id);
     glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
+    m_allocation.resize(get_texture_bytes(format, size, 0));
 
     stbi_image_free(pixel_data);
 }
 
+void Texture::load_texture_from_baked(
+    const std::filesystem::path& texture_path) {
+    BakedTexture baked(texture_path);
+    if (!baked.is_valid()) {
+        return;
+    }
+
+    const BakedTextureHeader& header = baked.get_header();
+    m_size = glm::ivec2(header.width, header.height);
+    m_color_channel_count = header.channel_count;
+
+    glBindTexture(GL_TEXTURE_2D, m_id);
+    glTexStorage2D(GL_TEXTURE_2D, header.level_count, header.internal_format,
+                   m_size.x, m_size.y);
+    m_allocation.resize(
+        get_texture_bytes(header.internal_format, m_size, header.level_count));
+    for (uint32_t i = 0; i < header.level_count; ++i) {
+        const BakedTextureLevel& level = baked.get_level(i);
+        if (baked.is_compressed()) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width,
+                                      level.height, header.internal_format,
+                                      level.size, baked.get_level_data(i));
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height,
+                            header.format, header.type,
+                            baked.get_level_data(i));
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+std::shared_ptr<const UploadTicket> Texture::load_texture_from_byte_async(
+    UploadService& uploads, std::vector<uint8_t> pixel_data, GLuint type,
+    const glm::ivec2& size, GLuint internal_format, GLuint format) {
+    return uploads.upload_texture(*this, std::move(pixel_data), type, size,
+                                  internal_format, format);
+}
+
+std::shared_ptr<const UploadTicket> Texture::load_texture_from_path_async(
+    UploadService& uploads, const std::filesystem::path& texture_path) {
+    set_label(texture_path.filename().string());
+    return uploads.upload_texture(*this, texture_path);
+}
+
 void Texture::set_filter_mode(GLuint mode) {
     glBindTexture(GL_TEXTURE_2D, m_id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mode);
@@ -70,13 +124,18 @@ void Texture::set_wrap_mode(GLuint mode) {
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void Texture::set_label(const std::string& label) const {
+    gl_debug_label(GL_TEXTURE, m_id, label);
+}
+
 GLuint Texture::get_id() const { return m_id; }
 
 glm::ivec2 Texture::get_size() const { return m_size; }
 
 // render texture
 RenderTexture::RenderTexture(const glm::ivec2& size, GLuint format)
-    : Texture() {
+    : Texture(MemoryCategory::RenderTarget),
+      m_depth_allocation(MemoryCategory::RenderTarget) {
     glGenFramebuffers(1, &m_frame_buffer);
     gl_check_error();
     glBindFramebuffer(GL_FRAMEBUFFER, m_frame_buffer);
@@ -85,6 +144,7 @@ RenderTexture::RenderTexture(const glm::ivec2& size, GLuint format)
     glGenRenderbuffers(1, &m_render_buffer);
     glBindRenderbuffer(GL_RENDERBUFFER, m_render_buffer);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+    m_depth_allocation.resize(get_texture_bytes(GL_DEPTH24_STENCIL8, size));
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
     load_texture_from_byte(0, GL_UNSIGNED_BYTE, size, format, format);
@@ -112,4 +172,6 @@ void RenderTexture::begin_draw() {
     glBindFramebuffer(GL_FRAMEBUFFER, m_frame_buffer);
 }
 
-void RenderTexture::end_draw() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
\ No newline at end of file
+void RenderTexture::end_draw() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+GLuint RenderTexture::get_frame_buffer_id() const { return m_frame_buffer; }
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "texture_array.hpp"
+#include "frame_counters.hpp"
+#include "upload.hpp"
+#include <algorithm>
+
+// texture array
+TextureArray::TextureArray(const glm::ivec2& size, int layer_count,
+                           GLenum internal_format)
+    : m_size(size), m_layer_count(layer_count),
+      m_internal_format(internal_format),
+      m_allocation(MemoryCategory::Texture) {
+    glGenTextures(1, &m_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_id);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, m_internal_format, m_size.x,
+                   m_size.y, m_layer_count);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_allocation.resize(get_texture_bytes(m_internal_format, m_size) *
+                        m_layer_count);
+
+    // lowest layers first so batched passes cover a short range
+    for (int i = m_layer_count - 1; i >= 0; --i) {
+        m_free.push_back(i);
+    }
+}
+
+TextureArray::~TextureArray() { glDeleteTextures(1, &m_id); }
+
+int TextureArray::acquire() {
+    if (m_free.empty()) {
+        return -1;
+    }
+    int layer = m_free.back();
+    m_free.pop_back();
+    return layer;
+}
+
+void TextureArray::release(int layer) {
+    // keep the lowest layer on top
+    m_free.insert(std::upper_bound(m_free.begin(), m_free.end(), layer,
+                                   std::greater<int>()),
+                  layer);
+}
+
+GLuint TextureArray::get_id() const { return m_id; }
+
+glm::ivec2 TextureArray::get_size() const { return m_size; }
+
+GLenum TextureArray::get_internal_format() const { return m_internal_format; }
+
+int TextureArray::get_layer_count() const { return m_layer_count; }
+
+int TextureArray::get_used_count() const {
+    return m_layer_count - (int)m_free.size();
+}
+
+// texture layer
+TextureLayer::TextureLayer(std::shared_ptr<TextureArray> array, int layer)
+    : m_array(std::move(array)), m_layer(layer) {}
+
+TextureLayer::~TextureLayer() { reset(); }
+
+TextureLayer::TextureLayer(TextureLayer&& other)
+    : m_array(std::move(other.m_array)), m_layer(other.m_layer) {
+    other.m_layer = -1;
+}
+
+TextureLayer& TextureLayer::operator=(TextureLayer&& other) {
+    if (this != &other) {
+        reset();
+        m_array = std::move(other.m_array);
+        m_layer = other.m_layer;
+        other.m_layer = -1;
+    }
+    return *this;
+}
+
+void TextureLayer::reset() {
+    if (m_array) {
+        m_array->release(m_layer);
+    }
+    m_array.reset();
+    m_layer = -1;
+}
+
+void TextureLayer::upload(const void* pixel_data, GLuint type, GLuint format) {
+    glm::ivec2 size = m_array->get_size();
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_array->get_id());
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, m_layer, size.x, size.y, 1,
+                    format, type, pixel_data);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    FrameCounters::add(FrameCounter::UploadedBytes,
+                       get_texture_bytes(m_array->get_internal_format(), size));
+}
+
+std::shared_ptr<const UploadTicket>
+TextureLayer::upload_async(UploadService& uploads,
+                           std::vector<uint8_t> pixel_data, GLuint type,
+                           GLuint format) {
+    return uploads.upload_texture_layer(m_array->get_id(), m_layer,
+                                        std::move(pixel_data), type,
+                                        m_array->get_size(), format);
+}
+
+bool TextureLayer::is_valid() const { return m_array != nullptr; }
+
+const TextureArray& TextureLayer::get_array() const { return *m_array; }
+
+int TextureLayer::get_layer() const { return m_layer; }
+
+glm::ivec2 TextureLayer::get_size() const {
+    return m_array ? m_array->get_size() : glm::ivec2(0);
+}
+
+// pool
+TextureArrayPool::TextureArrayPool(GLenum internal_format,
+                                   int layers_per_array)
+    : m_internal_format(internal_format),
+      m_layers_per_array(layers_per_array) {}
+
+TextureLayer TextureArrayPool::acquire(const glm::ivec2& size) {
+    for (std::shared_ptr<TextureArray>& array : m_arrays) {
+        if (array->get_size() != size) {
+            continue;
+        }
+        int layer = array->acquire();
+        if (layer >= 0) {
+            return TextureLayer(array, layer);
+        }
+    }
+
+    std::shared_ptr<TextureArray> array = std::make_shared<TextureArray>(
+        size, m_layers_per_array, m_internal_format);
+    m_arrays.push_back(array);
+    m_idle_trims.push_back(0);
+    return TextureLayer(array, array->acquire());
+}
+
+void TextureArrayPool::trim(int idle_trims) {
+    size_t kept = 0;
+    for (size_t i = 0; i < m_arrays.size(); ++i) {
+        int idle = m_arrays[i]->get_used_count() == 0 ? m_idle_trims[i] + 1 : 0;
+        if (idle > idle_trims) {
+            continue;
+        }
+        m_arrays[kept] = std::move(m_arrays[i]);
+        m_idle_trims[kept] = idle;
+        kept++;
+    }
+    m_arrays.resize(kept);
+    m_idle_trims.resize(kept);
+}
+
+const std::vector<std::shared_ptr<TextureArray>>&
+TextureArrayPool::get_arrays() const {
+    return m_arrays;
+}
@@ -0,0 +1,413 @@
+#include "upload.hpp"
+#include "baked_texture.hpp"
+#include "frame_counters.hpp"
+#include "gl_debug.hpp"
+#include "stb_image.h"
+#include "texture.hpp"
+#include "window.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static constexpr size_t STAGING_ALIGNMENT = 256;
+
+bool UploadTicket::is_ready() const { return m_ready; }
+
+// staging ring
+StagingRing::StagingRing(GLenum target, size_t capacity)
+    : m_target(target), m_capacity(capacity),
+      m_allocation(MemoryCategory::Staging) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(m_target, m_buffer);
+    glBufferStorage(m_target, m_capacity, nullptr, flags);
+    m_data = (uint8_t*)glMapBufferRange(m_target, 0, m_capacity, flags);
+    glBindBuffer(m_target, 0);
+    m_allocation.resize(m_capacity);
+}
+
+StagingRing::~StagingRing() {
+    for (Region& region : m_in_flight) {
+        glDeleteSync(region.fence);
+    }
+    glBindBuffer(m_target, m_buffer);
+    glUnmapBuffer(m_target);
+    glBindBuffer(m_target, 0);
+    glDeleteBuffers(1, &m_buffer);
+}
+
+size_t StagingRing::allocate(size_t size) {
+    if (size > m_capacity || !m_data) {
+        return npos;
+    }
+
+    size_t begin = m_head;
+    if (begin + size > m_capacity) {
+        begin = 0;
+    }
+    size_t end = begin + size;
+
+    // fences signal in submission order, so retire the oldest regions until
+    // nothing in flight overlaps the requested range
+    auto overlaps = [begin, end](const Region& region) {
+        return region.begin < end && begin < region.end;
+    };
+    while (std::any_of(m_in_flight.begin(), m_in_flight.end(), overlaps)) {
+        Region& oldest = m_in_flight.front();
+        glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                         GL_TIMEOUT_IGNORED);
+        glDeleteSync(oldest.fence);
+        m_in_flight.pop_front();
+    }
+
+    m_head = (end + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT *
+             STAGING_ALIGNMENT;
+    return begin;
+}
+
+void StagingRing::fence(size_t offset, size_t size) {
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_in_flight.push_back({offset, offset + size, fence});
+}
+
+uint8_t* StagingRing::get_data(size_t offset) const { return m_data + offset; }
+
+GLuint StagingRing::get_id() const { return m_buffer; }
+
+GLenum StagingRing::get_target() const { return m_target; }
+
+// upload service
+UploadService::UploadService(const Window& window, size_t staging_size)
+    : m_staging_size(staging_size) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    m_context = glfwCreateWindow(1, 1, "upload", 0, window.get_handler());
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (m_context == 0) {
+        std::cerr << "FAILED TO CREATE UPLOAD CONTEXT, UPLOADING INLINE"
+                  << std::endl;
+        return;
+    }
+
+    m_worker = std::thread(&UploadService::run, this);
+}
+
+UploadService::~UploadService() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_condition.notify_one();
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+
+    for (std::shared_ptr<UploadTicket>& ticket : m_pending) {
+        if (ticket->m_fence) {
+            glDeleteSync(ticket->m_fence);
+        }
+    }
+
+    if (m_context) {
+        glfwDestroyWindow(m_context);
+    }
+}
+
+std::shared_ptr<const UploadTicket>
+UploadService::upload_texture(Texture& texture,
+                              const std::filesystem::path& path) {
+    // the texture is only touched on the render thread, the job fills in
+    // its metadata and the completion applies it
+    GLuint id = texture.get_id();
+    std::shared_ptr<TextureMetadata> metadata =
+        std::make_shared<TextureMetadata>();
+    auto complete = [&texture, metadata]() {
+        if (!metadata->valid) {
+            return;
+        }
+        texture.m_size = metadata->size;
+        texture.m_color_channel_count = metadata->channel_count;
+        texture.m_allocation.resize(metadata->bytes);
+    };
+    return enqueue([this, id, path, metadata]() {
+        if (BakedTexture::is_baked_texture(path)) {
+            upload_baked(id, path, *metadata);
+            return;
+        }
+
+        // the flag is global unless set per thread
+        stbi_set_flip_vertically_on_load_thread(true);
+        glm::ivec2 size;
+        int channel_count;
+        uint8_t* pixel_data = stbi_load(path.generic_string().c_str(),
+                                        &size.x, &size.y, &channel_count, 0);
+        if (!pixel_data) {
+            std::cerr << "FAILED TO LOAD IMAGE AT PATH: " << path << std::endl;
+            return;
+        }
+
+        GLuint format = GL_RGBA;
+        switch (channel_count) {
+        case 1:
+            format = GL_RED;
+            break;
+        case 3:
+            format = GL_RGB;
+            break;
+        }
+
+        metadata->size = size;
+        metadata->channel_count = channel_count;
+        metadata->bytes = get_texture_bytes(format, size, 0);
+        metadata->valid = true;
+        upload_pixels(id, pixel_data, (size_t)size.x * size.y * channel_count,
+                      GL_UNSIGNED_BYTE, size, format, format);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        stbi_image_free(pixel_data);
+    }, complete);
+}
+
+std::shared_ptr<const UploadTicket> UploadService::upload_texture(
+    Texture& texture, std::vector<uint8_t> pixel_data, GLuint type,
+    const glm::ivec2& size, GLuint internal_format, GLuint format) {
+    texture.m_size = size;
+    texture.m_allocation.resize(get_texture_bytes(internal_format, size));
+    return enqueue([this, &texture, pixel_data = std::move(pixel_data), type,
+                    size, internal_format, format]() {
+        upload_pixels(texture.get_id(), pixel_data.data(), pixel_data.size(),
+                      type, size, internal_format, format);
+    });
+}
+
+std::shared_ptr<const UploadTicket> UploadService::upload_texture_layer(
+    GLuint texture, int layer, std::vector<uint8_t> pixel_data, GLuint type,
+    const glm::ivec2& size, GLuint format) {
+    return enqueue([this, texture, layer, pixel_data = std::move(pixel_data),
+                    type, size, format]() {
+        FrameCounters::add(FrameCounter::UploadedBytes, pixel_data.size());
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+        size_t offset = m_pixel_ring->allocate(pixel_data.size());
+        const void* pixels = pixel_data.data();
+        if (offset != StagingRing::npos) {
+            std::memcpy(m_pixel_ring->get_data(offset), pixel_data.data(),
+                        pixel_data.size());
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_ring->get_id());
+            pixels = (const void*)offset;
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, size.x, size.y, 1,
+                        format, type, pixels);
+        if (offset != StagingRing::npos) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            m_pixel_ring->fence(offset, pixel_data.size());
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    });
+}
+
+std::shared_ptr<const UploadTicket>
+UploadService::upload_buffer(GLuint buffer, GLenum usage,
+                             std::vector<uint8_t> data) {
+    return enqueue([this, buffer, usage, data = std::move(data)]() {
+        FrameCounters::add(FrameCounter::UploadedBytes, data.size());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, data.size(), nullptr, usage);
+
+        size_t offset = m_buffer_ring->allocate(data.size());
+        if (offset == StagingRing::npos) {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, data.size(), data.data());
+        } else {
+            std::memcpy(m_buffer_ring->get_data(offset), data.data(),
+                        data.size());
+            glBindBuffer(GL_COPY_READ_BUFFER, m_buffer_ring->get_id());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                offset, 0, data.size());
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            m_buffer_ring->fence(offset, data.size());
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    });
+}
+
+void UploadService::poll() {
+    std::vector<std::function<void()>> completions;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        UploadTicket& ticket = **it;
+        if (!ticket.m_fence) {
+            ++it;
+            continue;
+        }
+
+        GLenum status = glClientWaitSync(ticket.m_fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED ||
+            status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(ticket.m_fence);
+            ticket.m_fence = nullptr;
+            ticket.m_ready = true;
+            if (ticket.m_complete) {
+                completions.push_back(std::move(ticket.m_complete));
+                ticket.m_complete = nullptr;
+            }
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    lock.unlock();
+
+    // the fence wait above orders the job's writes before these
+    for (std::function<void()>& complete : completions) {
+        complete();
+    }
+}
+
+std::shared_ptr<const UploadTicket> UploadService::enqueue(Job job,
+                                                           Job complete) {
+    std::shared_ptr<UploadTicket> ticket = std::make_shared<UploadTicket>();
+    if (!m_context) {
+        run_inline(job);
+        ticket->m_ready = true;
+        if (complete) {
+            complete();
+        }
+        return ticket;
+    }
+
+    ticket->m_complete = std::move(complete);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.emplace_back(std::move(job), ticket);
+        m_pending.push_back(ticket);
+    }
+    m_condition.notify_one();
+    return ticket;
+}
+
+void UploadService::run() {
+    glfwMakeContextCurrent(m_context);
+    gl_debug_install();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    m_pixel_ring =
+        std::make_unique<StagingRing>(GL_PIXEL_UNPACK_BUFFER, m_staging_size);
+    m_buffer_ring =
+        std::make_unique<StagingRing>(GL_COPY_READ_BUFFER, m_staging_size);
+
+    while (true) {
+        std::pair<Job, std::shared_ptr<UploadTicket>> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock,
+                             [this]() { return !m_running || !m_jobs.empty(); });
+            if (!m_running) {
+                break;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        job.first();
+
+        // the fence has to reach the server before another context waits on it
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job.second->m_fence = fence;
+    }
+
+    m_pixel_ring.reset();
+    m_buffer_ring.reset();
+    glfwMakeContextCurrent(0);
+}
+
+void UploadService::run_inline(const Job& job) {
+    if (!m_pixel_ring) {
+        m_pixel_ring = std::make_unique<StagingRing>(GL_PIXEL_UNPACK_BUFFER,
+                                                     m_staging_size);
+        m_buffer_ring =
+            std::make_unique<StagingRing>(GL_COPY_READ_BUFFER, m_staging_size);
+    }
+
+    // the jobs expect the upload context's unpack state
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    job();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+void UploadService::upload_baked(GLuint texture,
+                                 const std::filesystem::path& path,
+                                 TextureMetadata& metadata) {
+    BakedTexture baked(path);
+    if (!baked.is_valid()) {
+        return;
+    }
+
+    const BakedTextureHeader& header = baked.get_header();
+    metadata.size = glm::ivec2(header.width, header.height);
+    metadata.channel_count = header.channel_count;
+    metadata.bytes = get_texture_bytes(header.internal_format, metadata.size,
+                                       header.level_count);
+    metadata.valid = true;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, header.level_count, header.internal_format,
+                   header.width, header.height);
+    for (uint32_t i = 0; i < header.level_count; ++i) {
+        const BakedTextureLevel& level = baked.get_level(i);
+        const uint8_t* source = baked.get_level_data(i);
+
+        size_t offset = m_pixel_ring->allocate(level.size);
+        const void* pixels = source;
+        if (offset != StagingRing::npos) {
+            std::memcpy(m_pixel_ring->get_data(offset), source, level.size);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_ring->get_id());
+            pixels = (const void*)offset;
+        }
+
+        if (baked.is_compressed()) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width,
+                                      level.height, header.internal_format,
+                                      level.size, pixels);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height,
+                            header.format, header.type, pixels);
+        }
+
+        if (offset != StagingRing::npos) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            m_pixel_ring->fence(offset, level.size);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void UploadService::upload_pixels(GLuint texture, const uint8_t* pixel_data,
+                                  size_t size, GLuint type,
+                                  const glm::ivec2& extent,
+                                  GLuint internal_format, GLuint format) {
+    FrameCounters::add(FrameCounter::UploadedBytes, size);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    size_t offset = m_pixel_ring->allocate(size);
+    if (offset == StagingRing::npos) {
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, extent.x, extent.y, 0,
+                     format, type, pixel_data);
+    } else {
+        std::memcpy(m_pixel_ring->get_data(offset), pixel_data, size);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_ring->get_id());
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, extent.x, extent.y, 0,
+                     format, type, (void*)offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_pixel_ring->fence(offset, size);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,327 @@
+#include "vegetation.hpp"
+#include "chunk.hpp"
+#include <algorithm>
+#include <numeric>
+
+static int64_t count_instances(const std::vector<DrawCommand>& commands) {
+    int64_t count = 0;
+    for (const DrawCommand& command : commands) {
+        count += command.instance_count;
+    }
+    return count;
+}
+
+// instances the index attribute has to cover
+static size_t get_instance_extent(const std::vector<DrawCommand>& commands) {
+    size_t extent = 0;
+    for (const DrawCommand& command : commands) {
+        extent = std::max<size_t>(
+            extent, command.base_instance + command.instance_count);
+    }
+    return extent;
+}
+
+// species set
+SpeciesSet::SpeciesSet(const std::vector<Species>& species)
+    : m_species(species), m_allocation(MemoryCategory::Geometry) {
+    // indices are rebased while merging, every command uses base vertex 0
+    std::vector<Vertex> vertices;
+    std::vector<int> indices;
+    auto append = [&](const Mesh& mesh) {
+        SpeciesRange range = {(int)indices.size(),
+                              (int)mesh.get_indices().size()};
+        int base = (int)vertices.size();
+        vertices.insert(vertices.end(), mesh.get_vertices().begin(),
+                        mesh.get_vertices().end());
+        for (int index : mesh.get_indices()) {
+            indices.push_back(base + index);
+        }
+        return range;
+    };
+
+    float total_weight = 0.0f;
+    for (const Species& kind : m_species) {
+        total_weight += kind.weight;
+    }
+
+    std::vector<SpeciesParameters> parameters;
+    float threshold = 0.0f;
+    for (const Species& kind : m_species) {
+        m_ranges.push_back(append(*kind.mesh));
+        m_caster_ranges.push_back(
+            kind.caster ? append(*kind.caster) : m_ranges.back());
+
+        threshold += kind.weight / std::max(total_weight, 1e-6f);
+        parameters.push_back({threshold, kind.height_range.x,
+                              kind.height_range.y,
+                              m_ranges.back().first_index});
+    }
+    // rounding never leaves a cell without a species
+    if (!parameters.empty()) {
+        parameters.back().threshold = 1.0f;
+    }
+
+    m_mesh.set(vertices, indices);
+    m_mesh.set_label("species");
+    m_parameters.load_data(parameters);
+    m_parameters.set_label("species parameters");
+    reserve_instances(1 << 18);
+}
+
+SpeciesSet::~SpeciesSet() {
+    if (m_instance_indices) {
+        glDeleteBuffers(1, &m_instance_indices);
+    }
+}
+
+int SpeciesSet::get_count() const { return (int)m_species.size(); }
+
+const Species& SpeciesSet::get_species(int index) const {
+    return m_species[index];
+}
+
+SpeciesRange SpeciesSet::get_range(int index, bool caster) const {
+    return caster ? m_caster_ranges[index] : m_ranges[index];
+}
+
+const Mesh& SpeciesSet::get_mesh() const { return m_mesh; }
+
+void SpeciesSet::bind() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPECIES_BINDING,
+                     m_parameters.get_id());
+}
+
+void SpeciesSet::reserve_instances(size_t count) {
+    if (count <= m_instance_index_count) {
+        return;
+    }
+
+    // instanced attributes start at the base instance of a command, gl 4.5
+    // has no gl_BaseInstance to add to gl_InstanceID
+    std::vector<uint32_t> values(count);
+    std::iota(values.begin(), values.end(), 0u);
+    if (m_instance_indices) {
+        glDeleteBuffers(1, &m_instance_indices);
+    }
+    glGenBuffers(1, &m_instance_indices);
+    glBindVertexArray(m_mesh.get_vertex_array_id());
+    glBindBuffer(GL_ARRAY_BUFFER, m_instance_indices);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(uint32_t), values.data(),
+                 GL_STATIC_DRAW);
+    glVertexAttribIPointer(INSTANCE_INDEX_LOCATION, 1, GL_UNSIGNED_INT, 0,
+                           (void*)0);
+    glVertexAttribDivisor(INSTANCE_INDEX_LOCATION, 1);
+    glEnableVertexAttribArray(INSTANCE_INDEX_LOCATION);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_instance_index_count = count;
+    m_allocation.resize(count * sizeof(uint32_t));
+}
+
+// batch
+VegetationBatch::VegetationBatch(SpeciesSet& species, bool casters)
+    : m_species(species), m_casters(casters) {}
+
+void VegetationBatch::reserve(size_t chunk_count, int draw_count) {
+    size_t capacity = std::max<size_t>(chunk_count, 1) *
+                      m_species.get_count() * draw_count;
+    if (capacity > m_capacity) {
+        m_capacity = capacity;
+        m_commands.create_ring(m_capacity);
+        m_commands.set_label("vegetation commands");
+        m_blades.create_ring(m_capacity);
+        m_blades.set_label("procedural blades");
+    }
+}
+
+void VegetationBatch::begin_frame() {
+    m_commands.begin_frame();
+    m_blades.begin_frame();
+}
+
+void VegetationBatch::end_frame() {
+    m_commands.end_frame();
+    m_blades.end_frame();
+}
+
+void VegetationBatch::add(const Chunk& chunk, int stride) {
+    if (chunk.is_procedural()) {
+        add_procedural(chunk, stride);
+        return;
+    }
+
+    const InstanceRange& instances = chunk.get_instances();
+    if (!instances.is_valid() || chunk.get_grass_count() == 0) {
+        return;
+    }
+
+    const InstanceBuffer* buffer = &instances.get_buffer();
+    auto batch = std::find_if(
+        m_batches.begin(), m_batches.end(),
+        [buffer](const Batch& batch) { return batch.buffer == buffer; });
+    if (batch == m_batches.end()) {
+        m_batches.emplace_back().buffer = buffer;
+        batch = m_batches.end() - 1;
+    }
+
+    for (int i = 0; i < m_species.get_count(); ++i) {
+        GLuint count = chunk.get_species_count(i) / stride;
+        if (count == 0) {
+            continue;
+        }
+        SpeciesRange range = m_species.get_range(i, m_casters);
+        batch->commands.push_back(
+            {(GLuint)range.index_count, count, (GLuint)range.first_index, 0,
+             (GLuint)(instances.get_first() + chunk.get_species_first(i))});
+    }
+}
+
+void VegetationBatch::add_procedural(const Chunk& chunk, int stride) {
+    if (chunk.get_grass_count() == 0 || !chunk.get_noise_map().is_valid()) {
+        return;
+    }
+
+    const TextureArray* height_map = &chunk.get_height_map().get_array();
+    const TextureArray* noise_map = &chunk.get_noise_map().get_array();
+    auto batch = std::find_if(
+        m_batches.begin(), m_batches.end(), [&](const Batch& batch) {
+            return !batch.buffer && batch.height_map == height_map &&
+                   batch.noise_map == noise_map;
+        });
+    if (batch == m_batches.end()) {
+        m_batches.push_back({nullptr, {}, height_map, noise_map, {}});
+        batch = m_batches.end() - 1;
+    }
+
+    // every stride-th cell, the shader collapses the ones that grew nothing
+    // or another species
+    int width = chunk.get_procedural_blades(0).width;
+    GLuint count = (GLuint)(width * width / stride);
+    for (int i = 0; i < m_species.get_count(); ++i) {
+        if (chunk.get_species_count(i) / stride == 0) {
+            continue;
+        }
+        SpeciesRange range = m_species.get_range(i, m_casters);
+        batch->commands.push_back({(GLuint)range.index_count, count,
+                                   (GLuint)range.first_index, 0,
+                                   (GLuint)batch->blades.size()});
+        batch->blades.push_back(chunk.get_procedural_blades(i));
+    }
+}
+
+std::vector<const InstanceBuffer*> VegetationBatch::get_buffers() const {
+    std::vector<const InstanceBuffer*> buffers;
+    for (const Batch& batch : m_batches) {
+        buffers.push_back(batch.buffer);
+    }
+    return buffers;
+}
+
+void VegetationBatch::draw(Shader& shader, Shader* procedural) {
+    // growing the attribute rebinds the vertex array, do it up front
+    for (const Batch& batch : m_batches) {
+        m_species.reserve_instances(batch.buffer
+                                        ? batch.buffer->get_capacity()
+                                        : get_instance_extent(batch.commands));
+    }
+
+    // programs switch between instanced and procedural batches, the mode
+    // uniform goes back to instanced before a program is left
+    GLuint program = 0;
+    GLint batch_location = -1;
+    GLint procedural_location = -1;
+    auto use = [&](Shader& next) {
+        if (next.get_id() == program) {
+            return;
+        }
+        if (program) {
+            glUniform1i(procedural_location, 0);
+        }
+        program = next.get_id();
+        glUseProgram(program);
+        FrameCounters::add(FrameCounter::ProgramBinds);
+        batch_location = glGetUniformLocation(program, "batch_index");
+        procedural_location = glGetUniformLocation(program, "procedural");
+    };
+
+    glBindVertexArray(m_species.get_mesh().get_vertex_array_id());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands.get_id());
+    for (size_t i = 0; i < m_batches.size(); ++i) {
+        const Batch& batch = m_batches[i];
+        size_t offset = push(batch);
+        if (offset == ShaderBuffer<DrawCommand>::npos) {
+            continue;
+        }
+        if (batch.buffer) {
+            use(shader);
+            glUniform1i(procedural_location, 0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0,
+                             batch.buffer->get_id());
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_ORDER_BINDING,
+                             batch.buffer->get_order_id());
+        } else {
+            size_t blades =
+                m_blades.push(batch.blades.data(), batch.blades.size());
+            if (blades == ShaderBuffer<ProceduralBlades>::npos) {
+                continue;
+            }
+            use(procedural ? *procedural : shader);
+            glUniform1i(procedural_location, 1);
+            m_blades.bind_range(0, blades, batch.blades.size());
+            m_species.bind();
+            glActiveTexture(GL_TEXTURE0 + PROCEDURAL_HEIGHT_MAP_TEXTURE_UNIT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, batch.height_map->get_id());
+            glActiveTexture(GL_TEXTURE0 + PROCEDURAL_NOISE_MAP_TEXTURE_UNIT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, batch.noise_map->get_id());
+            glActiveTexture(GL_TEXTURE0);
+            FrameCounters::add(FrameCounter::TextureBinds, 2);
+        }
+        glUniform1i(batch_location, (int)i);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    (const void*)offset,
+                                    batch.commands.size(), 0);
+        FrameCounters::add(FrameCounter::DrawCalls);
+        FrameCounters::add(FrameCounter::Instances,
+                           count_instances(batch.commands));
+    }
+    if (program) {
+        glUniform1i(procedural_location, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_ORDER_BINDING, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    m_batches.clear();
+}
+
+void VegetationBatch::submit(RenderQueue& queue, RenderPass pass,
+                             Shader& shader, const glm::vec3& position) {
+    std::vector<Batch> procedural;
+    for (Batch& batch : m_batches) {
+        if (!batch.buffer) {
+            procedural.push_back(std::move(batch));
+            continue;
+        }
+        m_species.reserve_instances(batch.buffer->get_capacity());
+        size_t offset = push(batch);
+        if (offset == ShaderBuffer<DrawCommand>::npos) {
+            continue;
+        }
+        queue.submit_indirect(pass, m_species.get_mesh(), shader,
+                              batch.buffer->get_id(),
+                              batch.buffer->get_order_id(), m_commands.get_id(),
+                              offset, batch.commands.size(), position);
+        FrameCounters::add(FrameCounter::Instances,
+                           count_instances(batch.commands));
+    }
+    m_batches = std::move(procedural);
+}
+
+size_t VegetationBatch::push(const Batch& batch) {
+    if (batch.commands.empty()) {
+        return ShaderBuffer<DrawCommand>::npos;
+    }
+    return m_commands.push(batch.commands.data(), batch.commands.size());
+}
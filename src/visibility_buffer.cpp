@@ -0,0 +1,114 @@
+#include "visibility_buffer.hpp"
+#include "gl_debug.hpp"
+#include "glm/matrix.hpp"
+#include <iostream>
+#include <vector>
+
+VisibilityBuffer::VisibilityBuffer(const SpeciesSet& species,
+                                   const glm::ivec2& size)
+    : m_species(species), m_size(size),
+      m_ids(MemoryCategory::RenderTarget),
+      m_depth(MemoryCategory::RenderTarget) {
+    // integer textures are only complete without filtering
+    m_ids.load_texture_from_byte(0, GL_UNSIGNED_INT, m_size, GL_RG32UI,
+                                 GL_RG_INTEGER);
+    m_ids.set_filter_mode(GL_NEAREST);
+    // the format of the render texture depth, so it can be blitted over
+    m_depth.load_texture_from_byte(0, GL_UNSIGNED_INT_24_8, m_size,
+                                   GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL);
+    m_depth.set_filter_mode(GL_NEAREST);
+
+    glGenFramebuffers(1, &m_frame_buffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frame_buffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           m_ids.get_id(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                           GL_TEXTURE_2D, m_depth.get_id(), 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR WHILE INITIALIZING VISIBILITY BUFFER" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // one triangle over the whole viewport
+    glm::vec3 normal(0.0f, 0.0f, 1.0f);
+    glm::vec3 color(1.0f);
+    std::vector<Vertex> vertices = {
+        {{-1.0f, -1.0f, 0.0f}, {0.0f, 0.0f}, normal, color},
+        {{3.0f, -1.0f, 0.0f}, {2.0f, 0.0f}, normal, color},
+        {{-1.0f, 3.0f, 0.0f}, {0.0f, 2.0f}, normal, color}};
+    std::vector<int> indices = {0, 1, 2};
+    m_screen.set(vertices, indices);
+}
+
+VisibilityBuffer::~VisibilityBuffer() {
+    glDeleteFramebuffers(1, &m_frame_buffer);
+}
+
+void VisibilityBuffer::draw(RenderTexture& target, const glm::ivec2& size,
+                            const Camera& camera, VegetationBatch& vegetation,
+                            Shader& visibility, Shader& resolve) {
+    GlDebugGroup group("visibility buffer");
+    std::vector<const InstanceBuffer*> buffers = vegetation.get_buffers();
+
+    // the blades test against the depth of the opaque pass
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.get_frame_buffer_id());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_frame_buffer);
+    glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y,
+                      GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frame_buffer);
+    GLuint empty[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, empty);
+    vegetation.draw(visibility);
+
+    // every pixel writes the depth it was shaded at, the test already ran
+    target.begin_draw();
+    glDepthFunc(GL_ALWAYS);
+    glActiveTexture(GL_TEXTURE0 + VISIBILITY_ID_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_ids.get_id());
+    glActiveTexture(GL_TEXTURE0 + VISIBILITY_DEPTH_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_depth.get_id());
+    glActiveTexture(GL_TEXTURE0);
+    FrameCounters::add(FrameCounter::TextureBinds, 2);
+
+    resolve.set_uniform_int("visibility_ids", VISIBILITY_ID_TEXTURE_UNIT);
+    resolve.set_uniform_int("visibility_depth",
+                            VISIBILITY_DEPTH_TEXTURE_UNIT);
+    resolve.set_uniform_matrix4("inverse_projection",
+                                glm::inverse(camera.get_matrix()));
+    resolve.set_uniform_vector2("viewport_size", glm::vec2(size));
+    m_species.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_VERTEX_BINDING,
+                     m_species.get_mesh().get_vertex_buffer_id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_INDEX_BINDING,
+                     m_species.get_mesh().get_element_buffer_id());
+
+    glUseProgram(resolve.get_id());
+    FrameCounters::add(FrameCounter::ProgramBinds);
+    GLint batch_location =
+        glGetUniformLocation(resolve.get_id(), "batch_index");
+    glBindVertexArray(m_screen.get_vertex_array_id());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        // procedural blades have no instances to shade from
+        if (!buffers[i]) {
+            continue;
+        }
+        glUniform1i(batch_location, (int)i);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[i]->get_id());
+        glDrawElements(GL_TRIANGLES, m_screen.get_index_count(),
+                       GL_UNSIGNED_INT, nullptr);
+        FrameCounters::add(FrameCounter::DrawCalls);
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    for (int binding :
+         {0, VISIBILITY_VERTEX_BINDING, VISIBILITY_INDEX_BINDING}) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+    glActiveTexture(GL_TEXTURE0 + VISIBILITY_ID_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0 + VISIBILITY_DEPTH_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glDepthFunc(GL_LESS);
+}
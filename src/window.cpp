@@ -1,4 +1,6 @@
 #include "window.hpp"
+#include "gl_debug.hpp"
+#include <algorithm>
 #include <iostream>
 #include <memory>
 
@@ -31,73 +33,122 @@ void Timer::set_pause(bool flag) {
 // input
 
 void Input::clear_inputs() {
-    for (auto it = m_key_down.begin(); it != m_key_down.end(); ++it) {
-        it->second = false;
-    }
-    for (auto it = m_key_up.begin(); it != m_key_up.end(); ++it) {
-        it->second = false;
-    }
-    for (auto it = m_mouse_down.begin(); it != m_mouse_down.end(); ++it) {
-        it->second = false;
-    }
-    for (auto it = m_mouse_up.begin(); it != m_mouse_up.end(); ++it) {
-        it->second = false;
-    }
+    std::fill(m_key_down.begin(), m_key_down.end(), false);
+    std::fill(m_key_up.begin(), m_key_up.end(), false);
+    std::fill(m_mouse_down.begin(), m_mouse_down.end(), false);
+    std::fill(m_mouse_up.begin(), m_mouse_up.end(), false);
+    m_frame_begin = m_event_head;
+    m_first_event_time = -1.0;
 }
 
-bool Input::is_key_pressed(GLuint key) { return m_key_press[key]; }
+// codes outside the arrays (GLFW_KEY_UNKNOWN wraps around) read as released
+bool Input::is_key_pressed(GLuint key) {
+    return key < KEY_COUNT && m_key_press[key];
+}
 
-bool Input::is_key_down(GLuint key) { return m_key_down[key]; }
+bool Input::is_key_down(GLuint key) {
+    return key < KEY_COUNT && m_key_down[key];
+}
 
-bool Input::is_key_up(GLuint key) { return m_key_up[key]; }
+bool Input::is_key_up(GLuint key) { return key < KEY_COUNT && m_key_up[key]; }
 
-bool Input::is_mouse_pressed(GLuint button) { return m_mouse_press[button]; }
+bool Input::is_mouse_pressed(GLuint button) {
+    return button < BUTTON_COUNT && m_mouse_press[button];
+}
 
-bool Input::is_mouse_down(GLuint button) { return m_mouse_down[button]; }
+bool Input::is_mouse_down(GLuint button) {
+    return button < BUTTON_COUNT && m_mouse_down[button];
+}
 
-bool Input::is_mouse_up(GLuint button) { return m_mouse_up[button]; }
+bool Input::is_mouse_up(GLuint button) {
+    return button < BUTTON_COUNT && m_mouse_up[button];
+}
 
-void Input::set_key_pressed(GLuint key, bool flag) { m_key_press[key] = flag; }
+void Input::set_key_pressed(GLuint key, bool flag) {
+    if (key < KEY_COUNT) {
+        m_key_press[key] = flag;
+    }
+}
 
-void Input::set_key_down(GLuint key, bool flag) { m_key_down[key] = flag; }
+void Input::set_key_down(GLuint key, bool flag) {
+    if (key < KEY_COUNT) {
+        m_key_down[key] = flag;
+    }
+}
 
-void Input::set_key_up(GLuint key, bool flag) { m_key_up[key] = flag; }
+void Input::set_key_up(GLuint key, bool flag) {
+    if (key < KEY_COUNT) {
+        m_key_up[key] = flag;
+    }
+}
 
 void Input::set_mouse_pressed(GLuint button, bool flag) {
-    m_mouse_press[button] = flag;
+    if (button < BUTTON_COUNT) {
+        m_mouse_press[button] = flag;
+    }
 }
 
 void Input::set_mouse_down(GLuint button, bool flag) {
-    m_mouse_down[button] = flag;
+    if (button < BUTTON_COUNT) {
+        m_mouse_down[button] = flag;
+    }
 }
 
 void Input::set_mouse_up(GLuint button, bool flag) {
-    m_mouse_up[button] = flag;
+    if (button < BUTTON_COUNT) {
+        m_mouse_up[button] = flag;
+    }
+}
+
+void Input::push_event(const InputEvent& event) {
+    if (m_first_event_time < 0.0) {
+        m_first_event_time = event.time;
+    }
+    m_events[m_event_head % EVENT_CAPACITY] = event;
+    m_event_head++;
+}
+
+int Input::get_event_count() const {
+    return (int)std::min<uint64_t>(m_event_head - m_frame_begin,
+                                   EVENT_CAPACITY);
+}
+
+const InputEvent& Input::get_event(int index) const {
+    uint64_t first = m_event_head - get_event_count();
+    return m_events[(first + index) % EVENT_CAPACITY];
 }
 
+double Input::get_first_event_time() const { return m_first_event_time; }
+
 // window
 bool Window::m_glfw_initialized = false;
 int Window::m_active_windows = 0;
 
-Window::Window(const glm::ivec2& size, const std::string& title) {
+Window::Window(const glm::ivec2& size, const std::string& title,
+               bool visible) {
     if (!m_glfw_initialized) {
         glfwInit();
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        gl_debug_request_context();
         // glfwWindowHint(GLFW_SAMPLES, 4);
-        glfwSwapInterval(1);
         m_glfw_initialized = true;
     }
+    glfwWindowHint(GLFW_VISIBLE, visible);
     m_handler = glfwCreateWindow(size.x, size.y, title.c_str(), 0, 0);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
     if (m_handler == 0) {
         std::cout << "Failed to create window" << std::endl;
     } else {
         m_size = size;
         m_active_windows++;
         glfwMakeContextCurrent(m_handler);
+        // needs a current context, before this point it was a no-op
+        glfwSwapInterval(1);
         glfwSetKeyCallback(m_handler, glfw_key_callback);
         glfwSetMouseButtonCallback(m_handler, glfw_mouse_callback);
+        glfwSetCursorPosCallback(m_handler, glfw_cursor_callback);
         glfwSetWindowUserPointer(m_handler, this);
     }
 }
@@ -131,7 +182,8 @@ void Window::set_input_handler(std::shared_ptr<Input> input) {
 
 void Window::poll_events() {
     m_input->clear_inputs();
-    glfwWaitEventsTimeout(1.0f / 300.0f);
+    // frame pacing does the waiting, blocking here only adds input latency
+    glfwPollEvents();
 
     double x = 0.0f;
     double y = 0.0f;
@@ -143,9 +195,13 @@ void Window::close() { glfwSetWindowShouldClose(m_handler, true); }
 
 void Window::display() { glfwSwapBuffers(m_handler); }
 
+void Window::set_swap_interval(int interval) { glfwSwapInterval(interval); }
+
 void Window::glfw_key_callback(GLFWwindow* window, int key, int scancode,
                                int action, int mod) {
     Window* wrapper = (Window*)glfwGetWindowUserPointer(window);
+    wrapper->m_input->push_event(
+        {glfwGetTime(), InputEventType::Key, key, action});
 
     if (action != GLFW_RELEASE) {
         wrapper->m_input->set_key_pressed(key, action == GLFW_REPEAT ||
@@ -161,6 +217,11 @@ void Window::glfw_key_callback(GLFWwindow* window, int key, int scancode,
 void Window::glfw_mouse_callback(GLFWwindow* window, int button, int action,
                                  int mod) {
     Window* wrapper = (Window*)glfwGetWindowUserPointer(window);
+    double x = 0.0;
+    double y = 0.0;
+    glfwGetCursorPos(window, &x, &y);
+    wrapper->m_input->push_event({glfwGetTime(), InputEventType::Mouse, button,
+                                  action, glm::vec2(x, y)});
 
     if (action != GLFW_RELEASE) {
         wrapper->m_input->set_mouse_pressed(button, action == GLFW_REPEAT ||
@@ -171,4 +232,10 @@ void Window::glfw_mouse_callback(GLFWwindow* window, int button, int action,
 
     wrapper->m_input->set_mouse_down(button, action == GLFW_PRESS);
     wrapper->m_input->set_mouse_up(button, action == GLFW_RELEASE);
+}
+
+void Window::glfw_cursor_callback(GLFWwindow* window, double x, double y) {
+    Window* wrapper = (Window*)glfwGetWindowUserPointer(window);
+    wrapper->m_input->push_event({glfwGetTime(), InputEventType::Cursor, 0,
+                                  GLFW_REPEAT, glm::vec2(x, y)});
 }
\ No newline at end of file
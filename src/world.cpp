@@ -0,0 +1,459 @@
+#include "world.hpp"
+#include "vegetation.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// config
+bool load_world_config(const std::filesystem::path& path,
+                       WorldConfig& config) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "FAILED TO OPEN WORLD CONFIG: " << path << std::endl;
+        return false;
+    }
+
+    WorldConfig result = config;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::stringstream stream(line);
+        std::string key;
+        if (!(stream >> key)) {
+            continue;
+        }
+
+        if (key == "chunk_min") {
+            stream >> result.chunk_min.x >> result.chunk_min.y;
+        } else if (key == "chunk_max") {
+            stream >> result.chunk_max.x >> result.chunk_max.y;
+        } else if (key == "chunk_size") {
+            stream >> result.chunk_size;
+        } else if (key == "grass_per_unit") {
+            stream >> result.grass_per_unit;
+        } else if (key == "terrain_height") {
+            stream >> result.terrain_height;
+        } else if (key == "terrain_scale") {
+            stream >> result.terrain_scale;
+        } else if (key == "seed") {
+            stream >> result.seed;
+        } else if (key == "wind_direction") {
+            stream >> result.wind_direction;
+        } else if (key == "gpu_terrain") {
+            stream >> result.gpu_terrain;
+        } else if (key == "validate_terrain") {
+            stream >> result.validate_terrain;
+        } else if (key == "density_map") {
+            stream >> result.density_map;
+        } else if (key == "slope_fade") {
+            stream >> result.slope_fade.x >> result.slope_fade.y;
+        } else if (key == "altitude_range") {
+            stream >> result.altitude_range.x >> result.altitude_range.y;
+        } else if (key == "procedural_blades") {
+            stream >> result.procedural_blades;
+        } else {
+            std::cerr << "UNKNOWN WORLD CONFIG KEY: " << key << std::endl;
+            continue;
+        }
+
+        if (stream.fail()) {
+            std::cerr << "INVALID WORLD CONFIG VALUE FOR: " << key << std::endl;
+            return false;
+        }
+    }
+
+    // the low poly ground takes every fourth vertex
+    if (result.chunk_size <= 0 || result.chunk_size % 4 != 0 ||
+        result.grass_per_unit <= 0 ||
+        result.chunk_max.x <= result.chunk_min.x ||
+        result.chunk_max.y <= result.chunk_min.y ||
+        result.slope_fade.y <= result.slope_fade.x ||
+        result.altitude_range.y < result.altitude_range.x) {
+        std::cerr << "INVALID WORLD CONFIG: " << path << std::endl;
+        return false;
+    }
+
+    config = result;
+    return true;
+}
+
+bool save_world_config(const std::filesystem::path& path,
+                       const WorldConfig& config) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "FAILED TO OPEN WORLD CONFIG: " << path << std::endl;
+        return false;
+    }
+
+    file << "# chunk coordinates, max is exclusive\n";
+    file << "chunk_min " << config.chunk_min.x << " " << config.chunk_min.y
+         << "\n";
+    file << "chunk_max " << config.chunk_max.x << " " << config.chunk_max.y
+         << "\n";
+    file << "chunk_size " << config.chunk_size << "\n";
+    file << "grass_per_unit " << config.grass_per_unit << "\n";
+    file << "terrain_height " << config.terrain_height << "\n";
+    file << "terrain_scale " << config.terrain_scale << "\n";
+    file << "seed " << config.seed << "\n";
+    file << "wind_direction " << config.wind_direction << "\n";
+    file << "gpu_terrain " << config.gpu_terrain << "\n";
+    file << "validate_terrain " << config.validate_terrain << "\n";
+    file << "# density masks\n";
+    file << "density_map "
+         << (config.density_map.empty() ? "none" : config.density_map) << "\n";
+    file << "slope_fade " << config.slope_fade.x << " " << config.slope_fade.y
+         << "\n";
+    file << "altitude_range " << config.altitude_range.x << " "
+         << config.altitude_range.y << "\n";
+    file << "# blades recomputed per frame instead of stored\n";
+    file << "procedural_blades " << config.procedural_blades << "\n";
+    return true;
+}
+
+uint32_t compare_world_config(const WorldConfig& a, const WorldConfig& b) {
+    uint32_t changes = 0;
+    if (a.wind_direction != b.wind_direction) {
+        changes |= WORLD_WIND_CHANGED;
+    }
+    if (a.grass_per_unit != b.grass_per_unit ||
+        a.density_map != b.density_map || a.slope_fade != b.slope_fade ||
+        a.altitude_range != b.altitude_range ||
+        a.procedural_blades != b.procedural_blades) {
+        changes |= WORLD_DENSITY_CHANGED;
+    }
+    if (a.terrain_height != b.terrain_height ||
+        a.terrain_scale != b.terrain_scale || a.seed != b.seed ||
+        a.gpu_terrain != b.gpu_terrain ||
+        a.validate_terrain != b.validate_terrain) {
+        changes |= WORLD_TERRAIN_CHANGED;
+    }
+    if (a.chunk_min != b.chunk_min || a.chunk_max != b.chunk_max ||
+        a.chunk_size != b.chunk_size) {
+        changes |= WORLD_LAYOUT_CHANGED;
+    }
+    return changes;
+}
+
+// origin and inverse size of the area the density map is stretched over
+static glm::vec4 get_density_bounds(const WorldConfig& config) {
+    float chunk_size = (float)config.chunk_size;
+    glm::vec2 origin = glm::vec2(config.chunk_min) * chunk_size;
+    glm::vec2 size =
+        glm::vec2(config.chunk_max - config.chunk_min) * chunk_size;
+    return glm::vec4(origin.x, origin.y, 1.0f / size.x, 1.0f / size.y);
+}
+
+// polls an array or buffer stays empty before it is freed, so a chunk that
+// regenerates doesn't free and reallocate its pool storage
+static constexpr int POOL_IDLE_POLLS = 120;
+
+static bool has_density_map(const WorldConfig& config) {
+    return !config.density_map.empty() && config.density_map != "none";
+}
+
+// world
+World::World(const WorldConfig& config, const SpeciesSet& species,
+             Shader& generator, Shader& compaction, Shader& terrain,
+             ComputeScheduler& scheduler, UploadService& uploads,
+             const ChunkCache* cache)
+    : m_species(species), m_generator(generator), m_compaction(compaction),
+      m_scheduler(scheduler), m_uploads(uploads), m_cache(cache),
+      m_config(config),
+      m_terrain(terrain), m_height_maps(GL_R16), m_noise_maps(GL_R16F),
+      m_instances(sizeof(GrassBuffer)) {
+    apply_rules();
+    m_terrain.set_seed(m_config.seed);
+
+    unsigned int worker_count =
+        std::max(1u, std::thread::hardware_concurrency() / 2);
+    for (unsigned int i = 0; i < worker_count; ++i) {
+        m_workers.emplace_back(&World::run, this);
+    }
+
+    schedule(m_config, true);
+    publish();
+}
+
+World::~World() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_condition.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+uint32_t World::apply(const WorldConfig& config) {
+    uint32_t changes = compare_world_config(m_config, config);
+    if (!changes) {
+        return 0;
+    }
+
+    // chunks of another size can't be kept even where the layout overlaps
+    bool rebuild_all = (changes & WORLD_TERRAIN_CHANGED) ||
+                       config.chunk_size != m_config.chunk_size;
+    // the density map follows the world bounds, a new layout moves it
+    // under the chunks that are kept. without a map nothing moves
+    bool map_moved = has_density_map(config) &&
+                     get_density_bounds(config) != get_density_bounds(m_config);
+    m_config = config;
+
+    if (changes & WORLD_DENSITY_CHANGED) {
+        apply_rules();
+    } else if (changes & WORLD_LAYOUT_CHANGED) {
+        set_mask_uniforms(m_generator);
+    }
+    if ((changes & WORLD_DENSITY_CHANGED) || map_moved) {
+        for (std::shared_ptr<Chunk>& chunk : m_chunks) {
+            chunk->set_procedural(m_config.procedural_blades);
+            chunk->regenerate(m_config.grass_per_unit);
+        }
+        for (auto& [coordinate, chunk] : m_pending) {
+            chunk->set_procedural(m_config.procedural_blades);
+            chunk->regenerate(m_config.grass_per_unit);
+        }
+    }
+
+    if (changes & (WORLD_TERRAIN_CHANGED | WORLD_LAYOUT_CHANGED)) {
+        m_terrain.set_seed(m_config.seed);
+        schedule(m_config, rebuild_all);
+    }
+
+    return changes;
+}
+
+bool World::poll() {
+    // arrays emptied by chunks the render thread released since
+    m_height_maps.trim(POOL_IDLE_POLLS);
+    m_noise_maps.trim(POOL_IDLE_POLLS);
+    m_instances.trim(POOL_IDLE_POLLS);
+
+    std::deque<BuildResult> results;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        results.swap(m_results);
+    }
+
+    bool changed = false;
+    for (BuildResult& result : results) {
+        if (result.generation != m_generation) {
+            continue;
+        }
+
+        int64_t chunk_key = key(result.geometry.coordinate);
+        std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>(
+            m_species, m_generator, m_compaction, m_scheduler, m_height_maps,
+            m_noise_maps, m_instances, std::move(result.geometry),
+            m_config.grass_per_unit, &m_uploads, &m_terrain);
+        chunk->set_procedural(m_config.procedural_blades);
+        m_outstanding--;
+        if (m_streaming) {
+            m_chunks.push_back(chunk);
+            m_chunk_map[chunk_key] = chunk;
+            changed = true;
+        } else {
+            m_pending[chunk_key] = chunk;
+        }
+    }
+
+    // a gpu built terrain only reaches the cpu queries once read back
+    bool terrain_read = false;
+    for (const std::shared_ptr<Chunk>& chunk : m_chunks) {
+        terrain_read = chunk->take_terrain_readback() || terrain_read;
+    }
+
+    if (m_streaming) {
+        m_streaming = m_outstanding > 0;
+        if (changed || terrain_read) {
+            publish();
+        }
+        return false;
+    }
+    if (terrain_read) {
+        publish();
+    }
+
+    if (!m_swap_pending || m_outstanding > 0) {
+        return false;
+    }
+
+    // every new chunk has to be drawable before any old one goes away
+    bool ready = true;
+    for (auto& [coordinate, chunk] : m_pending) {
+        ready = chunk->prepare() && ready;
+    }
+    if (!ready) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    std::unordered_map<int64_t, std::shared_ptr<Chunk>> chunk_map;
+    for (const glm::ivec2& coordinate : m_layout) {
+        int64_t chunk_key = key(coordinate);
+        auto pending = m_pending.find(chunk_key);
+        std::shared_ptr<Chunk> chunk = pending != m_pending.end()
+                                           ? pending->second
+                                           : m_chunk_map[chunk_key];
+        chunks.push_back(chunk);
+        chunk_map[chunk_key] = chunk;
+    }
+    m_chunks = std::move(chunks);
+    m_chunk_map = std::move(chunk_map);
+    m_pending.clear();
+    m_swap_pending = false;
+    publish();
+    return true;
+}
+
+std::shared_ptr<const WorldSnapshot> World::get_snapshot() const {
+    std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    return m_snapshot;
+}
+
+const WorldConfig& World::get_config() const { return m_config; }
+
+int World::get_pending_count() const {
+    return m_outstanding + (int)m_pending.size();
+}
+
+size_t World::evict(size_t bytes) {
+    std::vector<Chunk*> chunks;
+    for (const std::shared_ptr<Chunk>& chunk : m_chunks) {
+        chunks.push_back(chunk.get());
+    }
+    std::sort(chunks.begin(), chunks.end(), [](Chunk* a, Chunk* b) {
+        return a->get_last_used() < b->get_last_used();
+    });
+
+    // like layers, runs only give memory back once their buffer is empty,
+    // so the freed bytes are measured after trimming instead of summed
+    size_t total = MemoryTracker::get_total();
+    size_t freed = 0;
+    for (Chunk* chunk : chunks) {
+        if (freed >= bytes) {
+            break;
+        }
+        if (!chunk->evict()) {
+            continue;
+        }
+        MemoryTracker::count_eviction();
+        m_noise_maps.trim();
+        m_instances.trim();
+        freed = total - std::min(total, MemoryTracker::get_total());
+    }
+    return freed;
+}
+
+int64_t World::key(const glm::ivec2& coordinate) {
+    return ((int64_t)coordinate.x << 32) | (uint32_t)coordinate.y;
+}
+
+void World::schedule(const WorldConfig& config, bool rebuild_all) {
+    m_generation++;
+    m_pending.clear();
+    m_layout.clear();
+    m_outstanding = 0;
+    m_streaming = m_chunks.empty();
+    m_swap_pending = !m_streaming;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // whatever the previous rebuild left is stale now
+        m_jobs.clear();
+        m_results.clear();
+        for (int x = config.chunk_min.x; x < config.chunk_max.x; ++x) {
+            for (int y = config.chunk_min.y; y < config.chunk_max.y; ++y) {
+                glm::ivec2 coordinate(x, y);
+                m_layout.push_back(coordinate);
+                if (!rebuild_all && m_chunk_map.count(key(coordinate))) {
+                    continue;
+                }
+                m_jobs.push_back({m_generation, coordinate, config});
+                m_outstanding++;
+            }
+        }
+    }
+    m_condition.notify_all();
+}
+
+void World::publish() {
+    std::shared_ptr<WorldSnapshot> snapshot = std::make_shared<WorldSnapshot>(
+        WorldSnapshot{m_chunks, HeightfieldStore(m_config.chunk_size)});
+    for (const std::shared_ptr<Chunk>& chunk : m_chunks) {
+        if (chunk->get_heightfield()) {
+            snapshot->terrain.insert(chunk->get_coordinate(),
+                                     chunk->get_heightfield());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    m_snapshot = snapshot;
+}
+
+void World::apply_rules() {
+    if (m_config.density_map.empty() || m_config.density_map == "none") {
+        uint8_t white[4] = {255, 255, 255, 255};
+        m_density_map.load_texture_from_byte(white, GL_UNSIGNED_BYTE,
+                                             glm::ivec2(1), GL_RGBA8, GL_RGBA);
+    } else {
+        m_density_map.load_texture_from_path(m_config.density_map);
+    }
+    m_density_map.set_filter_mode(GL_LINEAR);
+    m_density_map.set_wrap_mode(GL_CLAMP_TO_EDGE);
+
+    set_mask_uniforms(m_generator);
+
+    glActiveTexture(GL_TEXTURE0 + DENSITY_MAP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_density_map.get_id());
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void World::set_mask_uniforms(Shader& shader) const {
+    shader.set_uniform_int("density_map", DENSITY_MAP_TEXTURE_UNIT);
+    shader.set_uniform_vector4("density_map_bounds",
+                               get_density_bounds(m_config));
+    shader.set_uniform_vector2("slope_fade", m_config.slope_fade);
+    shader.set_uniform_vector2("altitude_range", m_config.altitude_range);
+}
+
+void World::run() {
+    while (true) {
+        BuildJob job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock,
+                             [this]() { return !m_running || !m_jobs.empty(); });
+            if (!m_running) {
+                break;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        ChunkGeometry geometry;
+        if (job.config.gpu_terrain) {
+            geometry = Chunk::build_bounds(
+                job.coordinate, job.config.chunk_size,
+                job.config.terrain_height, job.config.terrain_scale);
+            if (job.config.validate_terrain) {
+                geometry.heightfield =
+                    Chunk::build(job.coordinate, job.config.chunk_size,
+                                 job.config.terrain_height,
+                                 job.config.terrain_scale, job.config.seed)
+                        .heightfield;
+            }
+        } else if (!m_cache ||
+                   !m_cache->load(job.coordinate, job.config, geometry)) {
+            geometry = Chunk::build(job.coordinate, job.config.chunk_size,
+                                    job.config.terrain_height,
+                                    job.config.terrain_scale, job.config.seed);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results.push_back({job.generation, std::move(geometry)});
+    }
+}
@@ -0,0 +1,323 @@
+#include "baked_texture.hpp"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// bakes an image into a .ftex container: flipped for OpenGL, with the full mip
+// chain precomputed and optionally block compressed
+//
+// usage: texture_bake <input> <output.ftex> [--format raw|bc1|bc3]
+
+enum class BakeFormat { Raw, BC1, BC3 };
+
+struct Image {
+    int width;
+    int height;
+    int channels;
+    std::vector<uint8_t> pixels;
+};
+
+static Image downsample(const Image& image) {
+    Image result;
+    result.width = std::max(image.width / 2, 1);
+    result.height = std::max(image.height / 2, 1);
+    result.channels = image.channels;
+    result.pixels.resize((size_t)result.width * result.height * result.channels);
+
+    for (int y = 0; y < result.height; ++y) {
+        for (int x = 0; x < result.width; ++x) {
+            int x0 = std::min(x * 2, image.width - 1);
+            int x1 = std::min(x * 2 + 1, image.width - 1);
+            int y0 = std::min(y * 2, image.height - 1);
+            int y1 = std::min(y * 2 + 1, image.height - 1);
+            for (int c = 0; c < image.channels; ++c) {
+                auto at = [&](int px, int py) {
+                    return (int)image.pixels[((size_t)py * image.width + px) *
+                                                 image.channels +
+                                             c];
+                };
+                int sum = at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1);
+                result.pixels[((size_t)y * result.width + x) * result.channels +
+                              c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+
+    return result;
+}
+
+static uint16_t pack_565(const uint8_t* color) {
+    return (uint16_t)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) |
+                      (color[2] >> 3));
+}
+
+static void unpack_565(uint16_t packed, int* color) {
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// fetches a 4x4 block as rgba, clamping at the image border
+static void fetch_block(const Image& image, int bx, int by, uint8_t* block) {
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            int px = std::min(bx * 4 + x, image.width - 1);
+            int py = std::min(by * 4 + y, image.height - 1);
+            const uint8_t* source =
+                &image.pixels[((size_t)py * image.width + px) * image.channels];
+            uint8_t* target = &block[(y * 4 + x) * 4];
+            target[0] = source[0];
+            target[1] = image.channels > 1 ? source[1] : source[0];
+            target[2] = image.channels > 2 ? source[2] : source[0];
+            target[3] = image.channels > 3 ? source[3] : 255;
+        }
+    }
+}
+
+static void encode_color_block(const uint8_t* block, bool allow_three_color,
+                               uint8_t* output) {
+    uint8_t low[3] = {255, 255, 255};
+    uint8_t high[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            low[c] = std::min(low[c], block[i * 4 + c]);
+            high[c] = std::max(high[c], block[i * 4 + c]);
+        }
+    }
+
+    uint16_t c0 = pack_565(high);
+    uint16_t c1 = pack_565(low);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    int palette[4][3];
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1 || !allow_three_color) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int best_distance = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = block[i * 4 + c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+
+    output[0] = c0 & 0xff;
+    output[1] = c0 >> 8;
+    output[2] = c1 & 0xff;
+    output[3] = c1 >> 8;
+    std::memcpy(output + 4, &indices, 4);
+}
+
+static void encode_alpha_block(const uint8_t* block, uint8_t* output) {
+    uint8_t a0 = 0;
+    uint8_t a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, block[i * 4 + 3]);
+        a1 = std::min(a1, block[i * 4 + 3]);
+    }
+
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int i = 1; i < 7; ++i) {
+        palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int best_distance = 1 << 30;
+            for (int p = 0; p < 8; ++p) {
+                int distance = std::abs(block[i * 4 + 3] - palette[p]);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+
+    output[0] = a0;
+    output[1] = a1;
+    for (int i = 0; i < 6; ++i) {
+        output[2 + i] = (uint8_t)(indices >> (i * 8));
+    }
+}
+
+static std::vector<uint8_t> compress(const Image& image, BakeFormat format) {
+    int blocks_x = (image.width + 3) / 4;
+    int blocks_y = (image.height + 3) / 4;
+    int block_size = format == BakeFormat::BC1 ? 8 : 16;
+    std::vector<uint8_t> output((size_t)blocks_x * blocks_y * block_size);
+
+    uint8_t block[64];
+    for (int by = 0; by < blocks_y; ++by) {
+        for (int bx = 0; bx < blocks_x; ++bx) {
+            fetch_block(image, bx, by, block);
+            uint8_t* target =
+                &output[((size_t)by * blocks_x + bx) * block_size];
+            if (format == BakeFormat::BC1) {
+                encode_color_block(block, true, target);
+            } else {
+                encode_alpha_block(block, target);
+                encode_color_block(block, false, target + 8);
+            }
+        }
+    }
+
+    return output;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: texture_bake <input> <output"
+                  << BAKED_TEXTURE_EXTENSION << "> [--format raw|bc1|bc3]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path input_path = argv[1];
+    std::filesystem::path output_path = argv[2];
+    BakeFormat format = BakeFormat::Raw;
+    for (int i = 3; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "bc1") {
+                format = BakeFormat::BC1;
+            } else if (name == "bc3") {
+                format = BakeFormat::BC3;
+            } else if (name != "raw") {
+                std::cerr << "UNKNOWN FORMAT: " << name << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+    Image image;
+    uint8_t* pixel_data =
+        stbi_load(input_path.generic_string().c_str(), &image.width,
+                  &image.height, &image.channels, 0);
+    if (!pixel_data) {
+        std::cerr << "FAILED TO LOAD IMAGE AT PATH: " << input_path
+                  << std::endl;
+        return 1;
+    }
+    image.pixels.assign(pixel_data, pixel_data + (size_t)image.width *
+                                                     image.height *
+                                                     image.channels);
+    stbi_image_free(pixel_data);
+
+    BakedTextureHeader header = {};
+    std::memcpy(header.magic, BAKED_TEXTURE_MAGIC, 4);
+    header.version = BAKED_TEXTURE_VERSION;
+    header.width = image.width;
+    header.height = image.height;
+    header.channel_count = image.channels;
+    switch (format) {
+    case BakeFormat::BC1:
+        header.internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        break;
+    case BakeFormat::BC3:
+        header.internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        break;
+    case BakeFormat::Raw:
+        header.type = GL_UNSIGNED_BYTE;
+        switch (image.channels) {
+        case 1:
+            header.internal_format = GL_R8;
+            header.format = GL_RED;
+            break;
+        case 2:
+            header.internal_format = GL_RG8;
+            header.format = GL_RG;
+            break;
+        case 3:
+            header.internal_format = GL_RGB8;
+            header.format = GL_RGB;
+            break;
+        default:
+            header.internal_format = GL_RGBA8;
+            header.format = GL_RGBA;
+            break;
+        }
+        break;
+    }
+
+    std::vector<std::vector<uint8_t>> level_data;
+    std::vector<BakedTextureLevel> levels;
+    Image level = std::move(image);
+    while (true) {
+        BakedTextureLevel entry = {};
+        entry.width = level.width;
+        entry.height = level.height;
+        if (format == BakeFormat::Raw) {
+            level_data.push_back(level.pixels);
+        } else {
+            level_data.push_back(compress(level, format));
+        }
+        entry.size = level_data.back().size();
+        levels.push_back(entry);
+
+        if (level.width == 1 && level.height == 1) {
+            break;
+        }
+        level = downsample(level);
+    }
+    header.level_count = levels.size();
+
+    uint64_t offset = sizeof(BakedTextureHeader) +
+                      levels.size() * sizeof(BakedTextureLevel);
+    for (BakedTextureLevel& entry : levels) {
+        offset = (offset + 15) / 16 * 16;
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    std::ofstream file(output_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "FAILED TO OPEN OUTPUT: " << output_path << std::endl;
+        return 1;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)levels.data(),
+               levels.size() * sizeof(BakedTextureLevel));
+    for (size_t i = 0; i < levels.size(); ++i) {
+        std::vector<char> padding(levels[i].offset - (uint64_t)file.tellp(), 0);
+        file.write(padding.data(), padding.size());
+        file.write((const char*)level_data[i].data(), level_data[i].size());
+    }
+    file.close();
+
+    std::cout << output_path.generic_string() << ": " << header.width << "x"
+              << header.height << ", " << header.level_count << " levels, "
+              << offset << " bytes" << std::endl;
+
+    return 0;
+}